@@ -0,0 +1,399 @@
+/*
+    ------------------------------------------------------------------
+
+    This file is part of the Open Ephys GUI
+    Copyright (C) 2016 Open Ephys
+
+    ------------------------------------------------------------------
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Simulated AlphaOmega SDK
+namespace AO
+{
+#include "AOTypes.h"
+#include "AOSystemAPI.h"
+#include "StreamFormat.h"
+}
+
+namespace
+{
+    typedef std::chrono::steady_clock Clock;
+
+    /** Device timestamps count samples of the 44 kHz system clock */
+    const double DEVICE_CLOCK_HZ = 44000.0;
+    const int CONNECTION_DELAY_MS = 300;
+    const int SINE_TABLE_SIZE = 1024;
+
+    /** Microdrive starts 10 mm above target and advances 100 um every 2 s, down to 2 mm below */
+    const int DRIVE_START_DEPTH_UM = 15000;
+    const int DRIVE_STEP_UM = 100;
+    const double DRIVE_STEP_INTERVAL_S = 2.0;
+    const int DRIVE_END_DEPTH_UM = 27000;
+
+    struct SimulatedStream
+    {
+        const char *name;
+        bool groupedName;
+        int numberOfChannels;
+        double samplingRate;
+        int firstChannelID;
+        int sineTableStep;
+        int amplitude;
+        /** A port of 16 digital lines, one word per device tick */
+        bool digital;
+    };
+
+    // Channel naming and rates follow a Neuro Omega with one microelectrode drive and an ECOG headbox
+    const SimulatedStream DEFAULT_STREAMS[] = {
+        {"LFP", false, 5, 1375, 10000, 15, 400, false},
+        {"Macro LFP", false, 5, 1375, 10016, 15, 400, false},
+        {"RAW", false, 5, 44000, 10032, 1, 600, false},
+        {"Macro RAW", false, 5, 44000, 10048, 1, 600, false},
+        {"SPK", false, 5, 44000, 10064, 1, 300, false},
+        {"SEG", false, 5, 44000, 10080, 1, 300, false},
+        {"ECOG LF 1", true, 16, 1375, 10128, 8, 800, false},
+        {"ECOG HF 1", true, 16, 22000, 10256, 2, 800, false},
+        {"EMG 1", true, 16, 44000, 10384, 3, 1000, false},
+        {"ANALOG-IN", false, 4, 2750, 10512, 4, 2000, false},
+        {"Port-", false, 1, 44000, 11200, 0, 0, true}};
+
+    // Single stream systems matching the configurations used for benchmarking
+    const SimulatedStream LFP_STREAMS[] = {{"LFP", false, 5, 1375, 10000, 15, 400, false}};
+    const SimulatedStream RAW_STREAMS[] = {{"RAW", false, 5, 44000, 10032, 1, 600, false}};
+    const SimulatedStream ECOG_STREAMS[] = {{"ECOG HF 1", true, 16, 22000, 10256, 2, 800, false}};
+    const SimulatedStream STRESS_STREAMS[] = {{"SEG 2", true, 256, 44000, 10000, 1, 300, false}};
+
+    struct SimulatedProfile
+    {
+        const char *name;
+        const SimulatedStream *streams;
+        int numberOfStreams;
+    };
+
+    // Selected with the NEUROOMEGA_SIM_PROFILE environment variable
+    const SimulatedProfile SIMULATED_PROFILES[] = {
+        {"default", DEFAULT_STREAMS, sizeof(DEFAULT_STREAMS) / sizeof(SimulatedStream)},
+        {"lfp", LFP_STREAMS, 1},
+        {"raw", RAW_STREAMS, 1},
+        {"ecog", ECOG_STREAMS, 1},
+        {"stress", STRESS_STREAMS, 1}};
+
+    struct SimulatedChannel
+    {
+        int channelID;
+        std::string name;
+        double samplingRate;
+        int sineTableStep;
+        int amplitude;
+        bool digital;
+        bool buffered;
+        long long bufferingSize;
+        long long readPosition;
+    };
+
+    /** State shared by all SDK calls, guarded by lock */
+    class Simulator
+    {
+    public:
+        Simulator()
+        {
+            const char *profileVariable = std::getenv("NEUROOMEGA_SIM_PROFILE");
+            const SimulatedProfile *profile = &SIMULATED_PROFILES[0];
+            for (const SimulatedProfile &candidate : SIMULATED_PROFILES)
+                if (profileVariable != nullptr && strcmp(profileVariable, candidate.name) == 0)
+                    profile = &candidate;
+
+            for (int st = 0; st < profile->numberOfStreams; st++)
+            {
+                const SimulatedStream &stream = profile->streams[st];
+                for (int ch = 0; ch < stream.numberOfChannels; ch++)
+                {
+                    char name[MAX_CHANNEL_NAME_LEN];
+                    const int digits = (stream.numberOfChannels > 99) ? 3 : 2;
+                    if (stream.digital)
+                        snprintf(name, sizeof(name), "%s %d", stream.name, ch + 1);
+                    else if (stream.groupedName)
+                        snprintf(name, sizeof(name), "%s / %0*d", stream.name, digits, ch + 1);
+                    else
+                        snprintf(name, sizeof(name), "%s %0*d", stream.name, digits, ch + 1);
+
+                    SimulatedChannel channel = {stream.firstChannelID + ch, name, stream.samplingRate,
+                                                stream.sineTableStep, stream.amplitude, stream.digital, false, 0, 0};
+                    channelIndex[channel.channelID] = (int)channels.size();
+                    channels.push_back(channel);
+                }
+            }
+
+            for (int i = 0; i < SINE_TABLE_SIZE; i++)
+                sineTable[i] = (float)std::sin(2.0 * 3.14159265358979323846 * i / SINE_TABLE_SIZE);
+
+            // NEUROOMEGA_SIM_SPEED=N runs the device clock N times faster than real time, 0 returns data as fast as it is read
+            const char *speedVariable = std::getenv("NEUROOMEGA_SIM_SPEED");
+            speed = (speedVariable != nullptr) ? std::atof(speedVariable) : 1.0;
+
+            // NEUROOMEGA_SIM_DRIFT_PPM makes the device clock run fast (or slow, if negative) against the host clock
+            const char *driftVariable = std::getenv("NEUROOMEGA_SIM_DRIFT_PPM");
+            clockRate = 1.0 + ((driftVariable != nullptr) ? std::atof(driftVariable) : 0.0) * 1e-6;
+
+            connectionState = AO::eAO_DISCONNECTED;
+            clearTime = Clock::now();
+        }
+
+        std::mutex lock;
+        std::vector<SimulatedChannel> channels;
+        std::unordered_map<int, int> channelIndex;
+        float sineTable[SINE_TABLE_SIZE];
+        double speed;
+        double clockRate;
+
+        int connectionState;
+        Clock::time_point connectionTime;
+        Clock::time_point clearTime;
+
+        std::string lastError;
+        int errorCount = 0;
+
+        void setError(const std::string &error)
+        {
+            lastError = error;
+            errorCount++;
+        }
+
+        bool connected()
+        {
+            if (connectionState == AO::eAO_CONNECTING &&
+                Clock::now() - connectionTime >= std::chrono::milliseconds(CONNECTION_DELAY_MS))
+                connectionState = AO::eAO_CONNECTED;
+            return connectionState == AO::eAO_CONNECTED;
+        }
+
+        double secondsSince(Clock::time_point start)
+        {
+            return std::chrono::duration<double>(Clock::now() - start).count() * std::max(speed, 1.0);
+        }
+
+        /** Samples the device has produced for a channel since the buffers were cleared */
+        long long producedSamples(const SimulatedChannel &channel)
+        {
+            return (long long)(std::chrono::duration<double>(Clock::now() - clearTime).count() * speed * clockRate * channel.samplingRate);
+        }
+
+        AO::int16 sample(const SimulatedChannel &channel, long long position)
+        {
+            // Line 1 toggles every half second, line 2 pulses for 10 ms 0.25 s into every second
+            if (channel.digital)
+            {
+                const long long samplesPerSecond = (long long)channel.samplingRate;
+                const long long withinSecond = position % samplesPerSecond;
+                return (AO::int16)(((position / (samplesPerSecond / 2)) & 1) |
+                                   ((withinSecond >= samplesPerSecond / 4 && withinSecond < samplesPerSecond / 4 + samplesPerSecond / 100) ? 2 : 0));
+            }
+
+            // Sine plus a cheap hash based noise floor, deterministic in channel and position
+            unsigned int noise = (unsigned int)(position * 2654435761u) ^ (unsigned int)(channel.channelID * 40503u);
+            noise ^= noise >> 15;
+            float value = channel.amplitude * sineTable[(position * channel.sineTableStep) & (SINE_TABLE_SIZE - 1)];
+            return (AO::int16)(value + (int)(noise & 63) - 32);
+        }
+    };
+
+    Simulator &simulator()
+    {
+        static Simulator instance;
+        return instance;
+    }
+}
+
+// The simulated system never calls back, the plugin polls isConnected
+int AO::DefaultStartConnection(MAC_ADDR *pSystemMAC, void (* /*pfnCallbackFunction*/)())
+{
+    Simulator &sim = simulator();
+    std::lock_guard<std::mutex> guard(sim.lock);
+    if (pSystemMAC == nullptr)
+    {
+        sim.setError("DefaultStartConnection: MAC address is null");
+        return eAO_BAD_ARG;
+    }
+    sim.connectionState = eAO_CONNECTING;
+    sim.connectionTime = Clock::now();
+    return eAO_OK;
+}
+
+int AO::isConnected()
+{
+    Simulator &sim = simulator();
+    std::lock_guard<std::mutex> guard(sim.lock);
+    sim.connected();
+    return sim.connectionState;
+}
+
+int AO::CloseConnection()
+{
+    Simulator &sim = simulator();
+    std::lock_guard<std::mutex> guard(sim.lock);
+    sim.connectionState = eAO_DISCONNECTED;
+    for (SimulatedChannel &channel : sim.channels)
+        channel.buffered = false;
+    return eAO_OK;
+}
+
+int AO::ErrorHandlingfunc(int *pErrorCount, cChar *sError, int nErrorCapacity)
+{
+    Simulator &sim = simulator();
+    std::lock_guard<std::mutex> guard(sim.lock);
+    if (pErrorCount != nullptr)
+        *pErrorCount = sim.errorCount;
+    if (sError != nullptr && nErrorCapacity > 0)
+    {
+        strncpy(sError, sim.lastError.c_str(), nErrorCapacity - 1);
+        sError[nErrorCapacity - 1] = 0;
+    }
+    sim.errorCount = 0;
+    return eAO_OK;
+}
+
+int AO::GetChannelsCount(uint32 *pChannelsCount)
+{
+    Simulator &sim = simulator();
+    std::lock_guard<std::mutex> guard(sim.lock);
+    if (!sim.connected())
+        return eAO_NOT_CONNECTED;
+    *pChannelsCount = (uint32)sim.channels.size();
+    return eAO_OK;
+}
+
+int AO::GetAllChannels(SInformation *pChannelsInfo, int nChannelsCount)
+{
+    Simulator &sim = simulator();
+    std::lock_guard<std::mutex> guard(sim.lock);
+    if (!sim.connected())
+        return eAO_NOT_CONNECTED;
+    if (nChannelsCount < (int)sim.channels.size())
+    {
+        sim.setError("GetAllChannels: array too small");
+        return eAO_BAD_ARG;
+    }
+    for (size_t i = 0; i < sim.channels.size(); i++)
+    {
+        pChannelsInfo[i].channelID = sim.channels[i].channelID;
+        strncpy(pChannelsInfo[i].channelName, sim.channels[i].name.c_str(), MAX_CHANNEL_NAME_LEN - 1);
+        pChannelsInfo[i].channelName[MAX_CHANNEL_NAME_LEN - 1] = 0;
+    }
+    return eAO_OK;
+}
+
+int AO::AddBufferChannel(int nChannelID, int nBufferingSize)
+{
+    Simulator &sim = simulator();
+    std::lock_guard<std::mutex> guard(sim.lock);
+    auto found = sim.channelIndex.find(nChannelID);
+    if (found == sim.channelIndex.end())
+    {
+        sim.setError("AddBufferChannel: unknown channel " + std::to_string(nChannelID));
+        return eAO_BAD_ARG;
+    }
+    SimulatedChannel &channel = sim.channels[found->second];
+    channel.buffered = true;
+    channel.bufferingSize = (long long)(nBufferingSize / 1000.0 * channel.samplingRate);
+    channel.readPosition = sim.producedSamples(channel);
+    return eAO_OK;
+}
+
+int AO::ClearBuffers()
+{
+    Simulator &sim = simulator();
+    std::lock_guard<std::mutex> guard(sim.lock);
+    sim.clearTime = Clock::now();
+    for (SimulatedChannel &channel : sim.channels)
+        channel.readPosition = 0;
+    return eAO_OK;
+}
+
+int AO::GetAlignedData(int16 *pData, int nDataCapacity, int *pActualDataSize, int *pChannelsArray, int nChannelsCount, ULONG *pTS)
+{
+    Simulator &sim = simulator();
+    std::lock_guard<std::mutex> guard(sim.lock);
+    *pActualDataSize = 0;
+
+    if (!sim.connected())
+        return eAO_NOT_CONNECTED;
+    if (pData == nullptr || pChannelsArray == nullptr || nChannelsCount <= 0)
+    {
+        sim.setError("GetAlignedData: bad arguments");
+        return eAO_BAD_ARG;
+    }
+
+    long long numberOfSamples = nDataCapacity / nChannelsCount;
+    for (int ch = 0; ch < nChannelsCount; ch++)
+    {
+        auto found = sim.channelIndex.find(pChannelsArray[ch]);
+        if (found == sim.channelIndex.end() || !sim.channels[found->second].buffered)
+        {
+            sim.setError("GetAlignedData: channel " + std::to_string(pChannelsArray[ch]) + " is not buffered");
+            return eAO_BAD_ARG;
+        }
+        if (sim.speed <= 0)
+            continue;
+
+        // Anything older than the buffering size has been overwritten, like the SDK circular buffer
+        SimulatedChannel &channel = sim.channels[found->second];
+        long long produced = sim.producedSamples(channel);
+        channel.readPosition = std::max(channel.readPosition, produced - channel.bufferingSize);
+        numberOfSamples = std::min(numberOfSamples, produced - channel.readPosition);
+    }
+
+    if (numberOfSamples <= 0)
+        return eAO_MEM_EMPTY;
+
+    SimulatedChannel &first = sim.channels[sim.channelIndex[pChannelsArray[0]]];
+    // The device counter is 32 bits wide whatever the size of ULONG on the host
+    *pTS = (ULONG)(uint32)(first.readPosition * (DEVICE_CLOCK_HZ / first.samplingRate));
+
+    for (int ch = 0; ch < nChannelsCount; ch++)
+    {
+        SimulatedChannel &channel = sim.channels[sim.channelIndex[pChannelsArray[ch]]];
+        int16 *channelData = pData + ch * numberOfSamples;
+        for (long long samp = 0; samp < numberOfSamples; samp++)
+            channelData[samp] = sim.sample(channel, channel.readPosition + samp);
+        channel.readPosition += numberOfSamples;
+    }
+
+    *pActualDataSize = (int)(numberOfSamples * nChannelsCount);
+    return eAO_OK;
+}
+
+int AO::GetDriveDepth(int32 *pDepth)
+{
+    Simulator &sim = simulator();
+    std::lock_guard<std::mutex> guard(sim.lock);
+    if (!sim.connected())
+        return eAO_NOT_CONNECTED;
+    int steps = (int)(sim.secondsSince(sim.connectionTime) / DRIVE_STEP_INTERVAL_S);
+    *pDepth = std::min(DRIVE_START_DEPTH_UM + steps * DRIVE_STEP_UM, DRIVE_END_DEPTH_UM);
+    return eAO_OK;
+}
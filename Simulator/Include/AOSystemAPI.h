@@ -0,0 +1,60 @@
+/*
+	------------------------------------------------------------------
+
+	This file is part of the Open Ephys GUI
+	Copyright (C) 2020 Open Ephys
+
+	------------------------------------------------------------------
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Simulated AlphaOmega SDK, exposing the subset of the Neuro Omega
+// system API the plugin uses. Requires AOTypes.h to be included first.
+
+#ifndef __AOSYSTEMAPI_SIM_H__
+#define __AOSYSTEMAPI_SIM_H__
+
+/** Starts connecting to the system, isConnected reports eAO_CONNECTED once done */
+int DefaultStartConnection(MAC_ADDR *pSystemMAC, void (*pfnCallbackFunction)());
+
+/** Returns one of EAOConnection */
+int isConnected();
+
+int CloseConnection();
+
+/** Fills the last error message and the number of errors since the last call */
+int ErrorHandlingfunc(int *pErrorCount, cChar *sError, int nErrorCapacity);
+
+int GetChannelsCount(uint32 *pChannelsCount);
+
+int GetAllChannels(SInformation *pChannelsInfo, int nChannelsCount);
+
+/** Starts buffering nBufferingSize milliseconds of a channel */
+int AddBufferChannel(int nChannelID, int nBufferingSize);
+
+/** Drops everything buffered so far */
+int ClearBuffers();
+
+/**
+	Reads the same number of samples from every channel in pChannelsArray,
+	channel-major, into pData. pTS receives the device timestamp of the first sample.
+	Returns eAO_MEM_EMPTY when no new samples are buffered.
+*/
+int GetAlignedData(int16 *pData, int nDataCapacity, int *pActualDataSize, int *pChannelsArray, int nChannelsCount, ULONG *pTS);
+
+/** Microdrive depth in micrometers */
+int GetDriveDepth(int32 *pDepth);
+
+#endif // __AOSYSTEMAPI_SIM_H__
@@ -0,0 +1,65 @@
+/*
+	------------------------------------------------------------------
+
+	This file is part of the Open Ephys GUI
+	Copyright (C) 2020 Open Ephys
+
+	------------------------------------------------------------------
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Simulated AlphaOmega SDK types.
+// Like the proprietary headers this file is included inside a namespace,
+// so it must not include any other header.
+
+#ifndef __AOTYPES_SIM_H__
+#define __AOTYPES_SIM_H__
+
+typedef short int16;
+typedef int int32;
+typedef unsigned int uint32;
+typedef unsigned long ULONG;
+typedef char cChar;
+
+#define MAX_CHANNEL_NAME_LEN 64
+
+enum EAOResult
+{
+	eAO_OK = 0,
+	eAO_BAD_ARG = 1,
+	eAO_MEM_EMPTY = 2,
+	eAO_NOT_CONNECTED = 3,
+	eAO_FAIL = 4
+};
+
+enum EAOConnection
+{
+	eAO_DISCONNECTED = 0,
+	eAO_CONNECTED = 1,
+	eAO_CONNECTING = 2
+};
+
+struct MAC_ADDR
+{
+	int addr[6];
+};
+
+struct SInformation
+{
+	int channelID;
+	char channelName[MAX_CHANNEL_NAME_LEN];
+};
+
+#endif // __AOTYPES_SIM_H__
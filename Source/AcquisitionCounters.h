@@ -0,0 +1,215 @@
+/*
+	------------------------------------------------------------------
+
+	This file is part of the Open Ephys GUI
+	Copyright (C) 2020 Open Ephys
+
+	------------------------------------------------------------------
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __ACQUISITIONCOUNTERS_H__
+#define __ACQUISITIONCOUNTERS_H__
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <stdint.h>
+
+namespace AONode
+{
+	/** Monotonic time in nanoseconds */
+	inline int64_t getTimeNs()
+	{
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+
+	/**
+		Log-linear latency histogram in the spirit of HdrHistogram.
+
+		Values are bucketed by power of two, each power split in 16 linear
+		sub-buckets, giving ~6% resolution from 1 ns up to hours. Counts are
+		relaxed atomics so one thread can record while another reads.
+	*/
+	class LatencyHistogram
+	{
+	public:
+		LatencyHistogram() { reset(); }
+		LatencyHistogram(const LatencyHistogram &) = delete;
+		LatencyHistogram &operator=(const LatencyHistogram &) = delete;
+
+		void record(int64_t valueNs)
+		{
+			std::atomic<uint64_t> &bucket = counts[getBucketIndex(valueNs)];
+			bucket.store(bucket.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+			if (valueNs > maxValue.load(std::memory_order_relaxed))
+				maxValue.store(valueNs, std::memory_order_relaxed);
+		}
+
+		void reset()
+		{
+			for (auto &bucket : counts)
+				bucket.store(0, std::memory_order_relaxed);
+			maxValue.store(0, std::memory_order_relaxed);
+		}
+
+		uint64_t getCount() const
+		{
+			uint64_t total = 0;
+			for (auto &bucket : counts)
+				total += bucket.load(std::memory_order_relaxed);
+			return total;
+		}
+
+		int64_t getMax() const { return maxValue.load(std::memory_order_relaxed); }
+
+		/** Value below which the given fraction (0..1) of the recorded values fall */
+		int64_t getPercentile(double fraction) const
+		{
+			const uint64_t total = getCount();
+			if (total == 0)
+				return 0;
+
+			const uint64_t rank = std::max<uint64_t>(1, (uint64_t)std::ceil(fraction * total));
+			uint64_t seen = 0;
+			for (int i = 0; i < NUM_BUCKETS; i++)
+			{
+				seen += counts[i].load(std::memory_order_relaxed);
+				if (seen >= rank)
+					return std::min(getBucketValue(i), getMax());
+			}
+			return getMax();
+		}
+
+	private:
+		static const int SUB_BUCKETS = 16;
+		static const int NUM_BUCKETS = 61 * SUB_BUCKETS;
+
+		static int getBucketIndex(int64_t value)
+		{
+			if (value < SUB_BUCKETS)
+				return (int)std::max<int64_t>(value, 0);
+
+			int shift = 0;
+			while ((value >> shift) >= 2 * SUB_BUCKETS)
+				shift++;
+			return (shift + 1) * SUB_BUCKETS + (int)(value >> shift) - SUB_BUCKETS;
+		}
+
+		/** Upper bound of a bucket */
+		static int64_t getBucketValue(int index)
+		{
+			if (index < SUB_BUCKETS)
+				return index;
+
+			const int shift = index / SUB_BUCKETS - 1;
+			return ((int64_t)(index % SUB_BUCKETS + SUB_BUCKETS + 1) << shift) - 1;
+		}
+
+		std::atomic<uint64_t> counts[NUM_BUCKETS];
+		std::atomic<int64_t> maxValue;
+	};
+
+	/**
+		Where the time goes between GetAlignedData and the DataBuffer, for one stream.
+
+		Recorded once per block, each histogram by a single thread.
+	*/
+	struct StreamLatency
+	{
+		/** GetAlignedData calls that returned data */
+		LatencyHistogram fetch;
+		/** Sample numbers, timestamps and int16 to float conversion */
+		LatencyHistogram convert;
+		LatencyHistogram addToBuffer;
+		/** From the timestamp of the newest sample of a block until the block is in the DataBuffer */
+		LatencyHistogram age;
+
+		void reset()
+		{
+			fetch.reset();
+			convert.reset();
+			addToBuffer.reset();
+			age.reset();
+		}
+	};
+
+	/**
+		Live counters of one stream, updated with relaxed atomics by the
+		thread that reads or converts it and read from any thread.
+	*/
+	struct StreamCounters
+	{
+		/** Samples per channel added to the DataBuffer */
+		std::atomic<int64_t> samples{0};
+		std::atomic<int64_t> blocks{0};
+		/** GetAlignedData calls that failed for another reason than an empty buffer */
+		std::atomic<int64_t> sdkErrors{0};
+
+		/** Samples missing from the device, read in time */
+		std::atomic<int64_t> gaps{0};
+		/** Samples overwritten in the SDK buffer because they were not read in time */
+		std::atomic<int64_t> overruns{0};
+		/** Blocks starting before the previous one ended */
+		std::atomic<int64_t> overlaps{0};
+		std::atomic<int64_t> lostSamples{0};
+		/** Sample number of the latest gap, overrun or overlap */
+		std::atomic<int64_t> lastDiscontinuitySample{0};
+
+		/** DataBuffer samples not yet read by the GUI, after the last block and at most since the last snapshot */
+		std::atomic<int> bufferFill{0};
+		std::atomic<int> maxBufferFill{0};
+
+		static void increment(std::atomic<int64_t> &counter, int64_t amount = 1)
+		{
+			counter.fetch_add(amount, std::memory_order_relaxed);
+		}
+	};
+
+	/** Plain copy of one stream's StreamCounters, with its empty polls */
+	struct StreamCountersValues
+	{
+		int64_t samples;
+		int64_t blocks;
+		int64_t emptyPolls;
+		int64_t sdkErrors;
+		int64_t gaps;
+		int64_t overruns;
+		int64_t overlaps;
+		int64_t lostSamples;
+		int64_t lastDiscontinuitySample;
+		int bufferFill;
+		int maxBufferFill;
+	};
+
+	/**
+		Counters of every stream at one instant, fixed size so the data thread
+		can fill and publish it through a SeqLockSlot without allocating.
+		Streams past MAX_STREAMS are not counted.
+	*/
+	struct CountersSnapshot
+	{
+		static const int MAX_STREAMS = 64;
+
+		/** getTimeNs() when taken, 0 if no snapshot was taken yet */
+		int64_t snapshotNs;
+		int numberOfStreams;
+		/** One per StreamPlan::sourceBufferIdx */
+		StreamCountersValues streams[MAX_STREAMS];
+	};
+}
+
+#endif // __ACQUISITIONCOUNTERS_H__
@@ -0,0 +1,394 @@
+/*
+    ------------------------------------------------------------------
+
+    This file is part of the Open Ephys GUI
+    Copyright (C) 2016 Open Ephys
+
+    ------------------------------------------------------------------
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include "AcquisitionEngine.h"
+#include "SampleConversion.h"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace AONode;
+
+// Each GetAlignedData call can return this much of a stream, and twice as much per truncated call, up to the cap
+#define FETCH_BUFFER_MS 50
+#define MAX_FETCH_BUFFER_ITEMS (1 << 20)
+// Longest wait of the data thread for the stream readers, keeps it responsive to stop requests
+#define READERS_WAIT_MS 10
+
+AcquisitionEngine::AcquisitionEngine(Host &host_) : host(host_)
+{
+    countersValues = CountersSnapshot{};
+}
+
+AcquisitionEngine::~AcquisitionEngine()
+{
+    stop();
+}
+
+void AcquisitionEngine::setMode(AcquisitionMode mode_)
+{
+    mode = mode_;
+}
+
+void AcquisitionEngine::start(SampleSource &source_, AcquisitionPlan plan_, std::unique_ptr<FetchPlan> firstFetchPlan, int digitalPortChannelID)
+{
+    // The readers of the last run are gone, nothing reads the plans it replaced
+    streamReaders.clear();
+    source = &source_;
+    plan = std::move(plan_);
+    fetchPlan.clearRetired();
+    fetchPlan.publish(std::move(firstFetchPlan));
+
+    prepareStreamScratch();
+
+    for (int channelID : plan.channelIDs)
+        source->addBufferChannel(channelID, AO_BUFFER_SIZE_MS);
+    digitalInputsRead = (digitalPortChannelID >= 0);
+    if (digitalInputsRead)
+    {
+        source->addBufferChannel(digitalPortChannelID, AO_BUFFER_SIZE_MS);
+        if (digitalInputs == nullptr)
+            digitalInputs = std::make_unique<DigitalInputs>();
+        digitalInputs->prepare(digitalPortChannelID, (int)plan.streams.size());
+    }
+    source->clearBuffers();
+
+    pollWaitStrategy.prepare(plan);
+
+    // Timestamps are seconds since the device buffers were cleared, on the host clock
+    startNs = getTimeNs();
+    streamClocks.clear();
+    streamCounters.clear();
+    streamLatencies.clear();
+    streamAligners.clear();
+    for (const StreamPlan &stream : plan.streams)
+    {
+        streamClocks.push_back(std::make_unique<DeviceClockModel>());
+        streamClocks.back()->reset(stream.samplingRate, startNs);
+        streamCounters.push_back(std::make_unique<StreamCounters>());
+        streamLatencies.push_back(std::make_unique<StreamLatency>());
+        streamAligners.push_back(std::make_unique<FetchAligner>(*source, stream, *streamCounters.back()));
+    }
+    streamSampleCount.assign(plan.streams.size(), 0);
+
+    // Samples/s of the first snapshot are measured from the start
+    countersValues = CountersSnapshot{};
+    countersValues.snapshotNs = startNs;
+    countersSlot.publish(countersValues);
+
+    if (mode == AcquisitionMode::READER_THREADS)
+        startStreamReaders();
+}
+
+void AcquisitionEngine::stop()
+{
+    for (const std::unique_ptr<StreamReader> &reader : streamReaders)
+        reader->signalThreadShouldExit();
+
+    // Kept until the next start, for their counters
+    for (const std::unique_ptr<StreamReader> &reader : streamReaders)
+        reader->stopThread();
+}
+
+const StreamReader *AcquisitionEngine::getReader(int sourceBufferIdx) const
+{
+    return sourceBufferIdx < (int)streamReaders.size() ? streamReaders[sourceBufferIdx].get() : nullptr;
+}
+
+void AcquisitionEngine::publishFetchPlan(std::unique_ptr<FetchPlan> newPlan)
+{
+    fetchPlan.publish(std::move(newPlan));
+}
+
+void AcquisitionEngine::prepareStreamScratch()
+{
+    for (const StreamPlan &stream : plan.streams)
+    {
+        while ((int)streamScratch.size() <= stream.sourceBufferIdx)
+            streamScratch.push_back(std::make_unique<StreamScratch>());
+
+        int samplesPerFetch = (int)std::ceil(stream.samplingRate * FETCH_BUFFER_MS / 1000.0);
+        samplesPerFetch = std::min(std::max(1, MAX_FETCH_BUFFER_ITEMS / stream.numberOfChannels), std::max(1, samplesPerFetch));
+
+        streamScratch[stream.sourceBufferIdx]->ensureSize(stream.numberOfChannels, samplesPerFetch);
+    }
+}
+
+void AcquisitionEngine::growFetchBuffer(const StreamPlan &stream)
+{
+    StreamScratch *scratch = streamScratch[stream.sourceBufferIdx].get();
+    const int samplesPerFetch = scratch->getFetchCapacity() / stream.numberOfChannels;
+    const int maxSamplesPerFetch = std::max(1, MAX_FETCH_BUFFER_ITEMS / stream.numberOfChannels);
+    if (samplesPerFetch >= maxSamplesPerFetch)
+        return;
+
+    scratch->ensureSize(stream.numberOfChannels, std::min(2 * samplesPerFetch, maxSamplesPerFetch));
+    fetchBufferGrown = true;
+    host.fetchBufferGrown(stream, scratch->getFetchCapacity() / stream.numberOfChannels);
+}
+
+void AcquisitionEngine::publishCountersSnapshot()
+{
+    // Plain copies only, the JSON is built on the message thread
+    countersValues.numberOfStreams = 0;
+    for (const StreamPlan &stream : plan.streams)
+    {
+        if (stream.sourceBufferIdx >= CountersSnapshot::MAX_STREAMS)
+            continue;
+
+        StreamCounters *counters = streamCounters[stream.sourceBufferIdx].get();
+        StreamCountersValues &values = countersValues.streams[stream.sourceBufferIdx];
+        values.samples = counters->samples.load(std::memory_order_relaxed);
+        values.blocks = counters->blocks.load(std::memory_order_relaxed);
+        values.emptyPolls = pollWaitStrategy.getEmptyPolls(stream.sourceBufferIdx);
+        values.sdkErrors = counters->sdkErrors.load(std::memory_order_relaxed);
+        values.gaps = counters->gaps.load(std::memory_order_relaxed);
+        values.overruns = counters->overruns.load(std::memory_order_relaxed);
+        values.overlaps = counters->overlaps.load(std::memory_order_relaxed);
+        values.lostSamples = counters->lostSamples.load(std::memory_order_relaxed);
+        values.lastDiscontinuitySample = counters->lastDiscontinuitySample.load(std::memory_order_relaxed);
+        values.bufferFill = counters->bufferFill.load(std::memory_order_relaxed);
+        values.maxBufferFill = counters->maxBufferFill.exchange(0, std::memory_order_relaxed);
+        countersValues.numberOfStreams = std::max(countersValues.numberOfStreams, stream.sourceBufferIdx + 1);
+    }
+    countersValues.snapshotNs = getTimeNs();
+
+    countersSlot.publish(countersValues);
+}
+
+void AcquisitionEngine::readBlocks()
+{
+    fetchBufferGrown = false;
+
+    // Changes read before the blocks they belong to are placed on time
+    if (digitalInputsRead)
+        digitalInputs->poll(*source);
+
+    if (mode == AcquisitionMode::READER_THREADS && !streamReaders.empty())
+        drainStreamReaders();
+    else if (mode == AcquisitionMode::SCHEDULED)
+        pollScheduledStreams();
+    else
+        pollStreamsInSequence();
+
+    if (getTimeNs() - countersValues.snapshotNs >= (int64_t)COUNTERS_SNAPSHOT_INTERVAL_MS * 1000000)
+        publishCountersSnapshot();
+}
+
+void AcquisitionEngine::pollStreamsInSequence()
+{
+    int numberOfSamplesFromDevice;
+
+    for (const StreamPlan &stream : plan.streams)
+    {
+        numberOfSamplesFromDevice = updateStreamDataArrayFromAOAndGetNumberOfSamples(stream);
+
+        // Only happens when the host asked to stop while waiting
+        if (numberOfSamplesFromDevice == 0)
+            continue;
+
+        addStreamDataArrayToSourceBuffer(stream, numberOfSamplesFromDevice);
+    }
+}
+
+void AcquisitionEngine::pollScheduledStreams()
+{
+    pollWaitStrategy.waitForEarliestDeadline(plan);
+
+    // A stream with nothing buffered is rescheduled, it never holds back the others
+    const int64_t nowNs = getTimeNs();
+    for (const StreamPlan &stream : plan.streams)
+    {
+        if (pollWaitStrategy.getExpectedReadyNs(stream) > nowNs)
+            continue;
+
+        int numberOfSamplesFromDevice = pollStreamDataArrayFromAO(stream);
+        if (numberOfSamplesFromDevice == 0)
+        {
+            pollWaitStrategy.emptyPollDeferred(stream);
+            continue;
+        }
+
+        pollWaitStrategy.blockReceived(stream);
+        addStreamDataArrayToSourceBuffer(stream, numberOfSamplesFromDevice);
+    }
+}
+
+void AcquisitionEngine::drainStreamReaders()
+{
+    bool blockAdded = false;
+    int numberOfSamplesFromDevice;
+    StreamReader::BlockHeader block;
+
+    for (const StreamPlan &stream : plan.streams)
+    {
+        StreamReader *reader = streamReaders[stream.sourceBufferIdx].get();
+        while ((numberOfSamplesFromDevice = reader->popBlock(streamScratch[stream.sourceBufferIdx]->fetchData.get(), block)) > 0)
+        {
+            deviceFetch = block.fetch;
+            deviceTimeStamp = block.timeStamp;
+            deviceBlockArrivalNs = block.arrivalNs;
+            deviceBlockFetchNs = block.fetchNs;
+            addStreamDataArrayToSourceBuffer(stream, numberOfSamplesFromDevice);
+            blockAdded = true;
+        }
+    }
+
+    // The timeout keeps the thread responsive to stop requests when no stream delivers
+    if (!blockAdded)
+        readersDataReady.wait(READERS_WAIT_MS);
+}
+
+void AcquisitionEngine::startStreamReaders()
+{
+    for (const StreamPlan &stream : plan.streams)
+        streamReaders.push_back(std::make_unique<StreamReader>(*source, stream, fetchPlan, streamScratch[stream.sourceBufferIdx]->getFetchCapacity(), pollWaitStrategy, *streamCounters[stream.sourceBufferIdx], readersDataReady));
+
+    for (const std::unique_ptr<StreamReader> &reader : streamReaders)
+        reader->startThread();
+}
+
+void AcquisitionEngine::addStreamDataArrayToSourceBuffer(const StreamPlan &stream, int numberOfItemsFetched)
+{
+    const int numberOfSamplesPerChannel = numberOfItemsFetched / deviceFetch->getNumberOfChannels();
+    const int64_t blockStartNs = getTimeNs();
+
+    StreamScratch *scratch = streamScratch[stream.sourceBufferIdx].get();
+    int64_t *sampleCount = scratch->sampleCount.get();
+    double *timeStamps = scratch->timeStamps.get();
+    uint64_t *eventCodes = scratch->eventCodes.get();
+
+    DeviceClockModel *clock = streamClocks[stream.sourceBufferIdx].get();
+    const int64_t firstTick = clock->unwrap((uint32_t)deviceTimeStamp);
+    checkStreamContinuity(stream, firstTick);
+
+    const int64_t firstSampleCount = streamSampleCount[stream.sourceBufferIdx];
+    host.blockFetched(stream, *deviceFetch, (uint32_t)deviceTimeStamp, firstSampleCount, scratch->fetchData.get(), numberOfSamplesPerChannel);
+    deviceFetch->expand(scratch->fetchData.get(), stream.numberOfChannels, numberOfSamplesPerChannel);
+
+    for (int samp = 0; samp < numberOfSamplesPerChannel; samp++)
+        sampleCount[samp] = firstSampleCount + samp;
+
+    clock->timeStampBlock(firstTick, firstSampleCount, numberOfSamplesPerChannel, deviceBlockArrivalNs, timeStamps);
+
+    if (digitalInputsRead)
+        digitalInputs->fillEventCodes(stream.sourceBufferIdx, (uint32_t)deviceTimeStamp, clock->getTicksPerSample(), numberOfSamplesPerChannel, eventCodes);
+    else
+        std::fill(eventCodes, eventCodes + numberOfSamplesPerChannel, (uint64_t)0);
+
+    deinterleaveAndScale(scratch->fetchData.get(), scratch->sourceBufferData.get(),
+                         stream.numberOfChannels, numberOfSamplesPerChannel, stream.bitVolts);
+
+    const int64_t convertedNs = getTimeNs();
+    streamSampleCount[stream.sourceBufferIdx] = firstSampleCount + numberOfSamplesPerChannel;
+    const int bufferFill = host.addBlock(stream, *scratch, firstSampleCount, numberOfSamplesPerChannel, blockStartNs);
+    const int64_t bufferedNs = getTimeNs();
+
+    StreamCounters *counters = streamCounters[stream.sourceBufferIdx].get();
+    StreamCounters::increment(counters->samples, numberOfSamplesPerChannel);
+    StreamCounters::increment(counters->blocks);
+    counters->bufferFill.store(bufferFill, std::memory_order_relaxed);
+    if (bufferFill > counters->maxBufferFill.load(std::memory_order_relaxed))
+        counters->maxBufferFill.store(bufferFill, std::memory_order_relaxed);
+
+    StreamLatency *latency = streamLatencies[stream.sourceBufferIdx].get();
+    latency->fetch.record(deviceBlockFetchNs);
+    latency->convert.record(convertedNs - blockStartNs);
+    latency->addToBuffer.record(bufferedNs - convertedNs);
+    if (numberOfSamplesPerChannel > 0)
+        latency->age.record(bufferedNs - startNs - (int64_t)(timeStamps[numberOfSamplesPerChannel - 1] * 1e9));
+
+    // A full buffer means the SDK had more, the readers keep the size their rings were made for
+    if (numberOfSamplesPerChannel >= scratch->getFetchCapacity() / stream.numberOfChannels && streamReaders.empty())
+        growFetchBuffer(stream);
+}
+
+void AcquisitionEngine::checkStreamContinuity(const StreamPlan &stream, int64_t firstTick)
+{
+    const DeviceClockModel *clock = streamClocks[stream.sourceBufferIdx].get();
+    const int64_t missingSamples = clock->getMissingSamples(firstTick);
+    if (missingSamples == 0)
+        return;
+
+    StreamCounters *counters = streamCounters[stream.sourceBufferIdx].get();
+    const int64_t firstMissingSample = streamSampleCount[stream.sourceBufferIdx];
+
+    counters->lastDiscontinuitySample.store(firstMissingSample, std::memory_order_relaxed);
+    if (missingSamples < 0)
+    {
+        // Sample numbers never go back, the overlapping samples are kept as they are
+        StreamCounters::increment(counters->overlaps);
+        return;
+    }
+
+    // Not reading for longer than the SDK buffers means the lost samples were overwritten
+    const bool overrun = (deviceBlockArrivalNs - clock->getLastArrivalNs()) >= (int64_t)AO_BUFFER_SIZE_MS * 1000000;
+    StreamCounters::increment(overrun ? counters->overruns : counters->gaps);
+    StreamCounters::increment(counters->lostSamples, missingSamples);
+
+    // Later samples keep the sample numbers they would have had without the loss, the Host reports it from the counters
+    streamSampleCount[stream.sourceBufferIdx] = firstMissingSample + missingSamples;
+}
+
+int AcquisitionEngine::updateStreamDataArrayFromAOAndGetNumberOfSamples(const StreamPlan &stream)
+{
+    int numberOfSamplesFromDevice;
+
+    pollWaitStrategy.waitForNextBlock(stream);
+    for (int emptyPolls = 0; !host.shouldStop(); emptyPolls++)
+    {
+        numberOfSamplesFromDevice = pollStreamDataArrayFromAO(stream);
+        if (numberOfSamplesFromDevice > 0)
+        {
+            pollWaitStrategy.blockReceived(stream);
+            return numberOfSamplesFromDevice;
+        }
+        pollWaitStrategy.waitAfterEmptyPoll(stream, emptyPolls);
+    }
+    return 0;
+}
+
+int AcquisitionEngine::pollStreamDataArrayFromAO(const StreamPlan &stream)
+{
+    int numberOfSamplesFromDevice = 0;
+    const int64_t fetchStartNs = getTimeNs();
+    StreamScratch *scratch = streamScratch[stream.sourceBufferIdx].get();
+    FetchAligner *aligner = streamAligners[stream.sourceBufferIdx].get();
+    const StreamFetch &fetch = aligner->getFetch(fetchPlan.get()->streams[stream.sourceBufferIdx], scratch->fetchData.get(), scratch->getFetchCapacity());
+    const int capacity = scratch->getFetchCapacity() / stream.numberOfChannels * fetch.getNumberOfChannels();
+    // The SDK only reads the channel IDs
+    int status = source->getAlignedData(scratch->fetchData.get(), capacity, &numberOfSamplesFromDevice, const_cast<int *>(fetch.channelIDs.data()), fetch.getNumberOfChannels(), &deviceTimeStamp);
+    deviceBlockArrivalNs = getTimeNs();
+    deviceBlockFetchNs = deviceBlockArrivalNs - fetchStartNs;
+    if (status == AO::eAO_OK && numberOfSamplesFromDevice > 0)
+    {
+        aligner->blockFetched(deviceTimeStamp, numberOfSamplesFromDevice / fetch.getNumberOfChannels());
+        deviceFetch = &fetch;
+        return numberOfSamplesFromDevice;
+    }
+
+    // Whatever a failed call left in the buffer is not a block
+    if (status != AO::eAO_OK && status != AO::eAO_MEM_EMPTY)
+        StreamCounters::increment(streamCounters[stream.sourceBufferIdx]->sdkErrors);
+    return 0;
+}
@@ -0,0 +1,217 @@
+/*
+	------------------------------------------------------------------
+
+	This file is part of the Open Ephys GUI
+	Copyright (C) 2020 Open Ephys
+
+	------------------------------------------------------------------
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __ACQUISITIONENGINE_H__
+#define __ACQUISITIONENGINE_H__
+
+#include "AcquisitionCounters.h"
+#include "AcquisitionPlan.h"
+#include "DeviceClock.h"
+#include "DigitalInputs.h"
+#include "FetchAligner.h"
+#include "FetchPlan.h"
+#include "PollWaitStrategy.h"
+#include "SampleSource.h"
+#include "SeqLock.h"
+#include "StreamReader.h"
+#include "StreamScratch.h"
+
+#include <memory>
+#include <stdint.h>
+#include <vector>
+
+namespace AONode
+{
+	/** Order in which the data thread reads the streams, values match the editor selector IDs */
+	enum class AcquisitionMode
+	{
+		/** One stream after the other, each waited on until it has data */
+		SEQUENTIAL = 1,
+		/** Every stream on its own deadline, empty streams are skipped */
+		SCHEDULED,
+		/** Every stream read by its own thread, the data thread only converts */
+		READER_THREADS
+	};
+
+	/**
+		The acquisition path of DeviceThread, without JUCE or the GUI.
+
+		Reads the streams of an AcquisitionPlan from a SampleSource in one of
+		the AcquisitionModes, unwraps and checks the device timestamps, places
+		the digital input changes, converts every block to scaled floats and
+		hands it to its Host, which puts it in a DataBuffer. Gaps, overruns and
+		overlaps are only counted, the Host reports them from the snapshots. The headless
+		benchmark and the tests run it against the simulated SDK.
+
+		start, stop and publishFetchPlan are called while the data thread is
+		not running or from the thread that owns the engine, readBlocks from
+		the data thread only.
+	*/
+	class AcquisitionEngine
+	{
+	public:
+		/** How much of every channel the SDK keeps buffered */
+		static const int AO_BUFFER_SIZE_MS = 5000;
+		/** How often the data thread publishes the counters */
+		static const int COUNTERS_SNAPSHOT_INTERVAL_MS = 1000;
+
+		/** Where the blocks go, every call is made on the data thread */
+		class Host
+		{
+		public:
+			virtual ~Host() {}
+
+			/** True once readBlocks should return without waiting for more data */
+			virtual bool shouldStop() = 0;
+
+			/**
+				A block as GetAlignedData returned it, the channels of fetch in their order, before
+				it is expanded to every plan channel. firstSampleNumber is that of its first sample
+			*/
+			virtual void blockFetched(const StreamPlan &stream, const StreamFetch &fetch, uint32_t deviceTimeStamp, int64_t firstSampleNumber,
+									  const int16_t *data, int numberOfSamplesPerChannel) = 0;
+
+			/**
+				The converted block in scratch, with its sample numbers, timestamps and event codes,
+				started at blockStartNs. Returns the samples of the stream now waiting to be read
+			*/
+			virtual int addBlock(const StreamPlan &stream, StreamScratch &scratch, int64_t firstSampleNumber,
+								 int numberOfSamplesPerChannel, int64_t blockStartNs) = 0;
+
+			/** A full fetch made the fetch buffer of a stream grow, which allocates */
+			virtual void fetchBufferGrown(const StreamPlan &stream, int samplesPerChannel) = 0;
+		};
+
+		explicit AcquisitionEngine(Host &host);
+		~AcquisitionEngine();
+
+		AcquisitionEngine(const AcquisitionEngine &) = delete;
+		AcquisitionEngine &operator=(const AcquisitionEngine &) = delete;
+
+		/** Only while stopped */
+		void setMode(AcquisitionMode mode);
+		AcquisitionMode getMode() const { return mode; }
+
+		/** Waits between GetAlignedData polls and counts the empty ones, its mode can change at any time */
+		PollWaitStrategy &getPollWaitStrategy() { return pollWaitStrategy; }
+		const PollWaitStrategy &getPollWaitStrategy() const { return pollWaitStrategy; }
+
+		/**
+			Starts a run: has source buffer every channel of plan, and the digital input
+			port digitalPortChannelID unless it is -1, clears its buffers and starts the
+			reader threads. plan is moved in, so its StreamPlan::channelIDs stay valid
+		*/
+		void start(SampleSource &source, AcquisitionPlan plan, std::unique_ptr<FetchPlan> firstFetchPlan, int digitalPortChannelID);
+
+		/**
+			Data thread: reads the streams that have data and delivers their blocks to the
+			Host. Waits for data when none is ready, at most ~10 ms after shouldStop
+		*/
+		void readBlocks();
+
+		/** Stops the reader threads, once the data thread has stopped calling readBlocks */
+		void stop();
+
+		/** Streams of the current or last run */
+		const AcquisitionPlan &getPlan() const { return plan; }
+
+		/** Channels of the plan currently read, replaced while acquiring */
+		const FetchPlan *getFetchPlan() const { return fetchPlan.get(); }
+		void publishFetchPlan(std::unique_ptr<FetchPlan> plan);
+
+		/** getTimeNs() of the start of the run, timestamps are seconds since then */
+		int64_t getStartNs() const { return startNs; }
+
+		/** True if the last readBlocks grew a fetch buffer, which allocates */
+		bool hasGrownFetchBuffer() const { return fetchBufferGrown; }
+
+		/** Counters of every stream, published by the data thread every COUNTERS_SNAPSHOT_INTERVAL_MS */
+		CountersSnapshot getCountersSnapshot() const { return countersSlot.read(); }
+
+		// Per StreamPlan::sourceBufferIdx of the current or last run
+		const DeviceClockModel &getClock(int sourceBufferIdx) const { return *streamClocks[sourceBufferIdx]; }
+		const StreamCounters &getCounters(int sourceBufferIdx) const { return *streamCounters[sourceBufferIdx]; }
+		StreamLatency &getLatency(int sourceBufferIdx) { return *streamLatencies[sourceBufferIdx]; }
+		/** Reader of a stream in READER_THREADS mode, nullptr in the other modes */
+		const StreamReader *getReader(int sourceBufferIdx) const;
+
+		/** The digital input port of the run, nullptr if none is read */
+		const DigitalInputs *getDigitalInputs() const { return digitalInputsRead ? digitalInputs.get() : nullptr; }
+
+	private:
+		Host &host;
+		SampleSource *source = nullptr;
+		AcquisitionMode mode = AcquisitionMode::SCHEDULED;
+
+		AcquisitionPlan plan;
+		LiveFetchPlan fetchPlan;
+		int64_t startNs = 0;
+
+		std::vector<std::unique_ptr<StreamScratch>> streamScratch;
+		bool fetchBufferGrown = false;
+		/** Sample number of the next sample of each stream */
+		std::vector<int64_t> streamSampleCount;
+
+		/** Device tick to host time mapping of each stream */
+		std::vector<std::unique_ptr<DeviceClockModel>> streamClocks;
+		std::vector<std::unique_ptr<StreamCounters>> streamCounters;
+		std::vector<std::unique_ptr<StreamLatency>> streamLatencies;
+		/** Fetch of each stream read by the data thread, unused by the reader threads */
+		std::vector<std::unique_ptr<FetchAligner>> streamAligners;
+
+		/** Filled by the data thread every COUNTERS_SNAPSHOT_INTERVAL_MS and published to countersSlot */
+		CountersSnapshot countersValues;
+		SeqLockSlot<CountersSnapshot> countersSlot;
+
+		PollWaitStrategy pollWaitStrategy;
+
+		/** READER_THREADS mode: one reader per stream, signalling readersDataReady */
+		std::vector<std::unique_ptr<StreamReader>> streamReaders;
+		DataReadyEvent readersDataReady;
+
+		/** Line state of every sample, kept between runs so its buffers are made once */
+		std::unique_ptr<DigitalInputs> digitalInputs;
+		bool digitalInputsRead = false;
+
+		// Block being delivered
+		const StreamFetch *deviceFetch = nullptr;
+		AO::ULONG deviceTimeStamp = 0;
+		int64_t deviceBlockArrivalNs = 0;
+		int64_t deviceBlockFetchNs = 0;
+
+		void prepareStreamScratch();
+		void growFetchBuffer(const StreamPlan &stream);
+		void publishCountersSnapshot();
+		void pollStreamsInSequence();
+		void pollScheduledStreams();
+		void drainStreamReaders();
+		void startStreamReaders();
+		/** Delivers the block of deviceFetch channels in the fetch buffer, expanding it to every plan channel */
+		void addStreamDataArrayToSourceBuffer(const StreamPlan &stream, int numberOfItemsFetched);
+		void checkStreamContinuity(const StreamPlan &stream, int64_t firstTick);
+		/** One GetAlignedData call, returns the items fetched, 0 if the SDK had none or failed */
+		int pollStreamDataArrayFromAO(const StreamPlan &stream);
+		int updateStreamDataArrayFromAOAndGetNumberOfSamples(const StreamPlan &stream);
+	};
+}
+
+#endif // __ACQUISITIONENGINE_H__
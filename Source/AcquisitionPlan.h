@@ -0,0 +1,57 @@
+/*
+	------------------------------------------------------------------
+
+	This file is part of the Open Ephys GUI
+	Copyright (C) 2020 Open Ephys
+
+	------------------------------------------------------------------
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __ACQUISITIONPLAN_H__
+#define __ACQUISITIONPLAN_H__
+
+#include <vector>
+
+namespace AONode
+{
+	/**
+		Everything updateBuffer needs to know about one enabled stream,
+		resolved once from the streams XML when acquisition starts.
+	*/
+	struct StreamPlan
+	{
+		int streamID;
+		int sourceBufferIdx;
+		int numberOfChannels;
+		float bitVolts;
+		double samplingRate;
+		int *channelIDs;
+	};
+
+	/**
+		Flat, read-only description of the enabled streams.
+
+		StreamPlan::channelIDs points into channelIDs, so the plan must not
+		be modified once compiled.
+	*/
+	struct AcquisitionPlan
+	{
+		std::vector<StreamPlan> streams;
+		std::vector<int> channelIDs;
+	};
+}
+
+#endif // __ACQUISITIONPLAN_H__
@@ -0,0 +1,128 @@
+/*
+    ------------------------------------------------------------------
+
+    This file is part of the Open Ephys GUI
+    Copyright (C) 2016 Open Ephys
+
+    ------------------------------------------------------------------
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include "AcquisitionStats.h"
+#include "SampleConversion.h"
+
+using namespace AONode;
+
+AcquisitionBenchmark::AcquisitionBenchmark(const File &reportFile_) : reportFile(reportFile_)
+{
+}
+
+void AcquisitionBenchmark::start(const String &acquisitionMode_, const StringArray &streamNames, const Array<int> &numberOfChannels, const Array<double> &samplingRates)
+{
+    acquisitionMode = acquisitionMode_;
+    streams.clear();
+    for (int i = 0; i < streamNames.size(); i++)
+    {
+        StreamBenchmark *stream = new StreamBenchmark();
+        stream->name = streamNames[i];
+        stream->numberOfChannels = numberOfChannels[i];
+        stream->samplingRate = samplingRates[i];
+        streams.add(stream);
+    }
+    blockLatency.reset();
+
+    startTimeNs = getTimeNs();
+    firstThreadCpuNs = -1;
+    lastThreadCpuNs = -1;
+    otherThreadsCpuNs = 0;
+    startProcessCpuNs = getProcessCpuTimeNs();
+}
+
+void AcquisitionBenchmark::recordBlock(int sourceBufferIdx, int numberOfSamplesPerChannel, int64 blockStartNs, int64 latencyNs)
+{
+    StreamBenchmark *stream = streams.getUnchecked(sourceBufferIdx);
+    if (stream->lastDeliveryNs >= 0)
+        stream->deliveryInterval.record(blockStartNs - stream->lastDeliveryNs);
+    stream->lastDeliveryNs = blockStartNs;
+    stream->blocks++;
+    stream->samplesPerChannel += numberOfSamplesPerChannel;
+    stream->busyNs += latencyNs;
+    stream->latency.record(latencyNs);
+    blockLatency.record(latencyNs);
+}
+
+void AcquisitionBenchmark::recordThreadCpu()
+{
+    lastThreadCpuNs = getThreadCpuTimeNs();
+    if (firstThreadCpuNs < 0)
+        firstThreadCpuNs = lastThreadCpuNs;
+}
+
+void AcquisitionBenchmark::addThreadCpu(int64 cpuNs)
+{
+    otherThreadsCpuNs += cpuNs;
+}
+
+void AcquisitionBenchmark::stop()
+{
+    const double wallSeconds = (getTimeNs() - startTimeNs) / 1e9;
+    const double dataThreadCpuSeconds = (lastThreadCpuNs - firstThreadCpuNs) / 1e9;
+    const double cpuSeconds = dataThreadCpuSeconds + otherThreadsCpuNs / 1e9;
+    const double processCpuSeconds = (getProcessCpuTimeNs() - startProcessCpuNs) / 1e9;
+    const char *kernelNames[] = {"SCALAR", "SSE2", "AVX2", "AVX512"};
+
+    int64 totalSamples = 0;
+    int64 totalBusyNs = 0;
+    Array<var> streamReports;
+
+    for (StreamBenchmark *stream : streams)
+    {
+        const int64 samples = stream->samplesPerChannel * stream->numberOfChannels;
+        totalSamples += samples;
+        totalBusyNs += stream->busyNs;
+
+        DynamicObject::Ptr streamReport = new DynamicObject();
+        streamReport->setProperty("name", stream->name);
+        streamReport->setProperty("channels", stream->numberOfChannels);
+        streamReport->setProperty("samplingRate", stream->samplingRate);
+        streamReport->setProperty("blocks", stream->blocks);
+        streamReport->setProperty("samples", samples);
+        streamReport->setProperty("samplesPerSecond", wallSeconds > 0 ? samples / wallSeconds : 0.0);
+        streamReport->setProperty("nsPerSample", samples > 0 ? (double)stream->busyNs / samples : 0.0);
+        streamReport->setProperty("blockLatencyNs", toVar(stream->latency));
+        streamReport->setProperty("deliveryIntervalNs", toVar(stream->deliveryInterval));
+        streamReports.add(var(streamReport.get()));
+    }
+
+    DynamicObject::Ptr report = new DynamicObject();
+    report->setProperty("plugin", "Neuro Omega");
+    report->setProperty("acquisitionMode", acquisitionMode);
+    report->setProperty("conversionKernel", kernelNames[(int)getBestConversionKernel()]);
+    report->setProperty("wallSeconds", wallSeconds);
+    report->setProperty("samples", totalSamples);
+    report->setProperty("samplesPerSecond", wallSeconds > 0 ? totalSamples / wallSeconds : 0.0);
+    report->setProperty("nsPerSample", totalSamples > 0 ? (double)totalBusyNs / totalSamples : 0.0);
+    report->setProperty("cpuSecondsPerWallSecond", wallSeconds > 0 ? cpuSeconds / wallSeconds : 0.0);
+    report->setProperty("dataThreadCpuSecondsPerWallSecond", wallSeconds > 0 ? dataThreadCpuSeconds / wallSeconds : 0.0);
+    report->setProperty("processCpuSecondsPerWallSecond", wallSeconds > 0 ? processCpuSeconds / wallSeconds : 0.0);
+    report->setProperty("blockLatencyNs", toVar(blockLatency));
+    report->setProperty("streams", streamReports);
+
+    if (!reportFile.replaceWithText(JSON::toString(var(report.get()))))
+        LOGE("Unable to write benchmark report to ", reportFile.getFullPathName());
+    else
+        LOGC("Benchmark report written to ", reportFile.getFullPathName());
+}
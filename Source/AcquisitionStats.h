@@ -0,0 +1,115 @@
+/*
+	------------------------------------------------------------------
+
+	This file is part of the Open Ephys GUI
+	Copyright (C) 2020 Open Ephys
+
+	------------------------------------------------------------------
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __ACQUISITIONSTATS_H__
+#define __ACQUISITIONSTATS_H__
+
+#include <DataThreadHeaders.h>
+
+#include "AcquisitionCounters.h"
+#include "CpuTime.h"
+
+namespace AONode
+{
+	/** Percentiles and count of a histogram as a JSON object */
+	inline var toVar(const LatencyHistogram &histogram)
+	{
+		DynamicObject::Ptr result = new DynamicObject();
+		result->setProperty("count", (int64)histogram.getCount());
+		result->setProperty("p50", (int64)histogram.getPercentile(0.5));
+		result->setProperty("p99", (int64)histogram.getPercentile(0.99));
+		result->setProperty("p999", (int64)histogram.getPercentile(0.999));
+		result->setProperty("max", (int64)histogram.getMax());
+		return var(result.get());
+	}
+
+	inline var toVar(const StreamLatency &latency)
+	{
+		DynamicObject::Ptr result = new DynamicObject();
+		result->setProperty("fetchNs", toVar(latency.fetch));
+		result->setProperty("convertNs", toVar(latency.convert));
+		result->setProperty("addToBufferNs", toVar(latency.addToBuffer));
+		result->setProperty("ageNs", toVar(latency.age));
+		return var(result.get());
+	}
+
+	/**
+		Records how fast updateBuffer moves each stream into its DataBuffer
+		and writes a JSON report when acquisition stops.
+
+		Enabled by setting the NEUROOMEGA_BENCHMARK environment variable to
+		the report path. recordBlock and recordThreadCpu are called from the
+		data thread only. CPU time is reported for the acquisition threads
+		together (data thread, stream readers and depth poller), for the data
+		thread alone and for the whole process.
+	*/
+	class AcquisitionBenchmark
+	{
+	public:
+		AcquisitionBenchmark(const File &reportFile);
+
+		/** Clears all counters, one entry per StreamPlan::sourceBufferIdx */
+		void start(const String &acquisitionMode, const StringArray &streamNames, const Array<int> &numberOfChannels, const Array<double> &samplingRates);
+
+		/** One block delivered at blockStartNs, latencyNs is the time spent turning it into DataBuffer samples */
+		void recordBlock(int sourceBufferIdx, int numberOfSamplesPerChannel, int64 blockStartNs, int64 latencyNs);
+
+		/** Samples the data thread CPU time, called once per updateBuffer */
+		void recordThreadCpu();
+
+		/** Adds the CPU time of another acquisition thread, such as a StreamReader once it has stopped */
+		void addThreadCpu(int64 cpuNs);
+
+		/** Writes the report for the run started by the last call to start() */
+		void stop();
+
+	private:
+		struct StreamBenchmark
+		{
+			String name;
+			int numberOfChannels;
+			double samplingRate;
+			int64 blocks = 0;
+			int64 samplesPerChannel = 0;
+			int64 busyNs = 0;
+			int64 lastDeliveryNs = -1;
+			LatencyHistogram latency;
+			LatencyHistogram deliveryInterval;
+		};
+
+		File reportFile;
+		String acquisitionMode;
+		OwnedArray<StreamBenchmark> streams;
+		LatencyHistogram blockLatency;
+
+		int64 startTimeNs = 0;
+		int64 firstThreadCpuNs = -1;
+		int64 lastThreadCpuNs = -1;
+		int64 otherThreadsCpuNs = 0;
+		/** Everything the GUI process runs counts, the editor and the signal chain included */
+		int64 startProcessCpuNs = 0;
+
+		JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(AcquisitionBenchmark);
+	};
+}
+
+#endif // __ACQUISITIONSTATS_H__
@@ -0,0 +1,185 @@
+/*
+    ------------------------------------------------------------------
+
+    This file is part of the Open Ephys GUI
+    Copyright (C) 2016 Open Ephys
+
+    ------------------------------------------------------------------
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include "AllocationCounter.h"
+
+#ifdef NEUROOMEGA_COUNT_ALLOCATIONS
+#include <cstdlib>
+#include <new>
+#endif
+
+using namespace AONode;
+
+#ifdef NEUROOMEGA_COUNT_ALLOCATIONS
+
+// Plain integer, thread_local without a constructor never allocates itself
+static thread_local int64_t threadAllocations = 0;
+
+bool AllocationCounter::isCounting()
+{
+    return true;
+}
+
+int64_t AllocationCounter::getThreadAllocations()
+{
+    return threadAllocations;
+}
+
+static void *allocate(std::size_t size)
+{
+    threadAllocations++;
+    for (;;)
+    {
+        if (void *memory = std::malloc(size == 0 ? 1 : size))
+            return memory;
+        std::new_handler handler = std::get_new_handler();
+        if (handler == nullptr)
+            throw std::bad_alloc();
+        handler();
+    }
+}
+
+static void *allocateAligned(std::size_t size, std::align_val_t alignment)
+{
+    threadAllocations++;
+    const std::size_t align = static_cast<std::size_t>(alignment);
+#ifdef _MSC_VER
+    void *memory = _aligned_malloc(size == 0 ? 1 : size, align);
+#else
+    // aligned_alloc wants a multiple of the alignment
+    void *memory = std::aligned_alloc(align, ((size == 0 ? 1 : size) + align - 1) / align * align);
+#endif
+    if (memory == nullptr)
+        throw std::bad_alloc();
+    return memory;
+}
+
+static void freeAligned(void *memory)
+{
+#ifdef _MSC_VER
+    _aligned_free(memory);
+#else
+    std::free(memory);
+#endif
+}
+
+void *operator new(std::size_t size)
+{
+    return allocate(size);
+}
+
+void *operator new[](std::size_t size)
+{
+    return allocate(size);
+}
+
+void *operator new(std::size_t size, const std::nothrow_t &) noexcept
+{
+    try
+    {
+        return allocate(size);
+    }
+    catch (const std::bad_alloc &)
+    {
+        return nullptr;
+    }
+}
+
+void *operator new[](std::size_t size, const std::nothrow_t &) noexcept
+{
+    return operator new(size, std::nothrow);
+}
+
+void *operator new(std::size_t size, std::align_val_t alignment)
+{
+    return allocateAligned(size, alignment);
+}
+
+void *operator new[](std::size_t size, std::align_val_t alignment)
+{
+    return allocateAligned(size, alignment);
+}
+
+void operator delete(void *memory) noexcept
+{
+    std::free(memory);
+}
+
+void operator delete[](void *memory) noexcept
+{
+    std::free(memory);
+}
+
+void operator delete(void *memory, std::size_t) noexcept
+{
+    std::free(memory);
+}
+
+void operator delete[](void *memory, std::size_t) noexcept
+{
+    std::free(memory);
+}
+
+void operator delete(void *memory, const std::nothrow_t &) noexcept
+{
+    std::free(memory);
+}
+
+void operator delete[](void *memory, const std::nothrow_t &) noexcept
+{
+    std::free(memory);
+}
+
+void operator delete(void *memory, std::align_val_t) noexcept
+{
+    freeAligned(memory);
+}
+
+void operator delete[](void *memory, std::align_val_t) noexcept
+{
+    freeAligned(memory);
+}
+
+void operator delete(void *memory, std::size_t, std::align_val_t) noexcept
+{
+    freeAligned(memory);
+}
+
+void operator delete[](void *memory, std::size_t, std::align_val_t) noexcept
+{
+    freeAligned(memory);
+}
+
+#else
+
+bool AllocationCounter::isCounting()
+{
+    return false;
+}
+
+int64_t AllocationCounter::getThreadAllocations()
+{
+    return 0;
+}
+
+#endif
@@ -0,0 +1,53 @@
+/*
+	------------------------------------------------------------------
+
+	This file is part of the Open Ephys GUI
+	Copyright (C) 2020 Open Ephys
+
+	------------------------------------------------------------------
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __ALLOCATIONCOUNTER_H__
+#define __ALLOCATIONCOUNTER_H__
+
+#include <stdint.h>
+
+namespace AONode
+{
+	/**
+		Counts the operator new calls made by each thread, so a hot path can
+		assert that it did not allocate.
+
+		Only counts when the plugin is built with NEUROOMEGA_COUNT_ALLOCATIONS,
+		which replaces the global operator new and delete of the module it is
+		linked into. That is done for every Debug build and for the tests. The
+		replacements stay inside the plugin: a DLL does not export them and the
+		Linux and macOS builds hide them from the GUI process, which keeps its
+		own. Both sides allocate with malloc, so memory can be freed by either.
+		Memory taken with malloc, as JUCE's HeapBlock and Array do, is not
+		counted.
+	*/
+	namespace AllocationCounter
+	{
+		/** True if allocations are counted in this build */
+		bool isCounting();
+
+		/** Number of operator new calls made by the calling thread so far, 0 if not counting */
+		int64_t getThreadAllocations();
+	}
+}
+
+#endif // __ALLOCATIONCOUNTER_H__
@@ -0,0 +1,84 @@
+/*
+    ------------------------------------------------------------------
+
+    This file is part of the Open Ephys GUI
+    Copyright (C) 2016 Open Ephys
+
+    ------------------------------------------------------------------
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include "ChannelDefaults.h"
+
+using namespace AONode;
+
+ChannelDefaults::ChannelDefaults(const XmlElement *streams, const XmlElement *channels)
+{
+    if (streams != nullptr)
+    {
+        for (auto *stream : streams->getChildIterator())
+        {
+            const String name = stream->getStringAttribute("Stream_Name").toLowerCase();
+            if (!streamIndexByName.contains(name))
+                streamIndexByName.set(name, streamDefaults.size());
+            streamNameLengths.addIfNotAlreadyThere(name.length());
+            streamDefaults.add(stream);
+        }
+        streamNameLengths.sort();
+    }
+
+    if (channels != nullptr)
+    {
+        for (auto *channel : channels->getChildIterator())
+        {
+            const String key = getChannelKey(channel->getStringAttribute("Stream_Name"), channel->getStringAttribute("Channel_Name"));
+            if (!channelsByName.contains(key))
+                channelsByName.set(key, channel);
+        }
+    }
+}
+
+String ChannelDefaults::getChannelKey(const String &streamName, const String &channelName)
+{
+    // Names never contain a line break
+    return streamName.toLowerCase() + "\n" + channelName.toLowerCase();
+}
+
+const XmlElement *ChannelDefaults::getStream(const String &streamName) const
+{
+    // Every prefix of the name that is a Stream_Name matches, the earliest in the file wins
+    const String name = streamName.toLowerCase();
+    int firstIndex = -1;
+    for (int length : streamNameLengths)
+    {
+        if (length > name.length())
+            break;
+
+        const String prefix = name.substring(0, length);
+        if (!streamIndexByName.contains(prefix))
+            continue;
+
+        const int index = streamIndexByName[prefix];
+        if (firstIndex < 0 || index < firstIndex)
+            firstIndex = index;
+    }
+    return (firstIndex >= 0) ? streamDefaults[firstIndex] : nullptr;
+}
+
+const XmlElement *ChannelDefaults::getChannel(const String &streamName, const String &channelName) const
+{
+    return channelsByName[getChannelKey(streamName, channelName)];
+}
@@ -0,0 +1,68 @@
+/*
+	------------------------------------------------------------------
+
+	This file is part of the Open Ephys GUI
+	Copyright (C) 2020 Open Ephys
+
+	------------------------------------------------------------------
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef __CHANNELDEFAULTS_H__
+#define __CHANNELDEFAULTS_H__
+
+#include <DataThreadHeaders.h>
+
+namespace AONode
+{
+	/**
+		The defaults of AOSTREAMS.xml and AOCHANNELS.xml, indexed by name.
+
+		A stream default applies to every stream whose name starts with its
+		Stream_Name, the first one in the file winning. A channel default
+		applies to the channel with the same stream and channel names. Names
+		are compared ignoring case. Lookups return elements of the parsed
+		files, which must outlive this object.
+	*/
+	class ChannelDefaults
+	{
+	public:
+		/** Indexes the parsed STREAMS and CHANNELS elements, either may be null */
+		ChannelDefaults(const XmlElement *streams, const XmlElement *channels);
+
+		/** Default of a stream, nullptr if none applies */
+		const XmlElement *getStream(const String &streamName) const;
+
+		/** Default of a channel, nullptr if none applies */
+		const XmlElement *getChannel(const String &streamName, const String &channelName) const;
+
+	private:
+		static String getChannelKey(const String &streamName, const String &channelName);
+
+		/** Stream defaults in file order */
+		Array<const XmlElement *> streamDefaults;
+		/** Lower case Stream_Name to the index of its first default in streamDefaults */
+		HashMap<String, int> streamIndexByName;
+		/** Lengths of the Stream_Names, ascending, the only prefixes worth looking up */
+		Array<int> streamNameLengths;
+
+		HashMap<String, const XmlElement *> channelsByName;
+
+		JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(ChannelDefaults);
+	};
+}
+
+#endif // __CHANNELDEFAULTS_H__
@@ -0,0 +1,134 @@
+/*
+    ------------------------------------------------------------------
+
+    This file is part of the Open Ephys GUI
+    Copyright (C) 2016 Open Ephys
+
+    ------------------------------------------------------------------
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include "ChannelModel.h"
+
+using namespace AONode;
+
+void ChannelModel::rebuild(XmlElement *streamsList, XmlElement *channelsList)
+{
+    streams.clear();
+    streamIDByChannelID.clear();
+    if (streamsList == nullptr || channelsList == nullptr)
+        return;
+
+    for (auto *stream : streamsList->getChildIterator())
+    {
+        const int streamID = stream->getIntAttribute("ID", -1);
+        if (streamID < 0)
+            continue;
+        if (streamID >= (int)streams.size())
+            streams.resize(streamID + 1);
+        streams[streamID].xml = stream;
+    }
+
+    for (auto *channel : channelsList->getChildIterator())
+    {
+        const int streamID = channel->getIntAttribute("Stream_ID", -1);
+        if (getStream(streamID) == nullptr)
+            continue;
+        streams[streamID].channels.push_back(channel);
+        streamIDByChannelID.set(channel->getIntAttribute("ID"), streamID);
+    }
+
+    for (Stream &stream : streams)
+    {
+        if (stream.xml == nullptr)
+            continue;
+        updateEnabledChannels(stream);
+        disableIfEmpty(stream);
+    }
+    keepOneStreamEnabled();
+}
+
+void ChannelModel::channelEnabledChanged(int channelID)
+{
+    if (!streamIDByChannelID.contains(channelID))
+        return;
+
+    Stream &stream = streams[streamIDByChannelID[channelID]];
+    updateEnabledChannels(stream);
+    disableIfEmpty(stream);
+    keepOneStreamEnabled();
+}
+
+void ChannelModel::streamEnabledChanged(int streamID)
+{
+    if (getStream(streamID) == nullptr)
+        return;
+
+    disableIfEmpty(streams[streamID]);
+    keepOneStreamEnabled();
+}
+
+XmlElement *ChannelModel::getStream(int streamID) const
+{
+    return (streamID >= 0 && streamID < (int)streams.size()) ? streams[streamID].xml : nullptr;
+}
+
+bool ChannelModel::isStreamActive(int streamID) const
+{
+    const XmlElement *stream = getStream(streamID);
+    return stream != nullptr && stream->getBoolAttribute("Enabled") && !streams[streamID].enabledChannelIDs.empty();
+}
+
+void ChannelModel::updateEnabledChannels(Stream &stream)
+{
+    stream.enabledChannelIDs.clear();
+    for (const XmlElement *channel : stream.channels)
+    {
+        if (channel->getBoolAttribute("Enabled"))
+            stream.enabledChannelIDs.push_back(channel->getIntAttribute("ID"));
+    }
+
+    String channelIDs;
+    for (int id : stream.enabledChannelIDs)
+        channelIDs << (channelIDs.isEmpty() ? "" : ",") << id;
+    stream.xml->setAttribute("Channel_IDs", channelIDs);
+    stream.xml->setAttribute("Number_Of_Channels", (int)stream.enabledChannelIDs.size());
+}
+
+void ChannelModel::disableIfEmpty(Stream &stream)
+{
+    if (stream.enabledChannelIDs.empty())
+        stream.xml->setAttribute("Enabled", false);
+}
+
+void ChannelModel::keepOneStreamEnabled()
+{
+    for (const Stream &stream : streams)
+    {
+        if (stream.xml != nullptr && stream.xml->getBoolAttribute("Enabled"))
+            return;
+    }
+
+    // Keep the last stream that still has enabled channels
+    for (auto stream = streams.rbegin(); stream != streams.rend(); ++stream)
+    {
+        if (stream->xml != nullptr && !stream->enabledChannelIDs.empty())
+        {
+            stream->xml->setAttribute("Enabled", true);
+            return;
+        }
+    }
+}
@@ -0,0 +1,95 @@
+/*
+	------------------------------------------------------------------
+
+	This file is part of the Open Ephys GUI
+	Copyright (C) 2020 Open Ephys
+
+	------------------------------------------------------------------
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __CHANNELMODEL_H__
+#define __CHANNELMODEL_H__
+
+#include <DataThreadHeaders.h>
+
+#include <vector>
+
+namespace AONode
+{
+	/**
+		Which channels of each stream are enabled, as integer channel IDs.
+
+		Streams are indexed by their ID attribute and channels keep the order
+		of the channels list, whatever order the tables sorted the elements
+		in. The Channel_IDs and Number_Of_Channels attributes of a stream are
+		only written for the tables and for persistence, and only for the
+		stream that changed. The elements belong to the lists, which must
+		outlive this object or be passed to rebuild again.
+	*/
+	class ChannelModel
+	{
+	public:
+		ChannelModel() {}
+
+		/** Indexes new lists and brings their Channel_IDs, Number_Of_Channels and stream Enabled attributes up to date */
+		void rebuild(XmlElement *streams, XmlElement *channels);
+
+		/** After the Enabled attribute of one channel changed */
+		void channelEnabledChanged(int channelID);
+
+		/** After the Enabled attribute of one stream changed */
+		void streamEnabledChanged(int streamID);
+
+		/** One past the highest stream ID */
+		int getNumberOfStreams() const { return (int)streams.size(); }
+
+		/** Element of a stream, nullptr if no stream has this ID */
+		XmlElement *getStream(int streamID) const;
+
+		/** Every channel of a stream, in list order */
+		const std::vector<XmlElement *> &getChannels(int streamID) const { return streams[streamID].channels; }
+
+		/** IDs of the enabled channels of a stream, in list order */
+		const std::vector<int> &getEnabledChannelIDs(int streamID) const { return streams[streamID].enabledChannelIDs; }
+
+		/** Whether the stream is enabled and has enabled channels, the streams updateSettings creates */
+		bool isStreamActive(int streamID) const;
+
+	private:
+		struct Stream
+		{
+			XmlElement *xml = nullptr;
+			std::vector<XmlElement *> channels;
+			std::vector<int> enabledChannelIDs;
+		};
+
+		/** Recomputes the enabled IDs of a stream and writes its display attributes */
+		void updateEnabledChannels(Stream &stream);
+
+		/** A stream without enabled channels cannot be enabled */
+		void disableIfEmpty(Stream &stream);
+
+		/** Re-enables the last stream with enabled channels when no stream is enabled */
+		void keepOneStreamEnabled();
+
+		std::vector<Stream> streams;
+		HashMap<int, int> streamIDByChannelID;
+
+		JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(ChannelModel);
+	};
+}
+
+#endif // __CHANNELMODEL_H__
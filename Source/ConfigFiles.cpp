@@ -0,0 +1,100 @@
+/*
+    ------------------------------------------------------------------
+
+    This file is part of the Open Ephys GUI
+    Copyright (C) 2016 Open Ephys
+
+    ------------------------------------------------------------------
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include "ConfigFiles.h"
+
+using namespace AONode;
+
+ConfigFiles::ConfigFiles()
+{
+    const File application = File::getSpecialLocation(File::currentApplicationFile);
+    if (application.getFullPathName().contains("plugin-GUI" + File::getSeparatorString() + "Build"))
+        directory = application.getParentDirectory().getChildFile("configs");
+    else
+        directory = File::getSpecialLocation(File::SpecialLocationType::commonApplicationDataDirectory).getChildFile("Open Ephys").getChildFile("configs-api8");
+}
+
+ConfigFiles::ParsedFile &ConfigFiles::getParsedFile(const String &name)
+{
+    for (ParsedFile *parsedFile : parsedFiles)
+        if (parsedFile->name == name)
+            return *parsedFile;
+
+    ParsedFile *parsedFile = parsedFiles.add(new ParsedFile());
+    parsedFile->name = name;
+    return *parsedFile;
+}
+
+bool ConfigFiles::refresh(ParsedFile &parsedFile)
+{
+    const File file(directory.getChildFile("AO" + parsedFile.name + ".xml"));
+    const bool exists = file.existsAsFile();
+    const Time modificationTime = exists ? file.getLastModificationTime() : Time();
+    const int64 size = exists ? file.getSize() : -1;
+
+    if (exists == parsedFile.exists && modificationTime == parsedFile.modificationTime && size == parsedFile.size)
+        return false;
+
+    parsedFile.exists = exists;
+    parsedFile.modificationTime = modificationTime;
+    parsedFile.size = size;
+    parsedFile.element.reset();
+
+    if (!exists)
+    {
+        LOGC("Config file not found: ", file.getFullPathName());
+        return true;
+    }
+
+    std::unique_ptr<XmlElement> fileData = XmlDocument::parse(file);
+    XmlElement *element = (fileData != nullptr) ? fileData->getChildByName(parsedFile.name) : nullptr;
+    if (element == nullptr)
+    {
+        LOGE("No ", parsedFile.name, " in config file ", file.getFullPathName());
+        return true;
+    }
+
+    // Only the element is kept, detached from the document it was parsed with
+    fileData->removeChildElement(element, false);
+    parsedFile.element.reset(element);
+    return true;
+}
+
+const XmlElement *ConfigFiles::getDefaults(const String &name)
+{
+    ParsedFile &parsedFile = getParsedFile(name);
+    if (refresh(parsedFile))
+        channelDefaults.reset();
+    return parsedFile.element.get();
+}
+
+const ChannelDefaults &ConfigFiles::getChannelDefaults()
+{
+    // Both files are checked, either one changing invalidates the index
+    const XmlElement *streams = getDefaults("STREAMS");
+    const XmlElement *channels = getDefaults("CHANNELS");
+
+    if (channelDefaults == nullptr)
+        channelDefaults = std::make_unique<ChannelDefaults>(streams, channels);
+    return *channelDefaults;
+}
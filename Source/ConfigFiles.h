@@ -0,0 +1,77 @@
+/*
+	------------------------------------------------------------------
+
+	This file is part of the Open Ephys GUI
+	Copyright (C) 2020 Open Ephys
+
+	------------------------------------------------------------------
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef __CONFIGFILES_H__
+#define __CONFIGFILES_H__
+
+#include <DataThreadHeaders.h>
+
+#include "ChannelDefaults.h"
+
+namespace AONode
+{
+	/**
+		The plugin's configs folder and the defaults files in it.
+
+		The folder is resolved once. AOSTREAMS.xml and AOCHANNELS.xml are parsed
+		on first use and only parsed again after their modification time or
+		size changed, so asking for the defaults again costs a stat per file.
+		Message thread only.
+	*/
+	class ConfigFiles
+	{
+	public:
+		ConfigFiles();
+
+		/** configs next to a development build of the GUI, configs-api8 in the common application data otherwise */
+		const File &getDirectory() const { return directory; }
+
+		/** The <name> element of AO<name>.xml, nullptr if the file is missing or has none */
+		const XmlElement *getDefaults(const String &name);
+
+		/** Index of the current AOSTREAMS.xml and AOCHANNELS.xml, valid until the next call */
+		const ChannelDefaults &getChannelDefaults();
+
+	private:
+		struct ParsedFile
+		{
+			String name;
+			Time modificationTime;
+			int64 size = -1;
+			bool exists = false;
+			std::unique_ptr<XmlElement> element;
+		};
+
+		/** Parses a file again if it changed, returns true if it did */
+		bool refresh(ParsedFile &parsedFile);
+		ParsedFile &getParsedFile(const String &name);
+
+		File directory;
+		OwnedArray<ParsedFile> parsedFiles;
+		std::unique_ptr<ChannelDefaults> channelDefaults;
+
+		JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(ConfigFiles);
+	};
+}
+
+#endif // __CONFIGFILES_H__
@@ -0,0 +1,75 @@
+/*
+    ------------------------------------------------------------------
+
+    This file is part of the Open Ephys GUI
+    Copyright (C) 2016 Open Ephys
+
+    ------------------------------------------------------------------
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <Windows.h>
+#else
+#include <time.h>
+#endif
+
+#include "CpuTime.h"
+
+using namespace AONode;
+
+#ifdef _WIN32
+// FILETIME counts 100 ns intervals
+static int64_t getKernelAndUserTimeNs(const FILETIME &kernelTime, const FILETIME &userTime)
+{
+    uint64_t kernel = ((uint64_t)kernelTime.dwHighDateTime << 32) | kernelTime.dwLowDateTime;
+    uint64_t user = ((uint64_t)userTime.dwHighDateTime << 32) | userTime.dwLowDateTime;
+    return (int64_t)(kernel + user) * 100;
+}
+#else
+static int64_t getClockNs(clockid_t clock)
+{
+    timespec cpuTime;
+    if (clock_gettime(clock, &cpuTime) != 0)
+        return 0;
+    return (int64_t)cpuTime.tv_sec * 1000000000 + cpuTime.tv_nsec;
+}
+#endif
+
+int64_t AONode::getThreadCpuTimeNs()
+{
+#ifdef _WIN32
+    FILETIME creationTime, exitTime, kernelTime, userTime;
+    if (!GetThreadTimes(GetCurrentThread(), &creationTime, &exitTime, &kernelTime, &userTime))
+        return 0;
+    return getKernelAndUserTimeNs(kernelTime, userTime);
+#else
+    return getClockNs(CLOCK_THREAD_CPUTIME_ID);
+#endif
+}
+
+int64_t AONode::getProcessCpuTimeNs()
+{
+#ifdef _WIN32
+    FILETIME creationTime, exitTime, kernelTime, userTime;
+    if (!GetProcessTimes(GetCurrentProcess(), &creationTime, &exitTime, &kernelTime, &userTime))
+        return 0;
+    return getKernelAndUserTimeNs(kernelTime, userTime);
+#else
+    return getClockNs(CLOCK_PROCESS_CPUTIME_ID);
+#endif
+}
@@ -0,0 +1,37 @@
+/*
+	------------------------------------------------------------------
+
+	This file is part of the Open Ephys GUI
+	Copyright (C) 2020 Open Ephys
+
+	------------------------------------------------------------------
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __CPUTIME_H__
+#define __CPUTIME_H__
+
+#include <stdint.h>
+
+namespace AONode
+{
+	/** CPU time consumed by the calling thread, in nanoseconds */
+	int64_t getThreadCpuTimeNs();
+
+	/** CPU time consumed by every thread of the process, in nanoseconds */
+	int64_t getProcessCpuTimeNs();
+}
+
+#endif // __CPUTIME_H__
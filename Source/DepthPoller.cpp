@@ -0,0 +1,87 @@
+/*
+    ------------------------------------------------------------------
+
+    This file is part of the Open Ephys GUI
+    Copyright (C) 2016 Open Ephys
+
+    ------------------------------------------------------------------
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include "DepthPoller.h"
+#include "AcquisitionStats.h"
+
+using namespace AONode;
+
+// The drive moves at most a few hundred micrometres per second, faster polling gains nothing
+#define MAX_DEPTH_POLL_RATE_HZ 100.0
+#define MIN_DEPTH_POLL_RATE_HZ 0.1
+
+DepthPoller::DepthPoller(SampleSource &source_, double pollRateHz_)
+    : Thread("Neuro Omega Depth"),
+      source(source_)
+{
+    setPollRate(pollRateHz_);
+}
+
+DepthPoller::~DepthPoller()
+{
+    stopThread(1000);
+}
+
+void DepthPoller::setPollRate(double pollRateHz_)
+{
+    pollRateHz.store(limitPollRate(pollRateHz_), std::memory_order_relaxed);
+}
+
+double DepthPoller::limitPollRate(double pollRateHz_)
+{
+    return jlimit(MIN_DEPTH_POLL_RATE_HZ, MAX_DEPTH_POLL_RATE_HZ, pollRateHz_);
+}
+
+void DepthPoller::run()
+{
+    DepthReading reading;
+
+    while (!threadShouldExit())
+    {
+        AO::int32 depthUm = 0;
+        if (source.getDriveDepth(&depthUm) == AO::eAO_OK)
+        {
+            if (!reading.hasDepth || depthUm != reading.depthUm)
+            {
+                // The depth at the start is published, but only later moves are changes to mark
+                if (reading.hasDepth)
+                    reading.changes++;
+                reading.hasDepth = true;
+                reading.depthUm = depthUm;
+                reading.readNs = getTimeNs();
+                slot.publish(reading);
+
+                if (onDepthChanged)
+                    onDepthChanged(reading);
+            }
+        }
+        else
+        {
+            failedReads.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        wait(roundToInt(1000.0 / getPollRate()));
+    }
+
+    cpuTimeNs.store(getThreadCpuTimeNs(), std::memory_order_release);
+}
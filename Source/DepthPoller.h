@@ -0,0 +1,101 @@
+/*
+	------------------------------------------------------------------
+
+	This file is part of the Open Ephys GUI
+	Copyright (C) 2020 Open Ephys
+
+	------------------------------------------------------------------
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef __DEPTHPOLLER_H__
+#define __DEPTHPOLLER_H__
+
+#include <DataThreadHeaders.h>
+
+#include "SampleSource.h"
+#include "SeqLock.h"
+
+#include <atomic>
+#include <functional>
+
+namespace AONode
+{
+	/** Microdrive depth as last read from the source */
+	struct DepthReading
+	{
+		int32 depthUm = 0;
+		/** When this depth was first read, on the getTimeNs() clock */
+		int64 readNs = 0;
+		/** Number of depth changes seen so far, the first reading is the starting depth and not a change */
+		uint32 changes = 0;
+		/** False until the first successful read */
+		bool hasDepth = false;
+	};
+
+	/** A depth change the data thread marked on a sample, for the message thread to broadcast */
+	struct DepthChangeMark
+	{
+		int streamID;
+		int64 sampleNumber;
+		int32 depthUm;
+	};
+
+	/**
+		Reads the microdrive depth on its own thread at a low rate, so the
+		data thread never waits on drive I/O.
+
+		Every reading goes to a SeqLockSlot, so readers never wait on the
+		poller; onDepthChanged is called on the poller thread for the first
+		reading and when the depth differs from the previous one.
+	*/
+	class DepthPoller : public Thread
+	{
+	public:
+		DepthPoller(SampleSource &source, double pollRateHz);
+		~DepthPoller();
+
+		/** Takes effect after the current wait */
+		void setPollRate(double pollRateHz);
+		/** The rate setPollRate would use, within 0.1 and 100 Hz */
+		static double limitPollRate(double pollRateHz);
+		double getPollRate() const { return pollRateHz.load(std::memory_order_relaxed); }
+
+		/** Latest reading, safe from any thread */
+		DepthReading getLatest() const { return slot.read(); }
+
+		/** Failed getDriveDepth calls, e.g. no drive connected */
+		int64 getFailedReads() const { return failedReads.load(std::memory_order_relaxed); }
+
+		/** CPU time the poller thread used, once it has exited */
+		int64 getCpuTimeNs() const { return cpuTimeNs.load(std::memory_order_acquire); }
+
+		std::function<void(const DepthReading &)> onDepthChanged;
+
+		void run() override;
+
+	private:
+		SampleSource &source;
+		std::atomic<double> pollRateHz;
+		SeqLockSlot<DepthReading> slot;
+		std::atomic<int64> failedReads{0};
+		std::atomic<int64> cpuTimeNs{0};
+
+		JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(DepthPoller);
+	};
+}
+
+#endif // __DEPTHPOLLER_H__
@@ -0,0 +1,176 @@
+/*
+    ------------------------------------------------------------------
+
+    This file is part of the Open Ephys GUI
+    Copyright (C) 2016 Open Ephys
+
+    ------------------------------------------------------------------
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include "DeviceClock.h"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace AONode;
+
+// The loop narrows from 1 Hz at start down to this bandwidth as the run gets longer
+#define DLL_MIN_BANDWIDTH_HZ 0.005
+// Host wake-ups later than this (a stalled thread) only pull the model by this much
+#define DLL_MAX_ERROR_NS 2000000.0
+// Ticks needed before the ticks per sample are measured instead of taken from the nominal rate
+#define MIN_TICKS_FOR_RATE DEVICE_CLOCK_HZ
+// Once measured, a new measurement further than this from the last one means lost samples, not a different rate
+#define MAX_RATE_ERROR 0.01
+
+// M_PI is not standard C++
+#define DLL_PI 3.14159265358979323846
+
+void DeviceClockModel::reset(double nominalSamplingRate, int64_t hostStartNs_)
+{
+    nominalTicksPerSample = DEVICE_CLOCK_HZ / nominalSamplingRate;
+    ticksPerSample = nominalTicksPerSample;
+
+    hasTimeStamp = false;
+    lastTimeStamp = 0;
+    wraps = 0;
+
+    originTick = -1;
+    originSampleNumber = 0;
+    rateMeasured = false;
+    previousFirstTick = -1;
+    previousSampleNumber = 0;
+
+    hostStartNs = hostStartNs_;
+    referenceTick = 0;
+    referenceNs = 0;
+    nsPerTick = 0;
+
+    lastTimeStampSeconds = -1;
+    nextExpectedTick = -1;
+    lastArrivalNs = hostStartNs;
+}
+
+int64_t DeviceClockModel::unwrap(uint32_t deviceTimeStamp)
+{
+    // Only a jump back by more than half the counter range is a wrap, anything else is reordering
+    if (hasTimeStamp && deviceTimeStamp < lastTimeStamp && lastTimeStamp - deviceTimeStamp > 0x80000000u)
+        wraps++;
+
+    hasTimeStamp = true;
+    lastTimeStamp = deviceTimeStamp;
+    return (wraps << 32) + deviceTimeStamp;
+}
+
+double DeviceClockModel::getSecondsAtTick(int64_t tick) const
+{
+    return (referenceNs + (tick - referenceTick) * nsPerTick) * 1e-9;
+}
+
+int64_t DeviceClockModel::getMissingSamples(int64_t firstTick) const
+{
+    // Without a measured rate a wrong nominal one would turn every block into a gap or an overlap
+    if (nextExpectedTick < 0 || !rateMeasured)
+        return 0;
+    return (int64_t)std::round((firstTick - nextExpectedTick) / ticksPerSample);
+}
+
+double DeviceClockModel::getDriftPpm() const
+{
+    if (nsPerTick == 0)
+        return 0;
+    return (1e9 / DEVICE_CLOCK_HZ / nsPerTick - 1.0) * 1e6;
+}
+
+void DeviceClockModel::timeStampBlock(int64_t firstTick, int64_t firstSampleNumber, int numberOfSamples, int64_t hostArrivalNs, double *timeStamps)
+{
+    if (originTick < 0)
+    {
+        originTick = firstTick;
+        originSampleNumber = firstSampleNumber;
+    }
+    else if (!rateMeasured)
+    {
+        // Lost samples are not counted before the rate is known, a block that does not follow on from the previous one restarts the measurement
+        bool restarted = false;
+        if (previousSampleNumber > originSampleNumber)
+        {
+            const double estimate = double(previousFirstTick - originTick) / double(previousSampleNumber - originSampleNumber);
+            const double spacingError = double(firstTick - previousFirstTick) - (firstSampleNumber - previousSampleNumber) * estimate;
+            restarted = std::abs(spacingError) > 0.5 * estimate;
+        }
+
+        if (restarted)
+        {
+            originTick = firstTick;
+            originSampleNumber = firstSampleNumber;
+        }
+        else if (firstTick - originTick >= MIN_TICKS_FOR_RATE && firstSampleNumber > originSampleNumber)
+        {
+            // Whatever the nominal rate, the defaults file can be wrong
+            ticksPerSample = double(firstTick - originTick) / double(firstSampleNumber - originSampleNumber);
+            rateMeasured = true;
+        }
+    }
+    else if (firstSampleNumber > originSampleNumber)
+    {
+        const double measured = double(firstTick - originTick) / double(firstSampleNumber - originSampleNumber);
+        if (std::abs(measured - ticksPerSample) <= ticksPerSample * MAX_RATE_ERROR)
+            ticksPerSample = measured;
+    }
+    previousFirstTick = firstTick;
+    previousSampleNumber = firstSampleNumber;
+
+    // The block arrived about when its last sample was produced
+    const double endTick = firstTick + numberOfSamples * ticksPerSample;
+    const double hostNs = double(hostArrivalNs - hostStartNs);
+
+    if (nsPerTick == 0)
+    {
+        nsPerTick = 1e9 / DEVICE_CLOCK_HZ;
+        referenceTick = endTick;
+        referenceNs = hostNs;
+    }
+    else if (endTick > referenceTick)
+    {
+        const double elapsedTicks = endTick - referenceTick;
+        const double predictedNs = referenceNs + elapsedTicks * nsPerTick;
+        const double errorNs = std::min(DLL_MAX_ERROR_NS, std::max(-DLL_MAX_ERROR_NS, hostNs - predictedNs));
+
+        // Second order loop, critically damped, gains scaled to the time this block covers
+        const double bandwidthHz = std::max(DLL_MIN_BANDWIDTH_HZ, 1.0 / (1.0 + hostNs * 1e-9));
+        const double omega = std::min(0.5, 2.0 * DLL_PI * bandwidthHz * elapsedTicks * nsPerTick * 1e-9);
+
+        referenceTick = endTick;
+        referenceNs = predictedNs + std::sqrt(2.0) * omega * errorNs;
+        nsPerTick += omega * omega * errorNs / elapsedTicks;
+    }
+
+    const double secondsPerSample = ticksPerSample * nsPerTick * 1e-9;
+    double firstSeconds = getSecondsAtTick(firstTick);
+    if (firstSeconds <= lastTimeStampSeconds)
+        firstSeconds = lastTimeStampSeconds + secondsPerSample * 0.5;
+
+    for (int samp = 0; samp < numberOfSamples; samp++)
+        timeStamps[samp] = firstSeconds + samp * secondsPerSample;
+
+    if (numberOfSamples > 0)
+        lastTimeStampSeconds = timeStamps[numberOfSamples - 1];
+
+    nextExpectedTick = endTick;
+    lastArrivalNs = hostArrivalNs;
+}
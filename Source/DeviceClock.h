@@ -0,0 +1,115 @@
+/*
+	------------------------------------------------------------------
+
+	This file is part of the Open Ephys GUI
+	Copyright (C) 2020 Open Ephys
+
+	------------------------------------------------------------------
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef __DEVICECLOCK_H__
+#define __DEVICECLOCK_H__
+
+#include <stdint.h>
+
+namespace AONode
+{
+	/**
+		Turns the device timestamps of one stream into host-clock timestamps.
+
+		GetAlignedData stamps every block with the 44 kHz system clock tick of
+		its first sample, as a 32-bit counter that wraps after ~27 hours. The
+		ticks are unwrapped into a 64-bit count and kept as integers; the
+		samples of a block are spaced by the measured ticks per sample rather
+		than the nominal rate from the defaults file.
+
+		Ticks are mapped to host time with a delay-locked loop that follows
+		the drift between the device and host clocks. Its bandwidth starts
+		wide to lock quickly and narrows to average out host scheduling jitter.
+		Timestamps are seconds since reset() and strictly increasing.
+	*/
+	class DeviceClockModel
+	{
+	public:
+		static const int DEVICE_CLOCK_HZ = 44000;
+
+		DeviceClockModel() {}
+		DeviceClockModel(const DeviceClockModel &) = delete;
+		DeviceClockModel &operator=(const DeviceClockModel &) = delete;
+
+		/** Starts a new run, hostStartNs is the host time of timestamp 0 */
+		void reset(double nominalSamplingRate, int64_t hostStartNs);
+
+		/** Extends a 32-bit SDK timestamp to a tick count that does not wrap */
+		int64_t unwrap(uint32_t deviceTimeStamp);
+
+		/**
+			Feeds the block read at hostArrivalNs into the drift model, then fills
+			numberOfSamples timestamps for it. firstTick and firstSampleNumber are
+			the device tick and sample number of its first sample
+		*/
+		void timeStampBlock(int64_t firstTick, int64_t firstSampleNumber, int numberOfSamples, int64_t hostArrivalNs, double *timeStamps);
+
+		/**
+			Samples lost between the end of the previous block and a block starting
+			at firstTick, at the measured ticks per sample: 0 when contiguous and
+			until the rate is measured, negative when the blocks overlap
+		*/
+		int64_t getMissingSamples(int64_t firstTick) const;
+
+		/** Host time at which the previous block was read */
+		int64_t getLastArrivalNs() const { return lastArrivalNs; }
+
+		/** Device ticks between two samples, measured once enough samples were seen */
+		double getTicksPerSample() const { return ticksPerSample; }
+		bool isRateMeasured() const { return rateMeasured; }
+
+		/** Device clock rate error against the host clock, in parts per million */
+		double getDriftPpm() const;
+
+		/** Seconds since reset() of a device tick, according to the current model */
+		double getSecondsAtTick(int64_t tick) const;
+
+	private:
+		double nominalTicksPerSample = 1.0;
+		double ticksPerSample = 1.0;
+
+		bool hasTimeStamp = false;
+		uint32_t lastTimeStamp = 0;
+		int64_t wraps = 0;
+
+		// First block of the run, origin of the ticks per sample measurement
+		int64_t originTick = -1;
+		int64_t originSampleNumber = 0;
+		bool rateMeasured = false;
+		// Block before the current one, checked to follow on while the rate is measured
+		int64_t previousFirstTick = -1;
+		int64_t previousSampleNumber = 0;
+
+		// Delay-locked loop: host time (ns since reset) of referenceTick and its slope
+		int64_t hostStartNs = 0;
+		double referenceTick = 0;
+		double referenceNs = 0;
+		double nsPerTick = 0;
+
+		double lastTimeStampSeconds = -1;
+		double nextExpectedTick = -1;
+		int64_t lastArrivalNs = 0;
+	};
+}
+
+#endif // __DEVICECLOCK_H__
@@ -0,0 +1,156 @@
+/*
+    ------------------------------------------------------------------
+
+    This file is part of the Open Ephys GUI
+    Copyright (C) 2016 Open Ephys
+
+    ------------------------------------------------------------------
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include "DeviceConnection.h"
+
+#include <stdio.h>
+
+// AlphaOmega SDK
+namespace AO
+{
+#include "AOTypes.h"
+#include "AOSystemAPI.h"
+#include "StreamFormat.h"
+}
+
+using namespace AONode;
+
+// isConnected is cheap, polling it often makes the connection usable as soon as it is up
+#define CONNECTING_POLL_MS 50
+#define CONNECTED_POLL_MS 1000
+#define CONNECTION_TIMEOUT_MS 10000
+
+static String getLastAOSDKError()
+{
+    char sError[1000] = {0};
+    int nErrorCount = 0;
+    AO::ErrorHandlingfunc(&nErrorCount, sError, 1000);
+    return String(sError);
+}
+
+DeviceConnection::DeviceConnection(const File &lastMacFile_) : lastMacFile(lastMacFile_)
+{
+    if (lastMacFile.existsAsFile())
+        lastMac = lastMacFile.loadFileAsString().trim();
+
+    // The SDK connection outlives plugin instances
+    if (AO::isConnected() == AO::eAO_CONNECTED)
+    {
+        state = ConnectionState::CONNECTED;
+        startTimer(CONNECTED_POLL_MS);
+    }
+}
+
+DeviceConnection::~DeviceConnection()
+{
+    stopTimer();
+}
+
+void DeviceConnection::connect(const String &mac)
+{
+    AO::MAC_ADDR sysMAC = {0};
+    if (sscanf(mac.toStdString().c_str(), "%x:%x:%x:%x:%x:%x",
+               &sysMAC.addr[0], &sysMAC.addr[1], &sysMAC.addr[2], &sysMAC.addr[3], &sysMAC.addr[4], &sysMAC.addr[5]) != 6)
+    {
+        lastError = "Invalid MAC address " + mac;
+        setState(ConnectionState::FAILED);
+        return;
+    }
+
+    lastMac = mac.trim().toUpperCase();
+    if (!lastMacFile.replaceWithText(lastMac))
+        LOGE("Unable to remember the MAC address in ", lastMacFile.getFullPathName());
+
+    LOGC("Connecting to Neuro Omega ", lastMac);
+    if (AO::DefaultStartConnection(&sysMAC, 0) != AO::eAO_OK)
+    {
+        lastError = getLastAOSDKError();
+        setState(ConnectionState::FAILED);
+        return;
+    }
+
+    connectStartMs = Time::currentTimeMillis();
+    setState(ConnectionState::CONNECTING);
+    startTimer(CONNECTING_POLL_MS);
+}
+
+bool DeviceConnection::connectToLastMac()
+{
+    if (lastMac.isEmpty())
+        return false;
+
+    connect(lastMac);
+    return true;
+}
+
+void DeviceConnection::timerCallback()
+{
+    const bool connected = AO::isConnected() == AO::eAO_CONNECTED;
+
+    if (state == ConnectionState::CONNECTING)
+    {
+        if (connected)
+        {
+            LOGC("Connected to Neuro Omega ", lastMac, " in ", Time::currentTimeMillis() - connectStartMs, " ms");
+            startTimer(CONNECTED_POLL_MS);
+            setState(ConnectionState::CONNECTED);
+        }
+        else if (Time::currentTimeMillis() - connectStartMs >= CONNECTION_TIMEOUT_MS)
+        {
+            stopTimer();
+            lastError = getLastAOSDKError();
+            LOGE("Unable to connect to Neuro Omega ", lastMac, ": ", lastError);
+            setState(ConnectionState::FAILED);
+        }
+    }
+    else if (state == ConnectionState::CONNECTED && !connected)
+    {
+        stopTimer();
+        lastError = getLastAOSDKError();
+        LOGE("Lost the connection to Neuro Omega ", lastMac);
+        setState(ConnectionState::DISCONNECTED);
+    }
+}
+
+void DeviceConnection::setState(ConnectionState newState)
+{
+    state = newState;
+    if (onStateChanged)
+        onStateChanged(state);
+}
+
+String DeviceConnection::getStatusText() const
+{
+    switch (state)
+    {
+    case ConnectionState::DISCONNECTED:
+        return "Not connected";
+    case ConnectionState::CONNECTING:
+        return "Connecting...";
+    case ConnectionState::CONNECTED:
+        return "Connected";
+    case ConnectionState::FAILED:
+        return "Unable to connect";
+    }
+    return "";
+}
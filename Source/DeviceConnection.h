@@ -0,0 +1,89 @@
+/*
+	------------------------------------------------------------------
+
+	This file is part of the Open Ephys GUI
+	Copyright (C) 2020 Open Ephys
+
+	------------------------------------------------------------------
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef __DEVICECONNECTION_H__
+#define __DEVICECONNECTION_H__
+
+#include <DataThreadHeaders.h>
+
+#include <functional>
+
+namespace AONode
+{
+	/** Where the connection to the Neuro Omega stands */
+	enum class ConnectionState
+	{
+		DISCONNECTED = 1,
+		CONNECTING,
+		CONNECTED,
+		FAILED
+	};
+
+	/**
+		Connects to a Neuro Omega without blocking the message thread.
+
+		connect() starts the SDK connection and returns; a timer then polls
+		AO::isConnected until the system answers or the attempt times out,
+		and keeps checking the connection once it is up. The last MAC address
+		asked for is remembered in a file and used by connectToLastMac().
+
+		Message thread only, onStateChanged is called on it for every change.
+	*/
+	class DeviceConnection : private Timer
+	{
+	public:
+		DeviceConnection(const File &lastMacFile);
+		~DeviceConnection();
+
+		/** Starts connecting to the system with the given MAC address, "AA:BB:CC:DD:EE:FF" */
+		void connect(const String &mac);
+
+		/** Connects to the last MAC address asked for, returns false if there is none */
+		bool connectToLastMac();
+
+		ConnectionState getState() const { return state; }
+		const String &getLastMac() const { return lastMac; }
+
+		/** SDK error of the last failed attempt */
+		const String &getLastError() const { return lastError; }
+
+		/** One line for the editor */
+		String getStatusText() const;
+
+		std::function<void(ConnectionState)> onStateChanged;
+
+	private:
+		void timerCallback() override;
+		void setState(ConnectionState newState);
+
+		File lastMacFile;
+		String lastMac;
+		String lastError;
+		ConnectionState state = ConnectionState::DISCONNECTED;
+		int64 connectStartMs = 0;
+
+		JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(DeviceConnection);
+	};
+}
+
+#endif // __DEVICECONNECTION_H__
@@ -35,7 +35,7 @@ DeviceEditor::DeviceEditor(GenericProcessor *parentNode,
                            DeviceThread *board_)
     : VisualizerEditor(parentNode, "tabText", 340), board(board_)
 {
-    desiredWidth = 150;
+    desiredWidth = 430;
     canvas = nullptr;
     tabText = "Neuro Omega";
 
@@ -53,6 +53,179 @@ DeviceEditor::DeviceEditor(GenericProcessor *parentNode,
     updateChannelsFromSelector->onChange = [this]
     { updateChannelsFromChanged(); };
     addChildComponent(updateChannelsFromSelector);
+
+    pollWaitLabel = new Label("PollWait", "Wait For Data By:");
+    pollWaitLabel->setBounds(10, 75, 130, 20);
+    addAndMakeVisible(pollWaitLabel);
+
+    pollWaitSelector = new ComboBox("");
+    pollWaitSelector->setBounds(15, 100, 120, 20);
+    pollWaitSelector->setVisible(true);
+    pollWaitSelector->addItem(String("Spin"), (int)PollWaitMode::SPIN);
+    pollWaitSelector->addItem(String("Spin, then Yield"), (int)PollWaitMode::SPIN_THEN_YIELD);
+    pollWaitSelector->addItem(String("Sleep"), (int)PollWaitMode::SLEEP_UNTIL_READY);
+    pollWaitSelector->setSelectedId((int)board->getPollWaitMode(), dontSendNotification);
+    pollWaitSelector->onChange = [this]
+    { pollWaitChanged(); };
+    addChildComponent(pollWaitSelector);
+
+    acquisitionModeLabel = new Label("AcquisitionMode", "Read Streams:");
+    acquisitionModeLabel->setBounds(150, 25, 130, 20);
+    addAndMakeVisible(acquisitionModeLabel);
+
+    acquisitionModeSelector = new ComboBox("");
+    acquisitionModeSelector->setBounds(155, 50, 120, 20);
+    acquisitionModeSelector->setVisible(true);
+    acquisitionModeSelector->addItem(String("In Sequence"), (int)AcquisitionMode::SEQUENTIAL);
+    acquisitionModeSelector->addItem(String("Scheduled"), (int)AcquisitionMode::SCHEDULED);
+    acquisitionModeSelector->addItem(String("Thread Per Stream"), (int)AcquisitionMode::READER_THREADS);
+    acquisitionModeSelector->setSelectedId((int)board->getAcquisitionMode(), dontSendNotification);
+    acquisitionModeSelector->onChange = [this]
+    { acquisitionModeChanged(); };
+    addChildComponent(acquisitionModeSelector);
+
+    countersLabel = new CountersLabel(board);
+    countersLabel->setBounds(150, 75, 135, 45);
+    addAndMakeVisible(countersLabel);
+
+    sampleSourceLabel = new Label("SampleSource", "Data Source:");
+    sampleSourceLabel->setBounds(290, 25, 130, 20);
+    addAndMakeVisible(sampleSourceLabel);
+
+    sampleSourceSelector = new ComboBox("");
+    sampleSourceSelector->setBounds(295, 50, 120, 20);
+    sampleSourceSelector->setVisible(true);
+    sampleSourceSelector->addItem(String("Neuro Omega"), (int)SampleSourceType::NEURO_OMEGA);
+    sampleSourceSelector->addItem(String("Synthetic"), (int)SampleSourceType::SYNTHETIC);
+    sampleSourceSelector->addItem(String("Replay..."), (int)SampleSourceType::REPLAY);
+    sampleSourceSelector->setSelectedId((int)board->getSampleSourceType(), dontSendNotification);
+    sampleSourceSelector->onChange = [this]
+    { sampleSourceChanged(); };
+    addChildComponent(sampleSourceSelector);
+
+    macEditor = new TextEditor("MAC");
+    macEditor->setBounds(295, 75, 120, 20);
+    macEditor->setTextToShowWhenEmpty("AA:BB:CC:DD:EE:FF", Colours::grey);
+    macEditor->setText(board->getConnection().getLastMac(), dontSendNotification);
+    macEditor->onReturnKey = [this]
+    { connectClicked(); };
+    addAndMakeVisible(macEditor);
+
+    connectButton = new TextButton("Connect");
+    connectButton->setBounds(295, 100, 55, 20);
+    connectButton->onClick = [this]
+    { connectClicked(); };
+    addAndMakeVisible(connectButton);
+
+    connectionStatusLabel = new Label("ConnectionStatus", "");
+    connectionStatusLabel->setBounds(350, 100, 75, 20);
+    connectionStatusLabel->setFont(Font("Small Text", 11, Font::plain));
+    addAndMakeVisible(connectionStatusLabel);
+
+    board->onInputSourceChanged = [this]
+    { inputSourceChanged(); };
+    board->onChannelsXmlListsReplaced = [this]
+    { setUpCanvas(); };
+    updateConnectionControls(CoreServices::getAcquisitionStatus());
+}
+
+DeviceEditor::~DeviceEditor()
+{
+    board->onInputSourceChanged = nullptr;
+    board->onChannelsXmlListsReplaced = nullptr;
+}
+
+void DeviceEditor::connectClicked()
+{
+    board->connectToDevice(macEditor->getText());
+    updateConnectionControls(false);
+}
+
+void DeviceEditor::inputSourceChanged()
+{
+    // A connection lost while acquiring is only shown, the signal chain changes once stopped
+    const bool acquiring = CoreServices::getAcquisitionStatus();
+    updateConnectionControls(acquiring);
+    if (acquiring)
+        return;
+
+    updateChannelsFromSelector->setEnabled(board->foundInputSource());
+    setUpCanvas();
+    CoreServices::updateSignalChain(this);
+}
+
+void DeviceEditor::updateConnectionControls(bool acquiring)
+{
+    const DeviceConnection &connection = board->getConnection();
+    const bool neuroOmega = board->getSampleSourceType() == SampleSourceType::NEURO_OMEGA;
+
+    connectionStatusLabel->setText(neuroOmega ? connection.getStatusText() : String(), dontSendNotification);
+    connectionStatusLabel->setTooltip(connection.getState() == ConnectionState::FAILED ? connection.getLastError() : String());
+
+    const bool canConnect = neuroOmega && !acquiring && connection.getState() != ConnectionState::CONNECTING;
+    macEditor->setEnabled(canConnect);
+    connectButton->setEnabled(canConnect);
+}
+
+CountersLabel::CountersLabel(DeviceThread *board_) : Label("Counters", ""), board(board_)
+{
+    setFont(Font("Small Text", 11, Font::plain));
+    setJustificationType(Justification::topLeft);
+}
+
+void CountersLabel::timerCallback()
+{
+    var snapshot = board->getCountersSnapshot();
+    if (!snapshot.isObject())
+        return;
+
+    double samplesPerSecond = 0;
+    double maxBufferFill = 0;
+    int64 lostSamples = 0;
+    int64 sdkErrors = 0;
+    for (const var &stream : *snapshot["streams"].getArray())
+    {
+        samplesPerSecond += (double)stream["samplesPerSecond"] * (int)stream["channels"];
+        maxBufferFill = jmax(maxBufferFill, (double)stream["maxBufferFill"]);
+        lostSamples += (int64)stream["lostSamples"];
+        sdkErrors += (int64)stream["sdkErrors"];
+    }
+
+    setText(String(samplesPerSecond / 1000.0, 1) + " kS/s, " + String(roundToInt(maxBufferFill * 100)) + "% full\n" +
+                String(lostSamples) + " lost, " + String(sdkErrors) + " SDK errors",
+            dontSendNotification);
+}
+
+void DeviceEditor::acquisitionModeChanged()
+{
+    board->setAcquisitionMode((AcquisitionMode)acquisitionModeSelector->getSelectedId());
+}
+
+void DeviceEditor::sampleSourceChanged()
+{
+    SampleSourceType type = (SampleSourceType)sampleSourceSelector->getSelectedId();
+    if (type == SampleSourceType::REPLAY)
+    {
+        FileChooser chooser("Select a raw capture folder", board->getReplayFolder());
+        if (!chooser.browseForDirectory())
+        {
+            sampleSourceSelector->setSelectedId((int)board->getSampleSourceType(), dontSendNotification);
+            return;
+        }
+        board->setReplayFolder(chooser.getResult());
+    }
+
+    board->setSampleSourceType(type);
+    updateConnectionControls(false);
+    updateChannelsFromSelector->setEnabled(board->foundInputSource());
+    setUpCanvas();
+    CoreServices::updateSignalChain(this);
+}
+
+void DeviceEditor::pollWaitChanged()
+{
+    // Safe during acquisition, the data thread picks the new mode up on its next poll
+    board->setPollWaitMode((PollWaitMode)pollWaitSelector->getSelectedId());
 }
 
 void DeviceEditor::updateChannelsFromChanged()
@@ -80,16 +253,33 @@ void DeviceEditor::startAcquisition()
 {
     if (updateChannelsFromSelector != nullptr)
         updateChannelsFromSelector->setEnabled(false);
+    if (acquisitionModeSelector != nullptr)
+        acquisitionModeSelector->setEnabled(false);
+    if (sampleSourceSelector != nullptr)
+        sampleSourceSelector->setEnabled(false);
+    if (connectButton != nullptr)
+        updateConnectionControls(true);
+    if (countersLabel != nullptr)
+        countersLabel->startTimer(1000);
+    // Channels and streams can still be toggled, the thread reads the new selection at once
     if (canvas != nullptr)
-        canvas->setEnabled(false);
+        canvas->setOnlySelectionEditable(true);
 }
 
 void DeviceEditor::stopAcquisition()
 {
     if (updateChannelsFromSelector != nullptr)
         updateChannelsFromSelector->setEnabled(true);
+    if (acquisitionModeSelector != nullptr)
+        acquisitionModeSelector->setEnabled(true);
+    if (sampleSourceSelector != nullptr)
+        sampleSourceSelector->setEnabled(true);
+    if (connectButton != nullptr)
+        updateConnectionControls(false);
+    if (countersLabel != nullptr)
+        countersLabel->stopTimer();
     if (canvas != nullptr)
-        canvas->setEnabled(true);
+        canvas->setOnlySelectionEditable(false);
 }
 
 Visualizer *DeviceEditor::createNewCanvas()
@@ -108,12 +298,13 @@ void DeviceEditor::setUpCanvas()
 {
     if (canvas != nullptr)
     {
-        canvas->channelsTable->initFromXml(board->channelsXmlList);
+        canvas->channelsTable->initFromXml(board->channelsXmlList.get());
         canvas->channelsTable->addXmlModifiedListener(this);
-        canvas->streamsTable->initFromXml(board->streamsXmlList);
+        canvas->streamsTable->initFromXml(board->streamsXmlList.get());
         canvas->streamsTable->addXmlModifiedListener(this);
         canvas->channelStreamTabs->setCurrentTabIndex(1);
         canvas->channelStreamTabs->setCurrentTabIndex(0);
+        canvas->setOnlySelectionEditable(CoreServices::getAcquisitionStatus());
         canvas->updateContent();
         canvas->resized();
     }
@@ -121,8 +312,16 @@ void DeviceEditor::setUpCanvas()
 
 void DeviceEditor::actionListenerCallback(const String &message)
 {
-    board->updateChannelsStreamsEnabled();
+    StringArray tokens = StringArray::fromTokens(message, ":", "");
+    if (tokens[0] == "Enabled" && tokens[1] == "CHANNELS")
+        board->channelEnabledChanged(tokens[2].getIntValue());
+    else if (tokens[0] == "Enabled" && tokens[1] == "STREAMS")
+        board->streamEnabledChanged(tokens[2].getIntValue());
+    else
+        board->updateChannelsStreamsEnabled();
     if (canvas != nullptr)
         canvas->updateContent();
-    CoreServices::updateSignalChain(this);
+    // While acquiring the thread reads the new selection at once, the signal chain follows when it stops
+    if (!CoreServices::getAcquisitionStatus())
+        CoreServices::updateSignalChain(this);
 }
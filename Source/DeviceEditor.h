@@ -28,6 +28,21 @@ namespace AONode
 	class DeviceThread;
 	class ChannelsStreamsCanvas;
 
+	/** Shows the acquisition counters of the device thread, refreshed while acquiring */
+	class CountersLabel : public Label,
+						  public Timer
+	{
+	public:
+		CountersLabel(DeviceThread *board);
+
+		void timerCallback() override;
+
+	private:
+		DeviceThread *board;
+
+		JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(CountersLabel);
+	};
+
 	class DeviceEditor : public VisualizerEditor,
 						 public ActionListener
 
@@ -37,7 +52,7 @@ namespace AONode
 		DeviceEditor(GenericProcessor *parentNode, DeviceThread *thread);
 
 		/** Destructor*/
-		~DeviceEditor() {}
+		~DeviceEditor();
 
 		/** Disable UI during acquisition*/
 		void startAcquisition();
@@ -61,6 +76,28 @@ namespace AONode
 		ScopedPointer<Label> updateChannelsFromLabel;
 		ScopedPointer<ComboBox> updateChannelsFromSelector;
 		void updateChannelsFromChanged();
+
+		ScopedPointer<Label> pollWaitLabel;
+		ScopedPointer<ComboBox> pollWaitSelector;
+		void pollWaitChanged();
+
+		ScopedPointer<Label> acquisitionModeLabel;
+		ScopedPointer<ComboBox> acquisitionModeSelector;
+		void acquisitionModeChanged();
+
+		ScopedPointer<Label> sampleSourceLabel;
+		ScopedPointer<ComboBox> sampleSourceSelector;
+		void sampleSourceChanged();
+
+		ScopedPointer<TextEditor> macEditor;
+		ScopedPointer<TextButton> connectButton;
+		ScopedPointer<Label> connectionStatusLabel;
+		void connectClicked();
+		/** Shows the connection state, and the channels once the device connected */
+		void inputSourceChanged();
+		void updateConnectionControls(bool acquiring);
+
+		ScopedPointer<CountersLabel> countersLabel;
 		void setUpCanvas();
 
 		JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(DeviceEditor);
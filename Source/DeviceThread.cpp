@@ -27,9 +27,14 @@
 
 #include "DeviceThread.h"
 #include "DeviceEditor.h"
+#include "SampleConversion.h"
+#include "ReplaySource.h"
+#include "SyntheticSource.h"
 
+#include <algorithm>
 #include <ctime>
 #include <math.h>
+#include <utility>
 
 // AlphaOmega SDK
 namespace AO
@@ -41,20 +46,41 @@ namespace AO
 
 using namespace AONode;
 
-#define AO_BUFFER_SIZE_MS 5000
 #define SOURCE_BUFFER_SIZE 10000
-
-#define TEST_MODE_ON false
-#define TEST_SLEEP_TIME_MS 100
+#define DEPTH_POLL_RATE_HZ 10.0
+// Depth changes marked by the data thread and not yet broadcast, far more than a drive makes between two timer calls
+#define DEPTH_CHANGE_QUEUE_SIZE 256
+// TTL lines 0 to 15 follow the first digital input port
+#define DIGITAL_INPUT_LINES 16
+// TTL line of every stream that goes high for one sample where the drive depth changed
+#define DEPTH_EVENT_LINE 16
+// Channel IDs above this are digital ports, not continuous channels
+#define FIRST_DIGITAL_CHANNEL_ID 11100
 
 static const float DRIVE_ZERO_POSITION_MILIM = 25.0;
 
+static String getAcquisitionModeName(AcquisitionMode mode)
+{
+    switch (mode)
+    {
+    case AcquisitionMode::SEQUENTIAL:
+        return "sequential";
+    case AcquisitionMode::SCHEDULED:
+        return "scheduled";
+    case AcquisitionMode::READER_THREADS:
+        return "reader threads";
+    }
+    return "unknown";
+}
+
 DataThread *DeviceThread::createDataThread(SourceNode *sn)
 {
     return new DeviceThread(sn);
 }
 
 DeviceThread::DeviceThread(SourceNode *sn) : DataThread(sn),
+                                             engine(*this),
+                                             depthChangeMarks(DEPTH_CHANGE_QUEUE_SIZE),
                                              isTransmitting(false),
                                              updateSettingsDuringAcquisition(false)
 {
@@ -62,59 +88,164 @@ DeviceThread::DeviceThread(SourceNode *sn) : DataThread(sn),
     // removing this will make the gui crash
     sourceBuffers.add(new DataBuffer(2, SOURCE_BUFFER_SIZE));
 
-    queryUserStartConnection();
+    replayFolder = ReplaySource::getSettingsFromEnvironment().folder;
+
+    String depthPollRate = SystemStats::getEnvironmentVariable("NEUROOMEGA_DEPTH_POLL_HZ", "");
+    depthPollRateHz = DepthPoller::limitPollRate(depthPollRate.isNotEmpty() ? depthPollRate.getDoubleValue() : DEPTH_POLL_RATE_HZ);
+
+    // NEUROOMEGA_SOURCE=synthetic or replay starts without hardware
+    String sourceName = SystemStats::getEnvironmentVariable("NEUROOMEGA_SOURCE", "");
+    if (sourceName.equalsIgnoreCase("synthetic"))
+        createSampleSource(SampleSourceType::SYNTHETIC);
+    else if (sourceName.equalsIgnoreCase("replay"))
+        createSampleSource(SampleSourceType::REPLAY);
+    else
+        createSampleSource(SampleSourceType::NEURO_OMEGA);
+
+    String benchmarkReportPath = SystemStats::getEnvironmentVariable("NEUROOMEGA_BENCHMARK", "");
+    if (benchmarkReportPath.isNotEmpty())
+        benchmark = std::make_unique<AcquisitionBenchmark>(File(benchmarkReportPath));
+
+    String capturePath = SystemStats::getEnvironmentVariable("NEUROOMEGA_CAPTURE", "");
+    if (capturePath.isNotEmpty())
+        captureDirectory = File(capturePath);
+
+    // The GUI comes up at once, the channels are read when the connection is up
+    connection = std::make_unique<DeviceConnection>(configFiles.getDirectory().getChildFile("NeuroOmegaMAC.txt"));
+    connection->onStateChanged = [this](ConnectionState state)
+    { connectionStateChanged(state); };
+    // The last configuration of the device shows at once, it is checked against the device when connected
+    if (sampleSource->getType() == SampleSourceType::NEURO_OMEGA)
+    {
+        loadChannelsCache();
+        if (!foundInputSource())
+            connection->connectToLastMac();
+    }
+    if (foundInputSource() && channelsXmlList == nullptr)
+        updateChannelsFromAOInfo();
+}
+
+void DeviceThread::connectToDevice(const String &mac)
+{
+    jassert(!isThreadRunning());
+    connection->connect(mac);
+}
+
+void DeviceThread::connectionStateChanged(ConnectionState state)
+{
+    if (getSampleSourceType() != SampleSourceType::NEURO_OMEGA)
+        return;
+
+    if (state == ConnectionState::CONNECTED)
+        probeChannels();
+
+    if (onInputSourceChanged)
+        onInputSourceChanged();
+}
+
+void DeviceThread::setSampleSourceType(SampleSourceType type)
+{
+    jassert(!isThreadRunning());
+    if (type == getSampleSourceType())
+        return;
+
+    createSampleSource(type);
+    if (type == SampleSourceType::NEURO_OMEGA && !foundInputSource())
+    {
+        loadChannelsCache();
+        if (connection->getState() != ConnectionState::CONNECTING)
+            connection->connectToLastMac();
+    }
+
     if (foundInputSource())
         updateChannelsFromAOInfo();
 }
 
-void DeviceThread::updateChannelsFromAOInfo()
+void DeviceThread::setReplayFolder(const File &folder)
 {
-    AO::uint32 AONumberOfChannels = 0;
-    AO::GetChannelsCount(&AONumberOfChannels);
-    AO::SInformation *pChannelsInfo;
+    jassert(!isThreadRunning());
+    replayFolder = folder;
+    if (getSampleSourceType() != SampleSourceType::REPLAY)
+        return;
 
-    if (TEST_MODE_ON)
-        pChannelsInfo = populateInfoWithTestData(&AONumberOfChannels);
-    else
+    createSampleSource(SampleSourceType::REPLAY);
+    if (foundInputSource())
+        updateChannelsFromAOInfo();
+}
+
+void DeviceThread::createSampleSource(SampleSourceType type)
+{
+    // The channel lists no longer describe what the source reports
+    deviceChannelsHash = 0;
+
+    switch (type)
     {
-        pChannelsInfo = new AO::SInformation[AONumberOfChannels];
-        AO::GetAllChannels(pChannelsInfo, AONumberOfChannels);
+    case SampleSourceType::NEURO_OMEGA:
+        sampleSource = std::make_unique<NeuroOmegaSource>();
+        break;
+    case SampleSourceType::SYNTHETIC:
+        sampleSource = std::make_unique<SyntheticSource>(SyntheticSource::getSettingsFromEnvironment());
+        break;
+    case SampleSourceType::REPLAY:
+    {
+        ReplaySource::Settings settings = ReplaySource::getSettingsFromEnvironment();
+        settings.folder = replayFolder;
+        sampleSource = std::make_unique<ReplaySource>(settings);
+        break;
+    }
     }
+}
+
+SampleSourceType DeviceThread::getSampleSourceType() const
+{
+    return sampleSource->getType();
+}
+
+String DeviceThread::readDeviceChannelList(HeapBlock<AO::SInformation> &channelsInfo, int &numberOfAOChannels)
+{
+    AO::uint32 channelsCount = 0;
+    sampleSource->getChannelsCount(&channelsCount);
+    numberOfAOChannels = (int)channelsCount;
+    channelsInfo.calloc(jmax(1, numberOfAOChannels));
+    sampleSource->getAllChannels(channelsInfo, numberOfAOChannels);
+
+    String channelList;
+    for (int i = 0; i < numberOfAOChannels; i++)
+        channelList << String(channelsInfo[i].channelID) << ": " << channelsInfo[i].channelName << "\n";
+    return channelList;
+}
+
+void DeviceThread::updateChannelsFromAOInfo()
+{
+    HeapBlock<AO::SInformation> pChannelsInfo;
+    int AONumberOfChannels = 0;
+    const String channelList = readDeviceChannelList(pChannelsInfo, AONumberOfChannels);
 
     LOGC("Found ", AONumberOfChannels, " AO channels:");
     for (int i = 0; i < AONumberOfChannels; i++)
         LOGC("ID: ", pChannelsInfo[i].channelID, " Name: ", pChannelsInfo[i].channelName);
 
-    File configsDir;
-    if (File::getSpecialLocation(File::currentApplicationFile).getFullPathName().contains("plugin-GUI" + File::getSeparatorString() + "Build"))
-        configsDir = File::getSpecialLocation(File::currentApplicationFile).getParentDirectory().getChildFile("configs");
-    else
-        configsDir = File::getSpecialLocation(File::SpecialLocationType::commonApplicationDataDirectory).getChildFile("Open Ephys").getChildFile("configs-api8");
-
-    FileOutputStream logChannels(configsDir.getChildFile("ChannelsAvailable.log"));
-    logChannels.setPosition(0);
-    logChannels.truncate();
-    for (int i = 0; i < AONumberOfChannels; i++)
-    {
-        logChannels.writeText(String(pChannelsInfo[i].channelID) + ": " + pChannelsInfo[i].channelName + "\n", false, false, nullptr);
-        logChannels.flush();
-    }
+    const File &configsDir = configFiles.getDirectory();
+    configsDir.getChildFile("ChannelsAvailable.log").replaceWithText(channelList, false, false, nullptr);
+    deviceChannelsHash = channelList.hashCode64();
 
-    channelsXmlList = new XmlElement("CHANNELS");
-    streamsXmlList = new XmlElement("STREAMS");
+    std::unique_ptr<XmlElement> channels = std::make_unique<XmlElement>("CHANNELS");
+    std::unique_ptr<XmlElement> streams = std::make_unique<XmlElement>("STREAMS");
 
-    XmlElement *channel, *stream, *defaultStream, *defaultChannel;
+    XmlElement *channel, *stream = nullptr;
+    const XmlElement *defaultStream, *defaultChannel;
     String AOChannelName, channelName, streamName;
     int streamID = -1;
     numberOfChannels = AONumberOfChannels;
-    XmlElement *defaultStreamsXmlList = parseDefaultFileByName("STREAMS");
-    XmlElement* defaultChannelsXmlList = parseDefaultFileByName("CHANNELS");
+    digitalInputIDs.clearQuick();
+    const ChannelDefaults &defaults = configFiles.getChannelDefaults();
 
     for (int ch = 0; ch < AONumberOfChannels; ch++)
     {
         AOChannelName = String(pChannelsInfo[ch].channelName);
-        if (pChannelsInfo[ch].channelID > 11100)
+        if (pChannelsInfo[ch].channelID > FIRST_DIGITAL_CHANNEL_ID)
         {
+            digitalInputIDs.add(pChannelsInfo[ch].channelID);
             numberOfChannels--;
             continue;
         }
@@ -137,9 +268,9 @@ void DeviceThread::updateChannelsFromAOInfo()
         // Channel name always starts from the last occurrence of space
         channelName = AOChannelName.fromLastOccurrenceOf(" ", false, false);
 
-        if (streamID < 0 || (!streamName.equalsIgnoreCase(streamsXmlList->getChildElement(streamID)->getStringAttribute("Stream_Name"))))
+        if (streamID < 0 || (!streamName.equalsIgnoreCase(stream->getStringAttribute("Stream_Name"))))
         {
-            defaultStream = getStreamMatchingName(defaultStreamsXmlList, &streamName);
+            defaultStream = defaults.getStream(streamName);
             streamID++;
             stream = new XmlElement("STREAM");
             stream->setAttribute("ID", streamID);
@@ -149,8 +280,9 @@ void DeviceThread::updateChannelsFromAOInfo()
             stream->setAttribute("Gain", (defaultStream != nullptr) ? defaultStream->getDoubleAttribute("Gain") : 1);
             stream->setAttribute("Channel_IDs", "");
             stream->setAttribute("Number_Of_Channels", "");
-            stream->setAttribute("Enabled", (defaultStream != nullptr) ? defaultStream->getBoolAttribute("Enabled") : false);
-            streamsXmlList->addChildElement(stream);
+            // Benchmarks record everything the device exposes
+            stream->setAttribute("Enabled", (benchmark != nullptr) || ((defaultStream != nullptr) ? defaultStream->getBoolAttribute("Enabled") : false));
+            streams->addChildElement(stream);
         }
 
         stream->setAttribute("Channel_IDs", "");
@@ -161,138 +293,185 @@ void DeviceThread::updateChannelsFromAOInfo()
         channel->setAttribute("Stream_Name", streamName);
         channel->setAttribute("Channel_Name", channelName);
         //channel->setAttribute("Enabled", true);
-        defaultChannel = getChannelMatchingName(defaultChannelsXmlList, &streamName, &channelName);
-        channel->setAttribute("Enabled", (defaultChannel != nullptr)? defaultChannel->getBoolAttribute("Enabled") : false);
-        channelsXmlList->addChildElement(channel);
+        defaultChannel = defaults.getChannel(streamName, channelName);
+        channel->setAttribute("Enabled", (benchmark != nullptr) || ((defaultChannel != nullptr) ? defaultChannel->getBoolAttribute("Enabled") : false));
+        channels->addChildElement(channel);
     }
 
-    numberOfStreams = streamsXmlList->getNumChildElements();
-    updateChannelsStreamsEnabled();
+    setChannelsXmlLists(std::move(streams), std::move(channels));
     streamsXmlList->writeTo(configsDir.getChildFile("ChannelsFiltered.xml"));
+    saveChannelsCache();
 }
 
-AO::SInformation *DeviceThread::populateInfoWithTestData(AO::uint32 *AONumberOfChannels)
-{
-    *AONumberOfChannels = 10;
-    AO::SInformation *pChannelsInfo = new AO::SInformation[*AONumberOfChannels];
-    pChannelsInfo[0].channelID = 10000;
-    pChannelsInfo[1].channelID = 10001;
-    pChannelsInfo[2].channelID = 10002;
-    pChannelsInfo[3].channelID = 10003;
-    pChannelsInfo[4].channelID = 10004;
-    pChannelsInfo[5].channelID = 10005;
-    pChannelsInfo[6].channelID = 10006;
-    pChannelsInfo[7].channelID = 10007;
-    pChannelsInfo[8].channelID = 10008;
-    pChannelsInfo[9].channelID = 10009;
-    strcpy(pChannelsInfo[0].channelName, "LFP 01 / Central");
-    strcpy(pChannelsInfo[1].channelName, "LFP 02 / Posteriolateral");
-    strcpy(pChannelsInfo[2].channelName, "LFP 03");
-    strcpy(pChannelsInfo[3].channelName, "LFP 04");
-    strcpy(pChannelsInfo[4].channelName, "LFP 05");
-    strcpy(pChannelsInfo[5].channelName, "Macro_LFP 01 / Central");
-    strcpy(pChannelsInfo[6].channelName, "Macro_LFP 02 / Posteriolateral");
-    strcpy(pChannelsInfo[7].channelName, "Macro_LFP 03");
-    strcpy(pChannelsInfo[8].channelName, "Macro_LFP 04");
-    strcpy(pChannelsInfo[9].channelName, "Macro_LFP 05");
-    return pChannelsInfo;
-}
-
-void DeviceThread::updateChannelsFromDefaults()
+void DeviceThread::probeChannels()
 {
-    channelsXmlList = parseDefaultFileByName("CHANNELS");
-    streamsXmlList = parseDefaultFileByName("STREAMS");
+    if (channelsXmlList == nullptr || streamsXmlList == nullptr)
+    {
+        updateChannelsFromAOInfo();
+        return;
+    }
 
-    if ((channelsXmlList == nullptr) || (streamsXmlList == nullptr))
+    HeapBlock<AO::SInformation> channelsInfo;
+    int numberOfAOChannels = 0;
+    if (readDeviceChannelList(channelsInfo, numberOfAOChannels).hashCode64() == deviceChannelsHash)
+    {
+        LOGC("Device channels unchanged, keeping the saved configuration");
         return;
+    }
 
-    numberOfChannels = channelsXmlList->getNumChildElements();
-    numberOfStreams = streamsXmlList->getNumChildElements();
+    // The channels the device still has keep their selection, new ones take their defaults
+    HashMap<int, bool> channelsEnabled;
+    for (auto *channel : channelsXmlList->getChildIterator())
+        channelsEnabled.set(channel->getIntAttribute("ID"), channel->getBoolAttribute("Enabled"));
+    HashMap<String, bool> streamsEnabled;
+    for (auto *stream : streamsXmlList->getChildIterator())
+        streamsEnabled.set(stream->getStringAttribute("Stream_Name"), stream->getBoolAttribute("Enabled"));
+
+    LOGC("Device channels changed since the configuration was saved");
+    updateChannelsFromAOInfo();
+
+    for (auto *channel : channelsXmlList->getChildIterator())
+        if (channelsEnabled.contains(channel->getIntAttribute("ID")))
+            channel->setAttribute("Enabled", channelsEnabled[channel->getIntAttribute("ID")]);
+    for (auto *stream : streamsXmlList->getChildIterator())
+        if (streamsEnabled.contains(stream->getStringAttribute("Stream_Name")))
+            stream->setAttribute("Enabled", streamsEnabled[stream->getStringAttribute("Stream_Name")]);
 
     updateChannelsStreamsEnabled();
+    saveChannelsCache();
 }
 
-XmlElement *DeviceThread::parseDefaultFileByName(String name)
+void DeviceThread::handleAsyncUpdate()
 {
-    File configsDir;
-    if (File::getSpecialLocation(File::currentApplicationFile).getFullPathName().contains("plugin-GUI" + File::getSeparatorString() + "Build"))
-        configsDir = File::getSpecialLocation(File::currentApplicationFile).getParentDirectory().getChildFile("configs");
-    else
-        configsDir = File::getSpecialLocation(File::SpecialLocationType::commonApplicationDataDirectory).getChildFile("Open Ephys").getChildFile("configs-api8");
+    // A restored configuration is checked once the signal chain is loaded, then shown
+    if (getSampleSourceType() == SampleSourceType::NEURO_OMEGA && foundInputSource() && !isThreadRunning())
+        probeChannels();
 
-    File defaultsFile(configsDir.getChildFile("AO" + name + ".xml"));
-    if (!defaultsFile.existsAsFile())
-    {
-        LOGC("Config file not found: ", defaultsFile.getFullPathName());
-        return nullptr;
-    }
-    std::unique_ptr<juce::XmlElement> fileData = XmlDocument::parse(defaultsFile);
-    return new XmlElement(*fileData->getChildByName(name));
+    if (onInputSourceChanged)
+        onInputSourceChanged();
 }
 
-XmlElement *DeviceThread::getStreamMatchingName(XmlElement *list, String *name)
+std::unique_ptr<XmlElement> DeviceThread::createChannelsStateXml()
 {
-    for (auto *child : list->getChildIterator())
-        if (name->startsWithIgnoreCase(child->getStringAttribute("Stream_Name")))
-            return new XmlElement(*child);
-    return nullptr;
+    StringArray digitalIDs;
+    for (int id : digitalInputIDs)
+        digitalIDs.add(String(id));
+
+    std::unique_ptr<XmlElement> state = std::make_unique<XmlElement>("NEURO_OMEGA_CHANNELS");
+    state->setAttribute("Source", (int)getSampleSourceType());
+    state->setAttribute("MAC", connection->getLastMac());
+    state->setAttribute("Device_Channels_Hash", String(deviceChannelsHash));
+    state->setAttribute("Digital_Input_IDs", digitalIDs.joinIntoString(","));
+    state->addChildElement(new XmlElement(*streamsXmlList));
+    state->addChildElement(new XmlElement(*channelsXmlList));
+    return state;
 }
 
-XmlElement* DeviceThread::getChannelMatchingName(XmlElement *list, String *Stream_Name, String *Channel_Name)
+bool DeviceThread::restoreChannelsStateXml(const XmlElement &state)
 {
-    for (auto* child : list->getChildIterator())
-        if (Stream_Name->equalsIgnoreCase(child->getStringAttribute("Stream_Name")) && Channel_Name->equalsIgnoreCase(child->getStringAttribute("Channel_Name")))
-            return new XmlElement(*child);
-    return nullptr;
+    const XmlElement *streams = state.getChildByName("STREAMS");
+    const XmlElement *channels = state.getChildByName("CHANNELS");
+    if (streams == nullptr || channels == nullptr || state.getIntAttribute("Source") != (int)getSampleSourceType())
+        return false;
+
+    setChannelsXmlLists(std::make_unique<XmlElement>(*streams), std::make_unique<XmlElement>(*channels));
+    deviceChannelsHash = state.getStringAttribute("Device_Channels_Hash").getLargeIntValue();
+
+    digitalInputIDs.clearQuick();
+    for (const String &id : StringArray::fromTokens(state.getStringAttribute("Digital_Input_IDs"), ",", ""))
+        digitalInputIDs.add(id.getIntValue());
+    return true;
 }
 
-void DeviceThread::updateChannelsStreamsEnabled()
+File DeviceThread::getChannelsCacheFile() const
+{
+    return configFiles.getDirectory().getChildFile("NeuroOmega " + connection->getLastMac().replaceCharacter(':', '-') + ".xml");
+}
+
+void DeviceThread::saveChannelsCache()
+{
+    if (getSampleSourceType() != SampleSourceType::NEURO_OMEGA || connection == nullptr || connection->getLastMac().isEmpty() ||
+        channelsXmlList == nullptr || streamsXmlList == nullptr || deviceChannelsHash == 0)
+        return;
+
+    std::unique_ptr<XmlElement> state = createChannelsStateXml();
+    if (!state->writeTo(getChannelsCacheFile()))
+        LOGE("Unable to write the channel cache ", getChannelsCacheFile().getFullPathName());
+}
+
+bool DeviceThread::loadChannelsCache()
 {
-    XmlElement *channel, *enabledChannel, *stream;
-    StringArray channelsIDs;
-    bool atLeastOneStreamEnabled = false;
+    if (connection->getLastMac().isEmpty() || !getChannelsCacheFile().existsAsFile())
+        return false;
 
-    for (int st = 0; st < numberOfStreams; st++)
+    std::unique_ptr<XmlElement> state = XmlDocument::parse(getChannelsCacheFile());
+    if (state == nullptr || !restoreChannelsStateXml(*state))
+        return false;
+
+    LOGC("Restored the channels of Neuro Omega ", connection->getLastMac(), " from ", getChannelsCacheFile().getFullPathName());
+    return true;
+}
+
+void DeviceThread::updateChannelsFromDefaults()
+{
+    std::unique_ptr<XmlElement> channels = copyDefaultsByName("CHANNELS");
+    std::unique_ptr<XmlElement> streams = copyDefaultsByName("STREAMS");
+    if ((channels == nullptr) || (streams == nullptr))
     {
-        stream = streamsXmlList->getChildElement(st);
-        stream->setAttribute("Channel_IDs", "");
-        stream->setAttribute("Number_Of_Channels", "0");
+        LOGE("No default channels or streams in ", configFiles.getDirectory().getFullPathName(), ", keeping the current lists");
+        return;
     }
 
-    for (int ch = 0; ch < numberOfChannels; ch++)
-    {
-        channel = channelsXmlList->getChildElement(ch);
-        if (!channel->getBoolAttribute("Enabled"))
-            continue;
+    digitalInputIDs.clearQuick();
+    deviceChannelsHash = 0;
+    setChannelsXmlLists(std::move(streams), std::move(channels));
+}
 
-        stream = streamsXmlList->getChildElement(channel->getIntAttribute("Stream_ID"));
+std::unique_ptr<XmlElement> DeviceThread::copyDefaultsByName(const String &name)
+{
+    const XmlElement *defaults = configFiles.getDefaults(name);
+    return (defaults != nullptr) ? std::make_unique<XmlElement>(*defaults) : nullptr;
+}
 
-        channelsIDs.addTokens(stream->getStringAttribute("Channel_IDs"), ",", "\"");
-        channelsIDs.add(channel->getStringAttribute("ID"));
+void DeviceThread::setChannelsXmlLists(std::unique_ptr<XmlElement> streams, std::unique_ptr<XmlElement> channels)
+{
+    // The canvas tables point into the old lists, they are freed once the tables moved to the new ones
+    std::unique_ptr<XmlElement> oldStreams = std::exchange(streamsXmlList, std::move(streams));
+    std::unique_ptr<XmlElement> oldChannels = std::exchange(channelsXmlList, std::move(channels));
+    numberOfChannels = channelsXmlList->getNumChildElements();
+    updateChannelsStreamsEnabled();
 
-        stream->setAttribute("Channel_IDs", channelsIDs.joinIntoString(","));
-        stream->setAttribute("Number_Of_Channels", channelsIDs.size());
+    if (onChannelsXmlListsReplaced)
+        onChannelsXmlListsReplaced();
+}
 
-        channelsIDs.clear();
-        enabledChannel = channelsXmlList->getChildElement(ch);
-    }
+void DeviceThread::updateChannelsStreamsEnabled()
+{
+    channelModel.rebuild(streamsXmlList.get(), channelsXmlList.get());
+    if (isTransmitting)
+        updateFetchPlanDuringAcquisition();
+}
 
-    for (int st = 0; st < numberOfStreams; st++)
-    {
-        stream = streamsXmlList->getChildElement(st);
-        if (!stream->getBoolAttribute("Enabled"))
-            continue;
-        stream->setAttribute("Enabled", (stream->getIntAttribute("Number_Of_Channels") > 0) ? true : false);
-        atLeastOneStreamEnabled = (atLeastOneStreamEnabled || stream->getBoolAttribute("Enabled"));
-    }
+void DeviceThread::channelEnabledChanged(int channelID)
+{
+    channelModel.channelEnabledChanged(channelID);
+    if (isTransmitting)
+        updateFetchPlanDuringAcquisition();
+}
 
-    if (!atLeastOneStreamEnabled)
-        streamsXmlList->getChildElement(enabledChannel->getIntAttribute("Stream_ID"))->setAttribute("Enabled", true);
+void DeviceThread::streamEnabledChanged(int streamID)
+{
+    channelModel.streamEnabledChanged(streamID);
+    if (isTransmitting)
+        updateFetchPlanDuringAcquisition();
 }
 
 DeviceThread::~DeviceThread()
 {
-    if (foundInputSource())
+    cancelPendingUpdate();
+    saveChannelsCache();
+
+    if (AO::isConnected() == AO::eAO_CONNECTED)
     {
         AO::CloseConnection();
     }
@@ -300,7 +479,32 @@ DeviceThread::~DeviceThread()
 
 void DeviceThread::initialize(bool signalChainIsLoading)
 {
-    // TODO
+    // Without a saved chain the cached configuration is checked now, otherwise after it is loaded
+    if (!signalChainIsLoading)
+        triggerAsyncUpdate();
+}
+
+void DeviceThread::saveCustomParametersToXml(XmlElement *xml)
+{
+    xml->setAttribute("Depth_Poll_Hz", depthPollRateHz);
+
+    if (channelsXmlList == nullptr || streamsXmlList == nullptr)
+        return;
+
+    xml->addChildElement(createChannelsStateXml().release());
+    saveChannelsCache();
+}
+
+void DeviceThread::loadCustomParametersFromXml(XmlElement *xml)
+{
+    const XmlElement *state = xml->getChildByName("NEURO_OMEGA_CHANNELS");
+    if (state != nullptr && restoreChannelsStateXml(*state))
+        LOGC("Restored ", numberOfChannels, " channels from the signal chain");
+
+    if (xml->hasAttribute("Depth_Poll_Hz"))
+        setDepthPollRate(xml->getDoubleAttribute("Depth_Poll_Hz"));
+
+    triggerAsyncUpdate();
 }
 
 std::unique_ptr<GenericEditor> DeviceThread::createEditor(SourceNode *sn)
@@ -311,61 +515,119 @@ std::unique_ptr<GenericEditor> DeviceThread::createEditor(SourceNode *sn)
 
 void DeviceThread::handleBroadcastMessage(String msg)
 {
-    // TODO
+    // NeuroOmega:Latency answers with the histograms as NeuroOmega:LatencyReport:<json>, NeuroOmega:LatencyDump:<path> writes them to a file
+    // NeuroOmega:DepthPollHz:<Hz> changes how often the drive depth is read, also while acquiring
+    StringArray tokens = StringArray::fromTokens(msg, ":", "");
+    if (tokens.size() < 2 || tokens[0] != "NeuroOmega")
+        return;
+
+    // The answer has its own tag, so a report delivered back to this processor is not a request
+    if (tokens[1] == "Latency" && tokens.size() == 2)
+    {
+        broadcastMessage("NeuroOmega:LatencyReport:" + JSON::toString(getLatencyReport(), true));
+    }
+    else if (tokens[1] == "LatencyDump" && tokens.size() > 2)
+    {
+        // Windows paths contain a colon after the drive letter
+        File dumpFile(msg.fromFirstOccurrenceOf("LatencyDump:", false, false));
+        if (!dumpFile.replaceWithText(JSON::toString(getLatencyReport())))
+            LOGE("Could not write latency histograms to ", dumpFile.getFullPathName());
+    }
+    else if (tokens[1] == "LatencyReset")
+    {
+        for (const StreamPlan &stream : engine.getPlan().streams)
+            engine.getLatency(stream.sourceBufferIdx).reset();
+    }
+    else if (tokens[1] == "DepthPollHz" && tokens.size() == 3 && tokens[2].getDoubleValue() > 0)
+    {
+        setDepthPollRate(tokens[2].getDoubleValue());
+        LOGC("Drive depth read ", depthPollRateHz, " times a second");
+    }
 }
 
-void DeviceThread::queryUserStartConnection()
+void DeviceThread::timerCallback()
 {
-    auto *connectAW = new AlertWindow(TRANS("Neuro Omega: start connection"),
-                                      TRANS("Enter the system MAC adress"),
-                                      AlertWindow::NoIcon, nullptr);
+    broadcastDepthChanges();
+
+    const CountersSnapshot counters = engine.getCountersSnapshot();
+    if (counters.snapshotNs == previousCounters.snapshotNs)
+        return;
 
-    connectAW->addTextEditor("System MAC", String("AA:BB:CC:DD:EE:FF"), String(), false);
-    connectAW->addButton(TRANS("Connect"), 1, KeyPress(KeyPress::returnKey));
-    connectAW->addButton(TRANS("Cancel"), 0, KeyPress(KeyPress::escapeKey));
+    const double intervalSeconds = (counters.snapshotNs - previousCounters.snapshotNs) / 1e9;
+    const StringArray &streamNames = getPlanStreamNames();
 
-    if (connectAW->runModalLoop())
+    Array<var> streamSnapshots;
+    for (const StreamPlan &stream : engine.getPlan().streams)
     {
-        MouseCursor::showWaitCursor();
-        AO::MAC_ADDR sysMAC = {0};
-        sscanf(connectAW->getTextEditorContents("System MAC").toStdString().c_str(), "%x:%x:%x:%x:%x:%x",
-               &sysMAC.addr[0], &sysMAC.addr[1], &sysMAC.addr[2], &sysMAC.addr[3], &sysMAC.addr[4], &sysMAC.addr[5]);
-        AO::DefaultStartConnection(&sysMAC, 0);
-        waitForConnection();
-        MouseCursor::hideWaitCursor();
-    }
-    connectAW->setVisible(false);
+        if (stream.sourceBufferIdx >= counters.numberOfStreams)
+            continue;
 
-    auto *retryAW = new AlertWindow(TRANS("Neuro Omega"),
-                                    TRANS((foundInputSource()) ? "Connected!" : ("Unable to connect\n" + getLastAOSDKError())),
-                                    AlertWindow::NoIcon, nullptr);
+        const StreamCountersValues &values = counters.streams[stream.sourceBufferIdx];
+        const int64 previousSamples = previousCounters.streams[stream.sourceBufferIdx].samples;
+
+        DynamicObject::Ptr snapshot = new DynamicObject();
+        snapshot->setProperty("name", streamNames[stream.sourceBufferIdx]);
+        snapshot->setProperty("streamID", stream.streamID);
+        snapshot->setProperty("channels", stream.numberOfChannels);
+        snapshot->setProperty("samplesPerSecond", intervalSeconds > 0 ? (values.samples - previousSamples) / intervalSeconds : 0.0);
+        snapshot->setProperty("samples", (int64)values.samples);
+        snapshot->setProperty("blocks", (int64)values.blocks);
+        snapshot->setProperty("emptyPolls", (int64)values.emptyPolls);
+        snapshot->setProperty("sdkErrors", (int64)values.sdkErrors);
+        snapshot->setProperty("gaps", (int64)values.gaps);
+        snapshot->setProperty("overruns", (int64)values.overruns);
+        snapshot->setProperty("overlaps", (int64)values.overlaps);
+        snapshot->setProperty("lostSamples", (int64)values.lostSamples);
+        snapshot->setProperty("bufferFill", values.bufferFill / (double)SOURCE_BUFFER_SIZE);
+        snapshot->setProperty("maxBufferFill", values.maxBufferFill / (double)SOURCE_BUFFER_SIZE);
+        streamSnapshots.add(var(snapshot.get()));
+
+        reportDiscontinuities(stream, values, previousCounters.streams[stream.sourceBufferIdx]);
+    }
+    previousCounters = counters;
 
-    if (!foundInputSource())
-        retryAW->addButton(TRANS("Retry"), 1, KeyPress(KeyPress::returnKey));
-    retryAW->addButton(TRANS("OK"), 0, KeyPress(KeyPress::escapeKey));
+    DynamicObject::Ptr snapshot = new DynamicObject();
+    snapshot->setProperty("streams", streamSnapshots);
+    countersSnapshot = var(snapshot.get());
 
-    bool retry = retryAW->runModalLoop();
-    retryAW->setVisible(false);
-    if (retry)
-        queryUserStartConnection();
+    broadcastMessage("NeuroOmega:Counters:" + JSON::toString(countersSnapshot, true));
 }
 
-String DeviceThread::getLastAOSDKError()
+void DeviceThread::reportDiscontinuities(const StreamPlan &stream, const StreamCountersValues &values, const StreamCountersValues &previous)
 {
-    char sError[1000] = {0};
-    int nErrorCount = 0;
-    AO::ErrorHandlingfunc(&nErrorCount, sError, 1000);
-    return String(sError);
+    // Once per snapshot at most, however many blocks of the stream were discontinuous since the last one
+    const int64 gaps = values.gaps - previous.gaps;
+    const int64 overruns = values.overruns - previous.overruns;
+    const int64 overlaps = values.overlaps - previous.overlaps;
+    const int64 lostSamples = values.lostSamples - previous.lostSamples;
+
+    if (overlaps > 0)
+        LOGE("Stream ", stream.streamID, ": ", overlaps, " blocks overlapped the previous one, the latest at sample ", (int64)values.lastDiscontinuitySample);
+
+    if (gaps + overruns == 0)
+        return;
+
+    LOGE("Stream ", stream.streamID, ": ", gaps, " gaps and ", overruns, " overruns, ", lostSamples, " samples lost, the latest at sample ", (int64)values.lastDiscontinuitySample);
+    broadcastMessage(String("NeuroOmega:") + (overruns > 0 ? "Overrun:" : "Gap:") + String(stream.streamID) + ":" +
+                     String((int64)values.lastDiscontinuitySample) + ":" + String(lostSamples));
 }
 
-void DeviceThread::waitForConnection()
+var DeviceThread::getLatencyReport()
 {
-    for (int i = 0; i < 10; i++)
+    const StringArray &streamNames = getPlanStreamNames();
+
+    Array<var> streamReports;
+    for (const StreamPlan &stream : engine.getPlan().streams)
     {
-        Thread::sleep(1000);
-        if (foundInputSource())
-            return;
+        var streamReport = toVar(engine.getLatency(stream.sourceBufferIdx));
+        streamReport.getDynamicObject()->setProperty("name", streamNames[stream.sourceBufferIdx]);
+        streamReport.getDynamicObject()->setProperty("streamID", stream.streamID);
+        streamReports.add(streamReport);
     }
+
+    DynamicObject::Ptr report = new DynamicObject();
+    report->setProperty("streams", streamReports);
+    return var(report.get());
 }
 
 void DeviceThread::updateSettings(OwnedArray<ContinuousChannel> *continuousChannels,
@@ -375,7 +637,8 @@ void DeviceThread::updateSettings(OwnedArray<ContinuousChannel> *continuousChann
                                   OwnedArray<DeviceInfo> *devices,
                                   OwnedArray<ConfigurationObject> *configurationObjects)
 {
-    if (!foundInputSource())
+    // A restored configuration shows before the device is connected
+    if (channelsXmlList == nullptr || streamsXmlList == nullptr)
         return;
 
     continuousChannels->clear();
@@ -385,85 +648,101 @@ void DeviceThread::updateSettings(OwnedArray<ContinuousChannel> *continuousChann
     devices->clear();
     configurationObjects->clear();
     sourceBuffers.clear();
-    sourceBuffersSampleCount.clear();
-
-    bool streamEnabled, channelEnabled;
-    int streamID = -1, thisChannelStreamID = -1;
-    DataStream *stream;
 
-    for (int ch = 0; ch < numberOfChannels; ch++)
+    for (int streamID = 0; streamID < channelModel.getNumberOfStreams(); streamID++)
     {
-        thisChannelStreamID = channelsXmlList->getChildElement(ch)->getIntAttribute("Stream_ID");
-        streamEnabled = streamsXmlList->getChildElement(thisChannelStreamID)->getBoolAttribute("Enabled");
-        channelEnabled = channelsXmlList->getChildElement(ch)->getBoolAttribute("Enabled");
-        if (!(streamEnabled && channelEnabled))
+        if (!channelModel.isStreamActive(streamID))
             continue;
-        if (streamID != thisChannelStreamID)
+
+        DataStream::Settings dataStreamSettings = getStreamSettingsFromID(streamID);
+        DataStream *stream = new DataStream(dataStreamSettings);
+        sourceStreams->add(stream);
+        sourceBuffers.add(new DataBuffer((int)channelModel.getEnabledChannelIDs(streamID).size(), SOURCE_BUFFER_SIZE));
+
+        // SourceNode turns the event codes of each buffer into TTL events on the channel of its stream
+        EventChannel::Settings eventSettings{
+            EventChannel::Type::TTL,
+            "Neuro Omega TTL Input",
+            "Digital input lines 1 to " + String(DIGITAL_INPUT_LINES) + " of a Neuro Omega device, line " + String(DEPTH_EVENT_LINE + 1) + " marks drive depth changes",
+            "neuro-omega-device.events",
+            stream,
+            DEPTH_EVENT_LINE + 1};
+        eventChannels->add(new EventChannel(eventSettings));
+
+        float bitVolts = channelModel.getStream(streamID)->getDoubleAttribute("Bit_Resolution");
+        for (const XmlElement *channel : channelModel.getChannels(streamID))
         {
-            streamID = thisChannelStreamID;
-            DataStream::Settings dataStreamSettings = getStreamSettingsFromID(streamID);
-            stream = new DataStream(dataStreamSettings);
-            sourceStreams->add(stream);
-            sourceBuffers.add(new DataBuffer(streamsXmlList->getChildElement(streamID)->getIntAttribute("Number_Of_Channels"), SOURCE_BUFFER_SIZE));
-            sourceBuffersSampleCount.add(0);
+            if (!channel->getBoolAttribute("Enabled"))
+                continue;
+            ContinuousChannel::Settings channelSettings{
+                ContinuousChannel::ELECTRODE,
+                channel->getStringAttribute("Channel_Name"),
+                "description",
+                "neuro-omega-device.continuous.headstage",
+                bitVolts,
+                stream};
+            continuousChannels->add(new ContinuousChannel(channelSettings));
+            continuousChannels->getLast()->setUnits("uV");
         }
-        String channelName = channelsXmlList->getChildElement(ch)->getStringAttribute("Channel_Name");
-        float bitVolts = streamsXmlList->getChildElement(streamID)->getDoubleAttribute("Bit_Resolution");
-        ContinuousChannel::Settings channelSettings{
-            ContinuousChannel::ELECTRODE,
-            channelName,
-            "description",
-            "neuro-omega-device.continuous.headstage",
-            bitVolts,
-            stream};
-        continuousChannels->add(new ContinuousChannel(channelSettings));
-        continuousChannels->getLast()->setUnits("uV");
-    }
-
-    // Add an event channel.
-    // This is not used currently but RecordNode.cpp (line 447) calls eventChannels.getLast() and app crashes
-    // TODO: Fix and send PR
-    EventChannel::Settings settings{
-        EventChannel::Type::TTL,
-        "Neuro Omega TTL Input",
-        "Events on digital input lines of a Neuro Omega device",
-        "neuro-omega-device.events",
-        stream,
-        8};
-
-    eventChannels->add(new EventChannel(settings));
+    }
 }
 
 DataStream::Settings DeviceThread::getStreamSettingsFromID(int streamID)
 {
+    const XmlElement *stream = channelModel.getStream(streamID);
     DataStream::Settings dataStreamSettings{
-        streamsXmlList->getChildElement(streamID)->getStringAttribute("Stream_Name"),
+        stream->getStringAttribute("Stream_Name"),
         "description",
         "neuro-omega-device.data",
-        float(streamsXmlList->getChildElement(streamID)->getDoubleAttribute("Sampling_Rate"))};
+        float(stream->getDoubleAttribute("Sampling_Rate"))};
     return dataStreamSettings;
 }
 
 bool DeviceThread::foundInputSource()
 {
-    return ((AO::isConnected() == AO::eAO_CONNECTED) || TEST_MODE_ON);
+    return sampleSource->isConnected();
 }
 
 bool DeviceThread::startAcquisition()
 {
-    // Neuro Omega Buffer
-    deviceDataArraySize = 10000;
-    streamDataArray = new AO::int16[deviceDataArraySize];
+    AcquisitionPlan plan = compileAcquisitionPlan();
+    std::unique_ptr<FetchPlan> firstFetchPlan = compileFetchPlan(plan);
+    const int numberOfStreams = (int)plan.streams.size();
 
-    for (int i = 0; i < numberOfChannels; i++)
+    LOGC("AddBufferChannel(", (int)plan.channelIDs.size(), " channels", digitalInputIDs.size() > 0 ? " and digital input " + String(digitalInputIDs[0]) : String(), ", ", (int)AcquisitionEngine::AO_BUFFER_SIZE_MS, ")");
+    engine.start(*sampleSource, std::move(plan), std::move(firstFetchPlan), digitalInputIDs.size() > 0 ? digitalInputIDs[0] : -1);
+
+    streamDepthChanges.clearQuick();
+    streamDepthChanges.insertMultiple(0, 0, numberOfStreams);
+    droppedDepthChangeMarks = 0;
+
+    // Samples/s of the first snapshot are measured from the start, the data thread is not running yet
+    previousCounters = engine.getCountersSnapshot();
+    countersSnapshot = var();
+    startTimer(AcquisitionEngine::COUNTERS_SNAPSHOT_INTERVAL_MS / 4);
+
+    String acquisitionModeName = getAcquisitionModeName(engine.getMode());
+    LOGC("Acquisition mode: ", acquisitionModeName);
+
+    if (benchmark != nullptr)
     {
-        if (channelsXmlList->getChildElement(i)->getBoolAttribute("Enabled"))
+        Array<int> numberOfChannelsInStreams;
+        Array<double> samplingRates;
+        for (const StreamPlan &stream : engine.getPlan().streams)
         {
-            LOGC("AO::AddBufferChannel(", channelsXmlList->getChildElement(i)->getIntAttribute("ID"), ", ", AO_BUFFER_SIZE_MS, ")");
-            AO::AddBufferChannel(channelsXmlList->getChildElement(i)->getIntAttribute("ID"), AO_BUFFER_SIZE_MS);
+            numberOfChannelsInStreams.add(stream.numberOfChannels);
+            samplingRates.add(stream.samplingRate);
         }
+        benchmark->start(acquisitionModeName, getPlanStreamNames(), numberOfChannelsInStreams, samplingRates);
     }
-    AO::ClearBuffers();
+
+    if (captureDirectory != File())
+        startRawCapture();
+
+    depthPoller = std::make_unique<DepthPoller>(*sampleSource, depthPollRateHz);
+    depthPoller->onDepthChanged = [this](const DepthReading &reading)
+    { broadcastDistanceToTarget(reading); };
+    depthPoller->startThread();
 
     startThread();
 
@@ -479,139 +758,362 @@ bool DeviceThread::stopAcquisition()
         signalThreadShouldExit();
     }
 
+    // Everything below is torn down under the data thread, it must be gone first
+    if (!waitForThreadToExit(1000))
+        LOGE("Data thread did not stop within 1 s");
+
+    stopTimer();
+    broadcastDepthChanges();
+    if (droppedDepthChangeMarks > 0)
+        LOGE(droppedDepthChangeMarks, " depth changes were marked but not broadcast, the message thread fell behind");
+
+    engine.stop();
+    for (const StreamPlan &stream : engine.getPlan().streams)
+    {
+        const StreamReader *reader = engine.getReader(stream.sourceBufferIdx);
+        if (reader == nullptr)
+            continue;
+        if (benchmark != nullptr)
+            benchmark->addThreadCpu(reader->getCpuTimeNs());
+        if (reader->getRingFullStalls() > 0)
+            LOGC("Stream ", stream.streamID, " reader waited ", (int64)reader->getRingFullStalls(), " times for the data thread");
+    }
+
+    if (depthPoller != nullptr)
+    {
+        depthPoller->stopThread(1000);
+        if (benchmark != nullptr)
+            benchmark->addThreadCpu(depthPoller->getCpuTimeNs());
+        if (depthPoller->getFailedReads() > 0)
+            LOGC("Drive depth unavailable ", depthPoller->getFailedReads(), " times");
+        depthPoller.reset();
+    }
+
+    if (benchmark != nullptr)
+        benchmark->stop();
+
+    if (streamCaptures.size() > 0)
+        stopRawCapture();
+
+    const PollWaitStrategy &pollWaitStrategy = engine.getPollWaitStrategy();
+    for (const StreamPlan &stream : engine.getPlan().streams)
+    {
+        const LatencyHistogram &lateness = pollWaitStrategy.getWakeUpLateness(stream.sourceBufferIdx);
+        LOGC(getPlanStreamNames()[stream.sourceBufferIdx], ": ", (int64)pollWaitStrategy.getEmptyPolls(stream.sourceBufferIdx), " empty polls, ",
+             (int64)lateness.getCount(), " sleeps, wake-up lateness p50 ", (int64)lateness.getPercentile(0.5) / 1000,
+             " us, p99 ", (int64)lateness.getPercentile(0.99) / 1000, " us");
+    }
+
+    if (const DigitalInputs *digitalInputs = engine.getDigitalInputs())
+    {
+        LOGC("Digital input ", digitalInputs->getPortChannelID(), ": ", (int64)digitalInputs->getNumberOfChanges(), " changes, ",
+             (int64)digitalInputs->getLateChanges(), " placed late, ", (int64)digitalInputs->getLostChanges(), " lost, ",
+             (int64)digitalInputs->getSdkErrors(), " SDK errors");
+    }
+
+    for (const StreamPlan &stream : engine.getPlan().streams)
+    {
+        const DeviceClockModel &clock = engine.getClock(stream.sourceBufferIdx);
+        LOGC("Stream ", stream.streamID, " device clock drift ", String(clock.getDriftPpm(), 2), " ppm, ", String(clock.getTicksPerSample(), 4), " ticks per sample");
+
+        const StreamCounters &counters = engine.getCounters(stream.sourceBufferIdx);
+        if (counters.gaps + counters.overruns + counters.overlaps + counters.sdkErrors > 0)
+            LOGC("Stream ", stream.streamID, ": ", (int64)counters.gaps.load(), " gaps, ", (int64)counters.overruns.load(), " overruns, ",
+                 (int64)counters.overlaps.load(), " overlaps, ", (int64)counters.lostSamples.load(), " samples lost, ",
+                 (int64)counters.sdkErrors.load(), " SDK errors");
+    }
+
     clearSourceBuffers();
 
     isTransmitting = false;
 
+    // The signal chain keeps the channels of the start until acquisition stops
+    if (updateSettingsDuringAcquisition)
+    {
+        updateSettingsDuringAcquisition = false;
+        triggerAsyncUpdate();
+    }
+
     return true;
 }
 
-void DeviceThread::clearSourceBuffers()
+void DeviceThread::startRawCapture()
 {
-    int sourceBufferIdx = 0;
-    for (int i = 0; i < numberOfStreams; i++)
+    streamCaptures.clear();
+    captureGrower = std::make_unique<RawCaptureGrower>();
+
+    File folder = captureDirectory.getNonexistentChildFile("Neuro Omega " + Time::getCurrentTime().formatted("%Y-%m-%d_%H-%M-%S"), "");
+    if (!folder.createDirectory())
     {
-        if (streamsXmlList->getChildElement(i)->getBoolAttribute("Enabled"))
-        {
-            sourceBuffersSampleCount.set(sourceBufferIdx, 0);
-            sourceBuffers[sourceBufferIdx]->clear();
-            sourceBufferIdx++;
-        }
+        LOGE("Unable to create raw capture folder ", folder.getFullPathName());
+        return;
+    }
+
+    // "<stream> <channel>" parses back to the same stream and channel names when the capture is replayed
+    HashMap<int, String> channelNamesByID;
+    for (auto *channel : channelsXmlList->getChildIterator())
+    {
+        channelNamesByID.set(channel->getIntAttribute("ID"), channel->getStringAttribute("Channel_Name"));
+    }
+
+    const StringArray &streamNames = getPlanStreamNames();
+    for (const StreamPlan &stream : engine.getPlan().streams)
+    {
+        const String &streamName = streamNames[stream.sourceBufferIdx];
+        StringArray channelNames;
+        for (int ch = 0; ch < stream.numberOfChannels; ch++)
+            channelNames.add(streamName + " " + channelNamesByID[stream.channelIDs[ch]]);
+        streamCaptures.add(new RawCaptureWriter(*captureGrower, folder.getChildFile(File::createLegalFileName(streamName) + ".aoraw"), stream, streamName, channelNames));
     }
+    captureGrower->startThread();
+    LOGC("Capturing raw samples to ", folder.getFullPathName());
 }
 
-bool DeviceThread::updateBuffer()
+void DeviceThread::stopRawCapture()
 {
-    if (TEST_MODE_ON)
+    // The writers unmap and trim their files once nothing grows them
+    captureGrower.reset();
+
+    for (const RawCaptureWriter *capture : streamCaptures)
     {
-        deviceTimeStamp = std::time(0);
-        Thread::sleep(TEST_SLEEP_TIME_MS);
+        LOGC("Raw capture ", capture->getFile().getFileName(), ": ", capture->getBytesWritten(), " bytes");
+        if (capture->getDroppedBlocks() > 0)
+            LOGE("Raw capture ", capture->getFile().getFileName(), " dropped ", capture->getDroppedBlocks(), " blocks it had no room for");
     }
+    streamCaptures.clear();
+}
+
+AcquisitionPlan DeviceThread::compileAcquisitionPlan()
+{
+    AcquisitionPlan acquisitionPlan;
+    planStreamNames.clear();
 
-    int numberOfSamplesPerChannel;
-    int numberOfSamplesFromDevice;
     int sourceBufferIdx = 0;
-    int sourceBufferDataIdx;
-    float bitVolts;
 
-    for (int streamID = 0; streamID < numberOfStreams; streamID++)
+    for (int streamID = 0; streamID < channelModel.getNumberOfStreams(); streamID++)
     {
-        if (!streamsXmlList->getChildElement(streamID)->getBoolAttribute("Enabled"))
+        if (!channelModel.isStreamActive(streamID))
             continue;
 
-        numberOfChannelsInStream = streamsXmlList->getChildElement(streamID)->getIntAttribute("Number_Of_Channels");
-        bitVolts = streamsXmlList->getChildElement(streamID)->getDoubleAttribute("Bit_Resolution");
+        const XmlElement *stream = channelModel.getStream(streamID);
+        const std::vector<int> &channelIDs = channelModel.getEnabledChannelIDs(streamID);
+
+        StreamPlan streamPlan;
+        streamPlan.streamID = streamID;
+        streamPlan.sourceBufferIdx = sourceBufferIdx++;
+        streamPlan.numberOfChannels = (int)channelIDs.size();
+        streamPlan.bitVolts = stream->getDoubleAttribute("Bit_Resolution");
+        streamPlan.samplingRate = stream->getDoubleAttribute("Sampling_Rate");
+        streamPlan.channelIDs = nullptr;
+        acquisitionPlan.streams.push_back(streamPlan);
+        planStreamNames.add(stream->getStringAttribute("Stream_Name"));
+        acquisitionPlan.channelIDs.insert(acquisitionPlan.channelIDs.end(), channelIDs.begin(), channelIDs.end());
+    }
 
-        if (TEST_MODE_ON)
-            numberOfSamplesFromDevice = updateStreamDataArrayFromTestDataAndGetNumberOfSamples(streamID);
-        else
-            numberOfSamplesFromDevice = updateStreamDataArrayFromAOAndGetNumberOfSamples(streamID);
+    // Channel IDs are only resolved once the backing array stops growing
+    int *channelIDsArray = acquisitionPlan.channelIDs.data();
+    for (StreamPlan &streamPlan : acquisitionPlan.streams)
+    {
+        streamPlan.channelIDs = channelIDsArray;
+        channelIDsArray += streamPlan.numberOfChannels;
+    }
+    return acquisitionPlan;
+}
 
-        numberOfSamplesPerChannel = numberOfSamplesFromDevice / numberOfChannelsInStream;
+std::unique_ptr<FetchPlan> DeviceThread::compileFetchPlan(const AcquisitionPlan &acquisitionPlan) const
+{
+    std::unique_ptr<FetchPlan> plan = std::make_unique<FetchPlan>();
 
-        sourceBufferData = new float[numberOfSamplesFromDevice];
-        sampleCount = new int64[numberOfSamplesPerChannel];
-        timeStamps = new double[numberOfSamplesPerChannel];
-        eventCodes = new uint64[numberOfSamplesPerChannel];
+    for (const StreamPlan &stream : acquisitionPlan.streams)
+    {
+        SortedSet<int> enabledChannelIDs;
+        if (channelModel.isStreamActive(stream.streamID))
+        {
+            for (int channelID : channelModel.getEnabledChannelIDs(stream.streamID))
+                enabledChannelIDs.add(channelID);
+        }
 
-        sourceBufferDataIdx = 0;
-        for (int samp = 0; samp < numberOfSamplesPerChannel; samp++)
+        StreamFetch fetch;
+        for (int ch = 0; ch < stream.numberOfChannels; ch++)
         {
-            sampleCount[samp] = sourceBuffersSampleCount[sourceBufferIdx] + samp;
-            timeStamps[samp] = float(deviceTimeStamp) + samp / streamsXmlList->getChildElement(streamID)->getDoubleAttribute("Sampling_Rate");
-            eventCodes[samp] = 1;
-            for (int chan = 0; chan < numberOfChannelsInStream; chan++)
+            if (enabledChannelIDs.contains(stream.channelIDs[ch]))
             {
-                sourceBufferData[sourceBufferDataIdx++] = streamDataArray[(chan * numberOfSamplesPerChannel) + samp] * bitVolts;
+                fetch.channelIDs.push_back(stream.channelIDs[ch]);
+                fetch.rows.push_back(ch);
             }
         }
 
-        sourceBuffersSampleCount.set(sourceBufferIdx, sampleCount[numberOfSamplesPerChannel - 1] + 1);
-        sourceBuffers[sourceBufferIdx]->addToBuffer(sourceBufferData,
-                                                    sampleCount,
-                                                    timeStamps,
-                                                    eventCodes,
-                                                    numberOfSamplesPerChannel,
-                                                    1);
-        sourceBufferIdx++;
+        // A stream without selected channels keeps reading one, its sample numbers and timestamps stay continuous
+        if (fetch.channelIDs.empty())
+        {
+            fetch.channelIDs.push_back(stream.channelIDs[0]);
+            fetch.rows.push_back(-1);
+        }
+        // Only a block holding every plan channel in plan order can skip expanding
+        fetch.complete = (fetch.getNumberOfChannels() == stream.numberOfChannels);
+        for (int ch = 0; ch < fetch.getNumberOfChannels() && fetch.complete; ch++)
+            fetch.complete = (fetch.rows[ch] == ch);
+        plan->streams.push_back(fetch);
     }
-
-    queryDistanceToTarget();
-
-    return true;
+    return plan;
 }
 
-void DeviceThread::queryDistanceToTarget()
+void DeviceThread::updateFetchPlanDuringAcquisition()
 {
-    bool broadcast;
-    if (TEST_MODE_ON)
+    updateSettingsDuringAcquisition = true;
+
+    std::unique_ptr<FetchPlan> plan = compileFetchPlan(engine.getPlan());
+    if (plan->streams == engine.getFetchPlan()->streams)
+        return;
+
+    // Every channel of the plan has been buffered since the start, the SDK keeps buffering the deselected ones
+    int numberOfChannels = 0, numberOfRecordedChannels = 0;
+    for (const StreamFetch &stream : plan->streams)
     {
-        dtt = 100 * ((float)rand()) / (float)RAND_MAX;
-        broadcast = (dtt < 0.1);
+        numberOfChannels += (int)stream.rows.size();
+        numberOfRecordedChannels += (int)std::count_if(stream.rows.begin(), stream.rows.end(), [](int row)
+                                                       { return row >= 0; });
     }
-    else
+    engine.publishFetchPlan(std::move(plan));
+
+    int numberOfSelectedChannels = 0;
+    for (int streamID = 0; streamID < channelModel.getNumberOfStreams(); streamID++)
     {
-        AO::int32 nDepthUm = 0;
-        AO::EAOResult eAORes = (AO::EAOResult)AO::GetDriveDepth(&nDepthUm);
-        if (eAORes == AO::eAO_OK)
-            dtt = DRIVE_ZERO_POSITION_MILIM - nDepthUm / 1000.0;
-        broadcast = (eAORes == AO::eAO_OK) && (dtt != previous_dtt);
+        if (channelModel.isStreamActive(streamID))
+            numberOfSelectedChannels += (int)channelModel.getEnabledChannelIDs(streamID).size();
     }
+    LOGC("Reading ", numberOfRecordedChannels, " of ", (int)engine.getPlan().channelIDs.size(), " channels, ",
+         numberOfChannels - numberOfRecordedChannels, " only to keep their streams running, ",
+         numberOfSelectedChannels - numberOfRecordedChannels, " selected from the next acquisition");
+}
 
-    if (broadcast)
-        broadcastMessage("MicroDrive:DistanceToTarget:" + std::to_string(dtt));
+const StringArray &DeviceThread::getPlanStreamNames() const
+{
+    return planStreamNames;
+}
 
-    previous_dtt = dtt;
+void DeviceThread::setPollWaitMode(PollWaitMode mode)
+{
+    engine.getPollWaitStrategy().setMode(mode);
 }
 
-int DeviceThread::updateStreamDataArrayFromAOAndGetNumberOfSamples(int streamID)
+PollWaitMode DeviceThread::getPollWaitMode() const
 {
-    int *arrChannel = getChannelIDsArrayFromStreamID(streamID);
-    int status = AO::eAO_MEM_EMPTY;
-    int numberOfSamplesFromDevice = 0;
-    while (status == AO::eAO_MEM_EMPTY || numberOfSamplesFromDevice == 0)
-        status = AO::GetAlignedData(streamDataArray, deviceDataArraySize, &numberOfSamplesFromDevice, arrChannel, numberOfChannelsInStream, &deviceTimeStamp);
-    return numberOfSamplesFromDevice;
+    return engine.getPollWaitStrategy().getMode();
 }
 
-int *DeviceThread::getChannelIDsArrayFromStreamID(int streamID)
+void DeviceThread::setAcquisitionMode(AcquisitionMode mode)
 {
-    int *arrChannel = new int[streamsXmlList->getChildElement(streamID)->getIntAttribute("Number_Of_Channels")];
-    StringArray channelIDs;
-    channelIDs.addTokens(streamsXmlList->getChildElement(streamID)->getStringAttribute("Channel_IDs"), ",", "\"");
-    for (int ch = 0; ch < channelIDs.size(); ch++)
-        arrChannel[ch] = channelIDs[ch].getIntValue();
-    return arrChannel;
+    jassert(!isThreadRunning());
+    engine.setMode(mode);
 }
 
-int DeviceThread::updateStreamDataArrayFromTestDataAndGetNumberOfSamples(int streamID)
+AcquisitionMode DeviceThread::getAcquisitionMode() const
 {
-    int numberOfSamplesPerChannel = TEST_SLEEP_TIME_MS / 1000.0 * streamsXmlList->getChildElement(streamID)->getDoubleAttribute("Sampling_Rate");
-    int numberOfSamplesFromDevice = numberOfSamplesPerChannel * numberOfChannelsInStream;
-    for (int samp = 0; samp < numberOfSamplesPerChannel; samp++)
-    {
-        for (int chan = 0; chan < numberOfChannelsInStream; chan++)
-            streamDataArray[(chan * numberOfSamplesPerChannel) + samp] = pow(-1, streamID) * samp * (chan + 1);
-    }
-    return numberOfSamplesFromDevice;
-}
\ No newline at end of file
+    return engine.getMode();
+}
+
+void DeviceThread::clearSourceBuffers()
+{
+    for (const StreamPlan &stream : engine.getPlan().streams)
+        sourceBuffers[stream.sourceBufferIdx]->clear();
+}
+
+bool DeviceThread::updateBuffer()
+{
+    const int64 numberOfScratchAllocations = StreamScratch::getNumAllocations();
+    const int64 numberOfAllocations = AllocationCounter::getThreadAllocations();
+
+    engine.readBlocks();
+
+    if (benchmark != nullptr)
+        benchmark->recordThreadCpu();
+
+    // The scratch arenas are sized in startAcquisition, only a truncated fetch may grow them
+    jassert(engine.hasGrownFetchBuffer() || StreamScratch::getNumAllocations() == numberOfScratchAllocations);
+    // Nothing else allocates
+    jassert(engine.hasGrownFetchBuffer() || AllocationCounter::getThreadAllocations() == numberOfAllocations);
+
+    return true;
+}
+
+bool DeviceThread::shouldStop()
+{
+    return threadShouldExit();
+}
+
+void DeviceThread::blockFetched(const StreamPlan &stream, const StreamFetch &fetch, uint32_t deviceTimeStamp, int64_t firstSampleNumber,
+                                const int16_t *data, int numberOfSamplesPerChannel)
+{
+    if (streamCaptures.size() > 0)
+        streamCaptures.getUnchecked(stream.sourceBufferIdx)->writeBlock(fetch, deviceTimeStamp, firstSampleNumber, data, numberOfSamplesPerChannel);
+}
+
+int DeviceThread::addBlock(const StreamPlan &stream, StreamScratch &scratch, int64_t firstSampleNumber,
+                           int numberOfSamplesPerChannel, int64_t blockStartNs)
+{
+    if (depthPoller != nullptr && numberOfSamplesPerChannel > 0)
+        markDepthChange(stream, scratch, firstSampleNumber, numberOfSamplesPerChannel);
+
+    // juce::int64 is long long, int64_t is long on some platforms, both are 64 bits
+    static_assert(sizeof(int64) == sizeof(int64_t) && sizeof(uint64) == sizeof(uint64_t), "sample numbers and event codes are 64 bits");
+    DataBuffer *sourceBuffer = sourceBuffers[stream.sourceBufferIdx];
+    sourceBuffer->addToBuffer(scratch.sourceBufferData.get(),
+                              reinterpret_cast<int64 *>(scratch.sampleCount.get()),
+                              scratch.timeStamps.get(),
+                              reinterpret_cast<uint64 *>(scratch.eventCodes.get()),
+                              numberOfSamplesPerChannel,
+                              1);
+
+    if (benchmark != nullptr)
+        benchmark->recordBlock(stream.sourceBufferIdx, numberOfSamplesPerChannel, blockStartNs, getTimeNs() - blockStartNs);
+
+    return sourceBuffer->getNumSamples();
+}
+
+void DeviceThread::fetchBufferGrown(const StreamPlan &stream, int samplesPerChannel)
+{
+    LOGC("Stream ", stream.streamID, " fetch buffer grown to ", samplesPerChannel, " samples per channel");
+}
+
+void DeviceThread::markDepthChange(const StreamPlan &stream, StreamScratch &scratch, int64 firstSampleCount, int numberOfSamplesPerChannel)
+{
+    const DepthReading reading = depthPoller->getLatest();
+    if (reading.changes == streamDepthChanges[stream.sourceBufferIdx])
+        return;
+
+    // The change belongs to the first sample taken after the depth was read, a later block if this one ends before
+    const double changeSeconds = (reading.readNs - engine.getStartNs()) / 1e9;
+    if (changeSeconds > scratch.timeStamps[numberOfSamplesPerChannel - 1])
+        return;
+
+    const int samp = (int)(std::lower_bound(scratch.timeStamps.get(), scratch.timeStamps.get() + numberOfSamplesPerChannel, changeSeconds) - scratch.timeStamps.get());
+    scratch.eventCodes[samp] |= (uint64_t)1 << DEPTH_EVENT_LINE;
+    streamDepthChanges.set(stream.sourceBufferIdx, reading.changes);
+
+    // Broadcasting allocates, the message thread does it
+    const DepthChangeMark mark = {stream.streamID, firstSampleCount + samp, reading.depthUm};
+    if (!depthChangeMarks.push(&mark, 1))
+        droppedDepthChangeMarks++;
+}
+
+void DeviceThread::broadcastDepthChanges()
+{
+    DepthChangeMark mark;
+    while (depthChangeMarks.pop(&mark, 1))
+        broadcastMessage("MicroDrive:DepthChange:" + String(mark.streamID) + ":" + String(mark.sampleNumber) + ":" + String(mark.depthUm));
+}
+
+void DeviceThread::setDepthPollRate(double pollRateHz)
+{
+    depthPollRateHz = DepthPoller::limitPollRate(pollRateHz);
+    if (depthPoller != nullptr)
+        depthPoller->setPollRate(depthPollRateHz);
+}
+
+void DeviceThread::broadcastDistanceToTarget(const DepthReading &reading)
+{
+    // Depth poller thread, only when the depth changed
+    float distanceToTarget = DRIVE_ZERO_POSITION_MILIM - reading.depthUm / 1000.0;
+    broadcastMessage("MicroDrive:DistanceToTarget:" + std::to_string(distanceToTarget));
+}
@@ -30,6 +30,17 @@
 #include <array>
 #include <atomic>
 
+#include "AcquisitionEngine.h"
+#include "AcquisitionStats.h"
+#include "AllocationCounter.h"
+#include "ChannelModel.h"
+#include "ConfigFiles.h"
+#include "DepthPoller.h"
+#include "DeviceConnection.h"
+#include "RawCapture.h"
+#include "SampleSource.h"
+#include "SpscRing.h"
+
 // AlphaOmega SDK
 namespace AO
 {
@@ -45,7 +56,10 @@ namespace AONode
 
 		@see DataThread, SourceNode
 	*/
-	class DeviceThread : public DataThread
+	class DeviceThread : public DataThread,
+						 private AcquisitionEngine::Host,
+						 private AsyncUpdater,
+						 private Timer
 	{
 
 	public:
@@ -81,67 +95,174 @@ namespace AONode
 		/** Informs the DataThread about whether to expect saved settings to be loaded*/
 		void initialize(bool signalChainIsLoading) override;
 
+		/** Saves the channel list and selection with the signal chain */
+		void saveCustomParametersToXml(XmlElement *xml) override;
+
+		/** Restores the saved channel list and selection at once, the device is checked afterwards */
+		void loadCustomParametersFromXml(XmlElement *xml) override;
+
 		// for communication with SourceNode processors:
 		bool foundInputSource() override;
 
 		static DataThread *createDataThread(SourceNode *sn);
 
-		XmlElement *channelsXmlList = nullptr;
-		XmlElement *streamsXmlList = nullptr;
+		/** Selects how the data thread waits for the SDK to have new samples */
+		void setPollWaitMode(PollWaitMode mode);
+		PollWaitMode getPollWaitMode() const;
+
+		/** Selects how updateBuffer orders stream reads, only while not acquiring */
+		void setAcquisitionMode(AcquisitionMode mode);
+		AcquisitionMode getAcquisitionMode() const;
+
+		/** Switches between the Neuro Omega and the synthetic source, only while not acquiring */
+		void setSampleSourceType(SampleSourceType type);
+		SampleSourceType getSampleSourceType() const;
+
+		/** Folder of the raw capture the replay source plays, reopened at once if it is the current source */
+		void setReplayFolder(const File &folder);
+		const File &getReplayFolder() const { return replayFolder; }
+
+		/** Connects to the Neuro Omega in the background, the channels are read once it is up */
+		void connectToDevice(const String &mac);
+		const DeviceConnection &getConnection() const { return *connection; }
+
+		/** Called on the message thread when the device connected or the connection was lost */
+		std::function<void()> onInputSourceChanged;
+		/** Called on the message thread right after the channel lists were replaced, before the old ones are freed */
+		std::function<void()> onChannelsXmlListsReplaced;
+
+		/** How often the microdrive depth is read during acquisition, saved with the signal chain */
+		void setDepthPollRate(double pollRateHz);
+		double getDepthPollRate() const { return depthPollRateHz; }
+
+		/**
+			Latest per-stream counters with samples/s and DataBuffer fill, refreshed about
+			once a second during acquisition and broadcast as NeuroOmega:Counters:<json>.
+			Message thread only
+		*/
+		var getCountersSnapshot() const { return countersSnapshot; }
+
+		std::unique_ptr<XmlElement> channelsXmlList;
+		std::unique_ptr<XmlElement> streamsXmlList;
 		void updateChannelsFromAOInfo();
 		void updateChannelsFromDefaults();
+		/**
+			Re-indexes the lists after they were replaced or edited as a whole.
+			While acquiring, the channels read change at once, within those the
+			acquisition started with; the rest applies when it restarts.
+		*/
 		void updateChannelsStreamsEnabled();
+		/** After the Enabled checkbox of one channel or stream was toggled, applied like updateChannelsStreamsEnabled */
+		void channelEnabledChanged(int channelID);
+		void streamEnabledChanged(int streamID);
 
 	private:
 		// Channels info
 		AO::uint32 numberOfChannels;
-		int numberOfStreams;
-
-		// Neuro Omega Buffer
-		AO::int16 *streamDataArray;
-		int deviceDataArraySize;
-		AO::ULONG deviceTimeStamp;
-		int numberOfChannelsInStream;
-
-		// Neuro Omega distance to target
-		float dtt;
-		float previous_dtt;
-
-		// Source Buffer
-		float *sourceBufferData;
-		int numItems;
-		int64 *sampleCount;
-		double *timeStamps;
-		uint64 *eventCodes;
-		int chunkSize;
-		Array<int64> sourceBuffersSampleCount;
+		/** Enabled channel IDs of each stream, kept in step with the lists */
+		ChannelModel channelModel;
+
+		/** Reads, timestamps and converts the streams, compiled into its plan in startAcquisition */
+		AcquisitionEngine engine;
+		/** Stream_Name of each stream of the plan, indexed by StreamPlan::sourceBufferIdx, copied so no thread reads the lists */
+		StringArray planStreamNames;
+
+		/** Message thread: the snapshot samples/s are measured from, and the JSON of the latest one */
+		CountersSnapshot previousCounters;
+		var countersSnapshot;
+
+		/** Where channels, samples and drive depth come from */
+		std::unique_ptr<SampleSource> sampleSource;
+		File replayFolder;
+		void createSampleSource(SampleSourceType type);
+
+		/** Reads the microdrive depth during acquisition, at depthPollRateHz */
+		std::unique_ptr<DepthPoller> depthPoller;
+		double depthPollRateHz;
+		void broadcastDistanceToTarget(const DepthReading &reading);
+		/** DepthReading::changes already marked in each stream, one per StreamPlan::sourceBufferIdx */
+		Array<uint32> streamDepthChanges;
+		void markDepthChange(const StreamPlan &stream, StreamScratch &scratch, int64 firstSampleCount, int numberOfSamplesPerChannel);
+		/** Depth changes marked by the data thread, broadcast by the message thread */
+		SpscRing<DepthChangeMark> depthChangeMarks;
+		/** Data thread: marks that did not fit in depthChangeMarks, read once it has stopped */
+		int64 droppedDepthChangeMarks = 0;
+		/** Message thread */
+		void broadcastDepthChanges();
+
+		/** Digital input ports found by updateChannelsFromAOInfo, the first one drives the TTL lines */
+		Array<int> digitalInputIDs;
+
+		/** Set when the NEUROOMEGA_BENCHMARK environment variable names a report file */
+		std::unique_ptr<AcquisitionBenchmark> benchmark;
+
+		/** Set from the NEUROOMEGA_CAPTURE environment variable, each acquisition writes its raw blocks to a new folder in it */
+		File captureDirectory;
+		/** One per StreamPlan::sourceBufferIdx while capturing */
+		OwnedArray<RawCaptureWriter> streamCaptures;
+		/** Grows the capture files ahead of the data thread */
+		std::unique_ptr<RawCaptureGrower> captureGrower;
 
 		/** True if sourceBufferData is streaming*/
 		bool isTransmitting;
 
-		/** True if change in settings is needed during acquisition*/
+		/** True if the channels changed during acquisition, the signal chain is updated once it stops */
 		bool updateSettingsDuringAcquisition;
 
-		/** Open the connection to the neuro omega*/
-		void queryUserStartConnection();
-		String getLastAOSDKError();
-		void waitForConnection();
-
-		XmlElement *parseDefaultFileByName(String name);
-		XmlElement *getStreamMatchingName(XmlElement *list, String *name);
-		XmlElement *getChannelMatchingName(XmlElement* list, String *Stream_Name, String *Channel_Name);
+		/** Connection to the Neuro Omega, made without blocking the message thread */
+		std::unique_ptr<DeviceConnection> connection;
+		void connectionStateChanged(ConnectionState state);
+
+		/**
+			Hash of the channel IDs and names the device reported when the channel
+			lists were built, 0 if they were not built from a device
+		*/
+		int64 deviceChannelsHash = 0;
+		/** Channel IDs and names as the device reports them, one "<ID>: <name>" per line */
+		String readDeviceChannelList(HeapBlock<AO::SInformation> &channelsInfo, int &numberOfAOChannels);
+		/** Reads the device channels and rebuilds the lists only if they changed, keeping the selection */
+		void probeChannels();
+		void handleAsyncUpdate() override;
+
+		/** Channel lists, selection and digital inputs, as saved with the signal chain and in the device cache */
+		std::unique_ptr<XmlElement> createChannelsStateXml();
+		bool restoreChannelsStateXml(const XmlElement &state);
+		/** The last configuration of each Neuro Omega is kept in the configs folder, by MAC address */
+		File getChannelsCacheFile() const;
+		void saveChannelsCache();
+		bool loadChannelsCache();
+
+		/** Configs folder, defaults parsed once per change of the files */
+		ConfigFiles configFiles;
+		/** Copy of a defaults list the editor can modify, nullptr if there is none */
+		std::unique_ptr<XmlElement> copyDefaultsByName(const String &name);
+		/** Takes the new lists, re-indexes them and lets the editor move its tables over */
+		void setChannelsXmlLists(std::unique_ptr<XmlElement> streams, std::unique_ptr<XmlElement> channels);
+
+		AcquisitionPlan compileAcquisitionPlan();
+		std::unique_ptr<FetchPlan> compileFetchPlan(const AcquisitionPlan &plan) const;
+		void updateFetchPlanDuringAcquisition();
+		const StringArray &getPlanStreamNames() const;
+		var getLatencyReport();
+		/** Message thread: turns a new snapshot of the engine into countersSnapshot and broadcasts it */
+		void timerCallback() override;
+		/** Message thread: logs and broadcasts the gaps, overruns and overlaps counted between two snapshots */
+		void reportDiscontinuities(const StreamPlan &stream, const StreamCountersValues &values, const StreamCountersValues &previous);
+		void startRawCapture();
+		void stopRawCapture();
+
+		// AcquisitionEngine::Host, on the data thread
+		bool shouldStop() override;
+		void blockFetched(const StreamPlan &stream, const StreamFetch &fetch, uint32_t deviceTimeStamp, int64_t firstSampleNumber,
+						  const int16_t *data, int numberOfSamplesPerChannel) override;
+		int addBlock(const StreamPlan &stream, StreamScratch &scratch, int64_t firstSampleNumber,
+					 int numberOfSamplesPerChannel, int64_t blockStartNs) override;
+		void fetchBufferGrown(const StreamPlan &stream, int samplesPerChannel) override;
 
-		int updateStreamDataArrayFromAOAndGetNumberOfSamples(int streamID);
-		int updateStreamDataArrayFromTestDataAndGetNumberOfSamples(int streamID);
 		DataStream::Settings getStreamSettingsFromID(int streamID);
-		int *getChannelIDsArrayFromStreamID(int streamID);
 		void updateSampleCountAndTimeStampsAndEventCodes(int streamID, int numberOfSamplesPerChannel);
 		void resetStreamsTotalSamplesSinceStart();
 		void clearSourceBuffers();
-		void queryDistanceToTarget();
-
-		/** Testing */
-		AO::SInformation *populateInfoWithTestData(AO::uint32 *AONumberOfChannels);
 
 		JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(DeviceThread);
 	};
@@ -0,0 +1,130 @@
+/*
+    ------------------------------------------------------------------
+
+    This file is part of the Open Ephys GUI
+    Copyright (C) 2016 Open Ephys
+
+    ------------------------------------------------------------------
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include "DigitalInputs.h"
+#include "SampleConversion.h"
+
+#include <cmath>
+
+using namespace AONode;
+
+// Words read per getAlignedData call, 50 ms of the 44 kHz port
+#define DIGITAL_FETCH_WORDS 2200
+// Changes kept for the streams, seconds of a line toggling every millisecond
+#define DIGITAL_CHANGE_RING_SIZE 8192
+// A source delivering faster than real time never runs empty, poll() returns after this many reads
+#define MAX_DIGITAL_FETCHES_PER_POLL 8
+
+void DigitalInputs::prepare(int portChannelID_, int numberOfStreams)
+{
+    portChannelID = portChannelID_;
+
+    if (words == nullptr)
+    {
+        words.reset(new int16_t[DIGITAL_FETCH_WORDS]);
+        changePositions.reset(new int[DIGITAL_FETCH_WORDS]);
+        changes.reset(new Change[DIGITAL_CHANGE_RING_SIZE]);
+    }
+
+    // All lines start low, a port already high at the start shows as a change on its first word
+    lastWord = 0;
+    changesWritten = 0;
+    cursors.assign(numberOfStreams, StreamCursor());
+
+    lateChanges = 0;
+    lostChanges = 0;
+    sdkErrors = 0;
+}
+
+void DigitalInputs::poll(SampleSource &source)
+{
+    for (int fetch = 0; fetch < MAX_DIGITAL_FETCHES_PER_POLL; fetch++)
+    {
+        int numberOfWords = 0;
+        AO::ULONG timeStamp = 0;
+        const int status = source.getAlignedData(words.get(), DIGITAL_FETCH_WORDS, &numberOfWords, &portChannelID, 1, &timeStamp);
+        if (status != AO::eAO_OK || numberOfWords <= 0)
+        {
+            if (status != AO::eAO_OK && status != AO::eAO_MEM_EMPTY)
+                sdkErrors++;
+            return;
+        }
+
+        const int numberOfChanges = findChangedWords(words.get(), numberOfWords, lastWord, changePositions.get());
+        for (int i = 0; i < numberOfChanges; i++)
+        {
+            const int position = changePositions[i];
+            Change &change = changes[(int)(changesWritten % DIGITAL_CHANGE_RING_SIZE)];
+            change.tick = (uint32_t)timeStamp + (uint32_t)position;
+            change.word = (uint16_t)words[position];
+            changesWritten++;
+        }
+        lastWord = words[numberOfWords - 1];
+
+        // A short read emptied the buffer
+        if (numberOfWords < DIGITAL_FETCH_WORDS)
+            return;
+    }
+}
+
+void DigitalInputs::fillEventCodes(int sourceBufferIdx, uint32_t firstTick, double ticksPerSample, int numberOfSamples, uint64_t *eventCodes)
+{
+    StreamCursor &cursor = cursors[sourceBufferIdx];
+
+    if (cursor.nextChange < changesWritten - DIGITAL_CHANGE_RING_SIZE)
+    {
+        lostChanges += changesWritten - DIGITAL_CHANGE_RING_SIZE - cursor.nextChange;
+        cursor.nextChange = changesWritten - DIGITAL_CHANGE_RING_SIZE;
+    }
+
+    int samp = 0;
+    for (; cursor.nextChange < changesWritten; cursor.nextChange++)
+    {
+        const Change &change = changes[(int)(cursor.nextChange % DIGITAL_CHANGE_RING_SIZE)];
+
+        // Ticks wrap after 27 hours, the difference to the block start does not
+        const int32_t offsetTicks = (int32_t)(change.tick - firstTick);
+        int changeSample = 0;
+        if (offsetTicks > 0)
+        {
+            const double position = std::ceil(offsetTicks / ticksPerSample);
+            if (position >= numberOfSamples)
+                break;
+            changeSample = (int)position;
+        }
+        else if (offsetTicks <= -ticksPerSample && cursor.started)
+        {
+            // Closer than a sample before the block is after the last sample of the previous one
+            lateChanges++;
+        }
+
+        // Changes from before the first block of a stream only set its initial state
+        for (; samp < changeSample; samp++)
+            eventCodes[samp] = cursor.word;
+        cursor.word = change.word;
+    }
+
+    for (; samp < numberOfSamples; samp++)
+        eventCodes[samp] = cursor.word;
+    cursor.started = true;
+}
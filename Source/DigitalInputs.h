@@ -0,0 +1,109 @@
+/*
+	------------------------------------------------------------------
+
+	This file is part of the Open Ephys GUI
+	Copyright (C) 2020 Open Ephys
+
+	------------------------------------------------------------------
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef __DIGITALINPUTS_H__
+#define __DIGITALINPUTS_H__
+
+#include "SampleSource.h"
+
+#include <memory>
+#include <stdint.h>
+#include <vector>
+
+namespace AONode
+{
+	/**
+		Turns the words of a digital input port into the TTL line state of
+		every continuous sample.
+
+		The port is read as one int16 word per device clock tick; each word
+		that differs from the one before it is kept, with its tick, in a ring
+		shared by all streams. Every stream walks the ring with its own cursor
+		and places each change on its first sample at or after the change's
+		tick. A change that arrives after the samples it belongs to were
+		delivered lands on the first sample of the next block and is counted
+		as late.
+
+		Called from the data thread only.
+	*/
+	class DigitalInputs
+	{
+	public:
+		DigitalInputs() {}
+		DigitalInputs(const DigitalInputs &) = delete;
+		DigitalInputs &operator=(const DigitalInputs &) = delete;
+
+		/** Starts a run reading the port portChannelID for numberOfStreams streams */
+		void prepare(int portChannelID, int numberOfStreams);
+
+		/** Reads everything the source buffered for the port and records its changes */
+		void poll(SampleSource &source);
+
+		/**
+			Fills eventCodes with the line state at each sample of a block of one stream,
+			firstTick is the device tick of its first sample
+		*/
+		void fillEventCodes(int sourceBufferIdx, uint32_t firstTick, double ticksPerSample, int numberOfSamples, uint64_t *eventCodes);
+
+		int getPortChannelID() const { return portChannelID; }
+
+		int64_t getNumberOfChanges() const { return changesWritten; }
+		/** Changes placed on a later sample than their tick, summed over the streams */
+		int64_t getLateChanges() const { return lateChanges; }
+		/** Changes overwritten in the ring before a stream used them, summed over the streams */
+		int64_t getLostChanges() const { return lostChanges; }
+		/** getAlignedData calls that failed for another reason than an empty buffer */
+		int64_t getSdkErrors() const { return sdkErrors; }
+
+	private:
+		struct Change
+		{
+			uint32_t tick;
+			uint16_t word;
+		};
+
+		struct StreamCursor
+		{
+			int64_t nextChange = 0;
+			uint16_t word = 0;
+			bool started = false;
+		};
+
+		int portChannelID = -1;
+
+		std::unique_ptr<int16_t[]> words;
+		std::unique_ptr<int[]> changePositions;
+		/** Last word read, changes are found against it */
+		int16_t lastWord = 0;
+
+		std::unique_ptr<Change[]> changes;
+		int64_t changesWritten = 0;
+		std::vector<StreamCursor> cursors;
+
+		int64_t lateChanges = 0;
+		int64_t lostChanges = 0;
+		int64_t sdkErrors = 0;
+	};
+}
+
+#endif // __DIGITALINPUTS_H__
@@ -0,0 +1,107 @@
+/*
+    ------------------------------------------------------------------
+
+    This file is part of the Open Ephys GUI
+    Copyright (C) 2016 Open Ephys
+
+    ------------------------------------------------------------------
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include "FetchAligner.h"
+#include "DeviceClock.h"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace AONode;
+
+FetchAligner::FetchAligner(SampleSource &source_, const StreamPlan &stream_, StreamCounters &counters_)
+    : source(source_),
+      stream(stream_),
+      counters(counters_),
+      channelTicks(stream_.numberOfChannels, 0),
+      channelTickKnown(stream_.numberOfChannels, 0)
+{
+    // Every stream rate divides the device clock
+    ticksPerSample = std::max(1, (int)std::lround(DeviceClockModel::DEVICE_CLOCK_HZ / stream.samplingRate));
+}
+
+const StreamFetch &FetchAligner::getFetch(const StreamFetch &live, AO::int16 *buffer, int bufferCapacity)
+{
+    if (&live == current)
+        return live;
+
+    // Nothing read since the buffers were cleared, every channel is still at the first sample
+    if (current != nullptr && blockRead)
+    {
+        for (int channelID : live.channelIDs)
+        {
+            if (std::find(current->channelIDs.begin(), current->channelIDs.end(), channelID) != current->channelIDs.end())
+                continue;
+
+            const int row = (int)(std::find(stream.channelIDs, stream.channelIDs + stream.numberOfChannels, channelID) - stream.channelIDs);
+            if (row == stream.numberOfChannels || !alignChannel(row, buffer, bufferCapacity))
+                return *current;
+        }
+    }
+
+    // The positions found are only kept while nothing else reads the channels
+    std::fill(channelTickKnown.begin(), channelTickKnown.end(), (char)0);
+    current = &live;
+    return live;
+}
+
+void FetchAligner::blockFetched(AO::ULONG timeStamp, int numberOfSamplesPerChannel)
+{
+    nextTick = (uint32_t)timeStamp + (uint32_t)numberOfSamplesPerChannel * (uint32_t)ticksPerSample;
+    blockRead = true;
+}
+
+bool FetchAligner::alignChannel(int row, AO::int16 *buffer, int bufferCapacity)
+{
+    int channelID = stream.channelIDs[row];
+    int numberOfSamples = 0;
+    AO::ULONG timeStamp = 0;
+
+    // The timestamp of the oldest buffered sample costs that sample, the channel is behind by at least a block
+    if (!channelTickKnown[row])
+    {
+        const int status = source.getAlignedData(buffer, 1, &numberOfSamples, &channelID, 1, &timeStamp);
+        if (status != AO::eAO_OK && status != AO::eAO_MEM_EMPTY)
+            StreamCounters::increment(counters.sdkErrors);
+        if (status != AO::eAO_OK || numberOfSamples <= 0)
+            return false;
+
+        channelTicks[row] = (uint32_t)timeStamp + (uint32_t)ticksPerSample;
+        channelTickKnown[row] = 1;
+    }
+
+    // Device ticks wrap at 32 bits, the lag is far shorter than that
+    int64_t lag = (int32_t)(nextTick - channelTicks[row]) / ticksPerSample;
+    while (lag > 0)
+    {
+        const int status = source.getAlignedData(buffer, (int)std::min<int64_t>(lag, bufferCapacity), &numberOfSamples, &channelID, 1, &timeStamp);
+        if (status != AO::eAO_OK && status != AO::eAO_MEM_EMPTY)
+            StreamCounters::increment(counters.sdkErrors);
+        if (status != AO::eAO_OK || numberOfSamples <= 0)
+            return false;
+
+        channelTicks[row] = (uint32_t)timeStamp + (uint32_t)numberOfSamples * (uint32_t)ticksPerSample;
+        lag = (int32_t)(nextTick - channelTicks[row]) / ticksPerSample;
+    }
+    return true;
+}
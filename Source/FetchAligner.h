@@ -0,0 +1,86 @@
+/*
+	------------------------------------------------------------------
+
+	This file is part of the Open Ephys GUI
+	Copyright (C) 2020 Open Ephys
+
+	------------------------------------------------------------------
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef __FETCHALIGNER_H__
+#define __FETCHALIGNER_H__
+
+#include "AcquisitionCounters.h"
+#include "AcquisitionPlan.h"
+#include "FetchPlan.h"
+#include "SampleSource.h"
+
+#include <stdint.h>
+#include <vector>
+
+namespace AONode
+{
+	/**
+		Keeps the channels of one stream sample-aligned across fetch plan changes.
+
+		The SDK keeps buffering the channels a fetch leaves out, so a channel
+		fetched again would start where it was left, behind the others. Before
+		a new fetch is used, every channel it adds is read on its own and
+		discarded up to the device tick the other channels have reached. Until
+		that succeeds the previous fetch stays in use, so the added channels
+		keep their rows zeroed rather than delivering stale samples.
+
+		Used by the one thread fetching the stream, without allocating.
+	*/
+	class FetchAligner
+	{
+	public:
+		FetchAligner(SampleSource &source, const StreamPlan &stream, StreamCounters &counters);
+
+		FetchAligner(const FetchAligner &) = delete;
+		FetchAligner &operator=(const FetchAligner &) = delete;
+
+		/**
+			The fetch to read next: live once the channels it adds are aligned, else the
+			fetch used so far. buffer, of bufferCapacity items, is used to discard samples
+		*/
+		const StreamFetch &getFetch(const StreamFetch &live, AO::int16 *buffer, int bufferCapacity);
+
+		/** A block starting at timeStamp was read with the last fetch getFetch returned */
+		void blockFetched(AO::ULONG timeStamp, int numberOfSamplesPerChannel);
+
+	private:
+		SampleSource &source;
+		StreamPlan stream;
+		StreamCounters &counters;
+		int ticksPerSample;
+
+		const StreamFetch *current = nullptr;
+		/** Device tick of the next sample of the channels current reads, once a block was read */
+		bool blockRead = false;
+		uint32_t nextTick = 0;
+
+		/** Per plan channel: device tick of its next buffered sample, once found by an alignment attempt */
+		std::vector<uint32_t> channelTicks;
+		std::vector<char> channelTickKnown;
+
+		/** Discards the samples of one channel up to nextTick, false if the SDK failed or had none */
+		bool alignChannel(int row, AO::int16 *buffer, int bufferCapacity);
+	};
+}
+
+#endif // __FETCHALIGNER_H__
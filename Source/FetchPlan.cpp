@@ -0,0 +1,67 @@
+/*
+    ------------------------------------------------------------------
+
+    This file is part of the Open Ephys GUI
+    Copyright (C) 2016 Open Ephys
+
+    ------------------------------------------------------------------
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include "FetchPlan.h"
+
+#include <algorithm>
+#include <string.h>
+
+using namespace AONode;
+
+void StreamFetch::expand(int16_t *data, int numberOfChannels, int numberOfSamplesPerChannel) const
+{
+    if (complete)
+        return;
+
+    // Backwards, as a fetched channel only ever moves to a later row
+    const size_t channelBytes = (size_t)numberOfSamplesPerChannel * sizeof(int16_t);
+    for (int ch = getNumberOfChannels() - 1; ch >= 0; ch--)
+    {
+        if (rows[ch] > ch)
+            memmove(data + (size_t)rows[ch] * numberOfSamplesPerChannel, data + (size_t)ch * numberOfSamplesPerChannel, channelBytes);
+    }
+
+    int fetched = 0;
+    for (int row = 0; row < numberOfChannels; row++)
+    {
+        if (fetched < getNumberOfChannels() && rows[fetched] == row)
+        {
+            fetched++;
+            continue;
+        }
+        int16_t *rowData = data + (size_t)row * numberOfSamplesPerChannel;
+        std::fill(rowData, rowData + numberOfSamplesPerChannel, (int16_t)0);
+    }
+}
+
+void LiveFetchPlan::publish(std::unique_ptr<FetchPlan> plan)
+{
+    plans.emplace_back(std::move(plan));
+    current.store(plans.back().get(), std::memory_order_release);
+}
+
+void LiveFetchPlan::clearRetired()
+{
+    if (plans.size() > 1)
+        plans.erase(plans.begin(), plans.end() - 1);
+}
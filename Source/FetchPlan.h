@@ -0,0 +1,95 @@
+/*
+	------------------------------------------------------------------
+
+	This file is part of the Open Ephys GUI
+	Copyright (C) 2020 Open Ephys
+
+	------------------------------------------------------------------
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __FETCHPLAN_H__
+#define __FETCHPLAN_H__
+
+#include <atomic>
+#include <memory>
+#include <stdint.h>
+#include <vector>
+
+namespace AONode
+{
+	/**
+		Channels of one stream read from the SDK, a subset of StreamPlan::channelIDs.
+
+		rows[i] is the index in StreamPlan::channelIDs that channelIDs[i] fills,
+		in increasing order, or -1 for the one channel read to keep a stream
+		without selected channels running.
+	*/
+	struct StreamFetch
+	{
+		std::vector<int> channelIDs;
+		std::vector<int> rows;
+		/** Every plan channel in plan order, blocks need no expanding */
+		bool complete = true;
+
+		int getNumberOfChannels() const { return (int)channelIDs.size(); }
+
+		/**
+			Spreads a channel-major block of the fetched channels over all
+			numberOfChannels plan channels in place, zeroing the others. data
+			must have room for numberOfChannels * numberOfSamplesPerChannel items.
+		*/
+		void expand(int16_t *data, int numberOfChannels, int numberOfSamplesPerChannel) const;
+
+		bool operator==(const StreamFetch &other) const { return channelIDs == other.channelIDs && rows == other.rows; }
+	};
+
+	/** What to read of every stream, indexed by StreamPlan::sourceBufferIdx */
+	struct FetchPlan
+	{
+		std::vector<StreamFetch> streams;
+	};
+
+	/**
+		The fetch plan the acquisition threads read, replaced while they run.
+
+		publish swaps in a new plan with a single atomic store, the threads
+		load it once per block and never wait. Replaced plans are kept until
+		clearRetired, so a block fetched with one can still be expanded with it.
+	*/
+	class LiveFetchPlan
+	{
+	public:
+		LiveFetchPlan() {}
+		LiveFetchPlan(const LiveFetchPlan &) = delete;
+		LiveFetchPlan &operator=(const LiveFetchPlan &) = delete;
+
+		/** Message thread */
+		void publish(std::unique_ptr<FetchPlan> plan);
+
+		/** Any thread, nullptr before the first plan is published */
+		const FetchPlan *get() const { return current.load(std::memory_order_acquire); }
+
+		/** Frees the replaced plans, only while no acquisition thread runs */
+		void clearRetired();
+
+	private:
+		std::atomic<const FetchPlan *> current{nullptr};
+		/** Every plan published since clearRetired, the last one is current */
+		std::vector<std::unique_ptr<const FetchPlan>> plans;
+	};
+}
+
+#endif // __FETCHPLAN_H__
@@ -0,0 +1,170 @@
+/*
+    ------------------------------------------------------------------
+
+    This file is part of the Open Ephys GUI
+    Copyright (C) 2016 Open Ephys
+
+    ------------------------------------------------------------------
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include "PollWaitStrategy.h"
+
+#include <algorithm>
+#include <cmath>
+#include <thread>
+
+using namespace AONode;
+
+#define SPINS_BEFORE_YIELD 64
+#define DEFAULT_TARGET_BLOCK_MS 5.0
+#define MIN_NAP_NS 100000
+
+PollWaitStrategy::PollWaitStrategy() : mode(PollWaitMode::SLEEP_UNTIL_READY),
+                                       targetBlockMs(DEFAULT_TARGET_BLOCK_MS)
+{
+}
+
+void PollWaitStrategy::prepare(const AcquisitionPlan &plan)
+{
+    streamStates.clear();
+    for (int i = 0; i < (int)plan.streams.size(); i++)
+        streamStates.push_back(std::make_unique<StreamWaitState>());
+}
+
+void PollWaitStrategy::setMode(PollWaitMode newMode)
+{
+    mode.store(newMode, std::memory_order_relaxed);
+}
+
+void PollWaitStrategy::setTargetBlockMs(double newTargetBlockMs)
+{
+    targetBlockMs.store(newTargetBlockMs, std::memory_order_relaxed);
+}
+
+int64_t PollWaitStrategy::getTargetBlockNs(const StreamPlan &stream) const
+{
+    // Whole samples only, and at least one, so slow streams are not woken before anything can be there
+    const double targetSamples = std::max(1.0, std::round(stream.samplingRate * targetBlockMs.load(std::memory_order_relaxed) / 1000.0));
+    return (int64_t)(targetSamples / stream.samplingRate * 1e9);
+}
+
+int64_t PollWaitStrategy::getExpectedReadyNs(const StreamPlan &stream) const
+{
+    return streamStates[stream.sourceBufferIdx].get()->expectedReadyNs;
+}
+
+void PollWaitStrategy::waitForNextBlock(const StreamPlan &stream)
+{
+    if (getMode() != PollWaitMode::SLEEP_UNTIL_READY)
+        return;
+
+    StreamWaitState *state = streamStates[stream.sourceBufferIdx].get();
+    if (state->expectedReadyNs > getTimeNs())
+        sleepUntil(state, state->expectedReadyNs);
+}
+
+void PollWaitStrategy::waitAfterEmptyPoll(const StreamPlan &stream, int consecutiveEmptyPolls)
+{
+    StreamWaitState *state = streamStates[stream.sourceBufferIdx].get();
+    state->emptyPolls.store(state->emptyPolls.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+
+    switch (getMode())
+    {
+    case PollWaitMode::SPIN:
+        break;
+    case PollWaitMode::SPIN_THEN_YIELD:
+        if (consecutiveEmptyPolls >= SPINS_BEFORE_YIELD)
+            std::this_thread::yield();
+        break;
+    case PollWaitMode::SLEEP_UNTIL_READY:
+        // Woke up too early, nap for a fraction of a block rather than hammering the SDK
+        sleepUntil(state, getTimeNs() + std::max<int64_t>(MIN_NAP_NS, getTargetBlockNs(stream) / 8));
+        break;
+    }
+}
+
+void PollWaitStrategy::waitAfterError(const StreamPlan &stream)
+{
+    // A failing SDK is not polled faster than blocks are due, even when spinning
+    StreamWaitState *state = streamStates[stream.sourceBufferIdx].get();
+    sleepUntil(state, getTimeNs() + getTargetBlockNs(stream));
+}
+
+void PollWaitStrategy::blockReceived(const StreamPlan &stream)
+{
+    StreamWaitState *state = streamStates[stream.sourceBufferIdx].get();
+    state->consecutiveEmptyPolls = 0;
+
+    // Only sleeping waits for a full block, the spinning modes poll again straight away
+    state->expectedReadyNs = getTimeNs();
+    if (getMode() == PollWaitMode::SLEEP_UNTIL_READY)
+        state->expectedReadyNs += getTargetBlockNs(stream);
+}
+
+void PollWaitStrategy::waitForEarliestDeadline(const AcquisitionPlan &plan)
+{
+    if (getMode() != PollWaitMode::SLEEP_UNTIL_READY)
+        return;
+
+    StreamWaitState *earliest = nullptr;
+    for (const StreamPlan &stream : plan.streams)
+    {
+        StreamWaitState *state = streamStates[stream.sourceBufferIdx].get();
+        if (earliest == nullptr || state->expectedReadyNs < earliest->expectedReadyNs)
+            earliest = state;
+    }
+
+    if (earliest != nullptr && earliest->expectedReadyNs > getTimeNs())
+        sleepUntil(earliest, earliest->expectedReadyNs);
+}
+
+void PollWaitStrategy::emptyPollDeferred(const StreamPlan &stream)
+{
+    StreamWaitState *state = streamStates[stream.sourceBufferIdx].get();
+    state->emptyPolls.store(state->emptyPolls.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    state->consecutiveEmptyPolls++;
+    state->expectedReadyNs = getTimeNs();
+
+    switch (getMode())
+    {
+    case PollWaitMode::SPIN:
+        break;
+    case PollWaitMode::SPIN_THEN_YIELD:
+        if (state->consecutiveEmptyPolls >= SPINS_BEFORE_YIELD)
+            std::this_thread::yield();
+        break;
+    case PollWaitMode::SLEEP_UNTIL_READY:
+        state->expectedReadyNs += std::max<int64_t>(MIN_NAP_NS, getTargetBlockNs(stream) / 8);
+        break;
+    }
+}
+
+void PollWaitStrategy::sleepUntil(StreamWaitState *state, int64_t deadlineNs)
+{
+    std::this_thread::sleep_for(std::chrono::nanoseconds(deadlineNs - getTimeNs()));
+    state->wakeUpLateness.record(getTimeNs() - deadlineNs);
+}
+
+int64_t PollWaitStrategy::getEmptyPolls(int sourceBufferIdx) const
+{
+    return streamStates[sourceBufferIdx]->emptyPolls.load(std::memory_order_relaxed);
+}
+
+const LatencyHistogram &PollWaitStrategy::getWakeUpLateness(int sourceBufferIdx) const
+{
+    return streamStates[sourceBufferIdx]->wakeUpLateness;
+}
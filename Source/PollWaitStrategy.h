@@ -0,0 +1,115 @@
+/*
+	------------------------------------------------------------------
+
+	This file is part of the Open Ephys GUI
+	Copyright (C) 2020 Open Ephys
+
+	------------------------------------------------------------------
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __POLLWAITSTRATEGY_H__
+#define __POLLWAITSTRATEGY_H__
+
+#include <atomic>
+#include <memory>
+#include <stdint.h>
+#include <vector>
+
+#include "AcquisitionCounters.h"
+#include "AcquisitionPlan.h"
+
+namespace AONode
+{
+	/** How the data thread waits for GetAlignedData to have samples, values match the editor selector IDs */
+	enum class PollWaitMode
+	{
+		SPIN = 1,
+		SPIN_THEN_YIELD,
+		SLEEP_UNTIL_READY
+	};
+
+	/**
+		Decides what the data thread does between GetAlignedData calls.
+
+		SPIN polls continuously (lowest latency, one core at 100%).
+		SPIN_THEN_YIELD gives the core away after a run of empty polls.
+		SLEEP_UNTIL_READY sleeps until the stream should have accumulated a
+		target block, based on its sampling rate, and naps between empty polls.
+
+		The same policy drives both polling orders of DeviceThread: one stream
+		at a time until it has data, or each stream on its own deadline.
+
+		Empty polls and how late the thread wakes up from a sleep are counted per stream.
+	*/
+	class PollWaitStrategy
+	{
+	public:
+		PollWaitStrategy();
+		PollWaitStrategy(const PollWaitStrategy &) = delete;
+		PollWaitStrategy &operator=(const PollWaitStrategy &) = delete;
+
+		/** Resets the per-stream state, one entry per StreamPlan::sourceBufferIdx */
+		void prepare(const AcquisitionPlan &plan);
+
+		void setMode(PollWaitMode mode);
+		PollWaitMode getMode() const { return mode.load(std::memory_order_relaxed); }
+
+		/** Block duration SLEEP_UNTIL_READY aims for */
+		void setTargetBlockMs(double targetBlockMs);
+
+		/** Called before the first poll of a block */
+		void waitForNextBlock(const StreamPlan &stream);
+
+		/** Called after a poll returned no data */
+		void waitAfterEmptyPoll(const StreamPlan &stream, int consecutiveEmptyPolls);
+
+		/** Called after a poll failed, waits a whole block in every mode and is not an empty poll */
+		void waitAfterError(const StreamPlan &stream);
+
+		/** Called once a poll returned data */
+		void blockReceived(const StreamPlan &stream);
+
+		/** Scheduled polling: waits until the earliest stream deadline of the plan */
+		void waitForEarliestDeadline(const AcquisitionPlan &plan);
+
+		/** Scheduled polling: counts an empty poll and reschedules the stream without waiting */
+		void emptyPollDeferred(const StreamPlan &stream);
+
+		/** Time at which the stream should be polled next */
+		int64_t getExpectedReadyNs(const StreamPlan &stream) const;
+
+		int64_t getEmptyPolls(int sourceBufferIdx) const;
+		const LatencyHistogram &getWakeUpLateness(int sourceBufferIdx) const;
+
+	private:
+		struct StreamWaitState
+		{
+			int64_t expectedReadyNs = 0;
+			int consecutiveEmptyPolls = 0;
+			std::atomic<int64_t> emptyPolls{0};
+			LatencyHistogram wakeUpLateness;
+		};
+
+		void sleepUntil(StreamWaitState *state, int64_t deadlineNs);
+		int64_t getTargetBlockNs(const StreamPlan &stream) const;
+
+		std::atomic<PollWaitMode> mode;
+		std::atomic<double> targetBlockMs;
+		std::vector<std::unique_ptr<StreamWaitState>> streamStates;
+	};
+}
+
+#endif // __POLLWAITSTRATEGY_H__
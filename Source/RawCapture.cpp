@@ -0,0 +1,189 @@
+/*
+    ------------------------------------------------------------------
+
+    This file is part of the Open Ephys GUI
+    Copyright (C) 2016 Open Ephys
+
+    ------------------------------------------------------------------
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include "RawCapture.h"
+
+using namespace AONode;
+
+// The file is grown by this much of the stream at a time, and never by less than a block
+#define CAPTURE_GROWTH_SECONDS 60
+
+// The grower checks its writers at least this often, besides being woken by them
+#define CAPTURE_GROWER_WAIT_MS 100
+
+RawCaptureGrower::RawCaptureGrower() : Thread("Raw capture grower")
+{
+}
+
+RawCaptureGrower::~RawCaptureGrower()
+{
+    stopThread(2000);
+}
+
+void RawCaptureGrower::run()
+{
+    while (!threadShouldExit())
+    {
+        for (RawCaptureWriter *writer : writers)
+            writer->prepareNextMapping();
+
+        wait(CAPTURE_GROWER_WAIT_MS);
+    }
+}
+
+RawCaptureWriter::RawCaptureWriter(RawCaptureGrower &grower_, const File &file_, const StreamPlan &stream, const String &streamName, const StringArray &channelNames)
+    : grower(grower_),
+      file(file_),
+      numberOfChannels(stream.numberOfChannels)
+{
+    static_assert(sizeof(RawCaptureHeader) % 8 == 0 && sizeof(RawCaptureBlock) % 8 == 0, "capture records must keep 8-byte alignment");
+
+    grower.addWriter(this);
+
+    growthBytes = getRawCaptureBlockBytes(numberOfChannels, (int)(stream.samplingRate * CAPTURE_GROWTH_SECONDS));
+    writeOffset = getRawCaptureHeaderBytes(numberOfChannels);
+
+    if (!file.deleteFile() || !file.create() || (mapping = mapFile(jmax(writeOffset, growthBytes))) == nullptr)
+    {
+        LOGE("Unable to create raw capture file ", file.getFullPathName());
+        return;
+    }
+    mappedSize = (int64)mapping->getSize();
+
+    RawCaptureHeader *header = getHeader();
+    memcpy(header->magic, RAW_CAPTURE_MAGIC, sizeof(header->magic));
+    header->version = RAW_CAPTURE_VERSION;
+    header->headerBytes = (uint32)writeOffset;
+    header->streamID = stream.streamID;
+    header->numberOfChannels = numberOfChannels;
+    header->samplingRate = stream.samplingRate;
+    header->bitVolts = stream.bitVolts;
+    header->dataEnd = (uint64)writeOffset;
+    streamName.copyToUTF8(header->streamName, sizeof(header->streamName));
+    memcpy(header + 1, stream.channelIDs, numberOfChannels * sizeof(int32));
+
+    char *names = (char *)mapping->getData() + writeOffset - (int64)numberOfChannels * RAW_CAPTURE_NAME_BYTES;
+    for (int ch = 0; ch < numberOfChannels; ch++)
+        channelNames[ch].copyToUTF8(names + ch * RAW_CAPTURE_NAME_BYTES, RAW_CAPTURE_NAME_BYTES);
+}
+
+RawCaptureWriter::~RawCaptureWriter()
+{
+    if (mapping == nullptr)
+        return;
+
+    mapping.reset();
+    nextMapping.reset();
+    retiredMapping.reset();
+
+    FileOutputStream out(file);
+    if (out.openedOk())
+    {
+        out.setPosition(writeOffset);
+        out.truncate();
+    }
+}
+
+void RawCaptureWriter::writeBlock(const StreamFetch &fetch, uint32 deviceTimeStamp, int64 firstSampleNumber, const int16 *data, int numberOfSamplesPerChannel)
+{
+    if (mapping == nullptr || numberOfSamplesPerChannel <= 0)
+        return;
+
+    const int state = growState.load(std::memory_order_acquire);
+    if (state == GROW_FAILED)
+    {
+        droppedBlocks++;
+        return;
+    }
+
+    // The larger mapping is used from the next block on, the grower unmaps the old one
+    if (state == GROW_READY)
+    {
+        retiredMapping = std::move(mapping);
+        mapping = std::move(nextMapping);
+        mappedSize = requestedSize;
+        growState.store(GROW_IDLE, std::memory_order_release);
+    }
+
+    const int numberOfFetchedChannels = fetch.getNumberOfChannels();
+    const int64 blockBytes = getRawCaptureBlockBytes(numberOfFetchedChannels, numberOfSamplesPerChannel);
+    const bool fits = writeOffset + blockBytes <= mappedSize;
+    if (fits)
+    {
+        char *destination = (char *)mapping->getData() + writeOffset;
+        RawCaptureBlock *block = (RawCaptureBlock *)destination;
+        block->deviceTimeStamp = deviceTimeStamp;
+        block->numberOfSamplesPerChannel = numberOfSamplesPerChannel;
+        block->firstSampleNumber = firstSampleNumber;
+        block->numberOfFetchedChannels = numberOfFetchedChannels;
+        block->reserved = 0;
+        memcpy(block + 1, fetch.rows.data(), (size_t)numberOfFetchedChannels * sizeof(int32));
+        memcpy(destination + getRawCaptureBlockHeaderBytes(numberOfFetchedChannels), data, (size_t)numberOfFetchedChannels * numberOfSamplesPerChannel * sizeof(int16));
+
+        writeOffset += blockBytes;
+        getHeader()->dataEnd = (uint64)writeOffset;
+    }
+    else
+    {
+        // The grower fell half a step behind, the replay shows the block as lost samples
+        droppedBlocks++;
+    }
+
+    if (growState.load(std::memory_order_relaxed) == GROW_IDLE && mappedSize - writeOffset < jmax(growthBytes / 2, blockBytes))
+    {
+        requestedSize = jmax(mappedSize + growthBytes, writeOffset + 2 * blockBytes);
+        growState.store(GROW_REQUESTED, std::memory_order_release);
+        grower.notify();
+    }
+}
+
+void RawCaptureWriter::prepareNextMapping()
+{
+    if (growState.load(std::memory_order_acquire) != GROW_REQUESTED)
+        return;
+
+    retiredMapping.reset();
+    nextMapping = mapFile(requestedSize);
+    if (nextMapping == nullptr)
+        LOGE("Raw capture stopped, unable to grow ", file.getFullPathName());
+
+    growState.store(nextMapping != nullptr ? GROW_READY : GROW_FAILED, std::memory_order_release);
+}
+
+std::unique_ptr<MemoryMappedFile> RawCaptureWriter::mapFile(int64 size)
+{
+#if !JUCE_WINDOWS
+    // mmap needs the file to be as large as the mapping. Windows extends it when mapping, and does
+    // not let it be opened for writing while an earlier mapping is open
+    {
+        FileOutputStream out(file);
+        if (!out.openedOk() || !out.setPosition(size - 1) || !out.writeByte(0))
+            return nullptr;
+    }
+#endif
+
+    auto newMapping = std::make_unique<MemoryMappedFile>(file, Range<int64>(0, size), MemoryMappedFile::readWrite);
+    if (newMapping->getData() == nullptr || (int64)newMapping->getSize() < size)
+        return nullptr;
+    return newMapping;
+}
@@ -0,0 +1,197 @@
+/*
+	------------------------------------------------------------------
+
+	This file is part of the Open Ephys GUI
+	Copyright (C) 2020 Open Ephys
+
+	------------------------------------------------------------------
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef __RAWCAPTURE_H__
+#define __RAWCAPTURE_H__
+
+#include <DataThreadHeaders.h>
+
+#include "AcquisitionPlan.h"
+#include "FetchPlan.h"
+
+#include <atomic>
+
+namespace AONode
+{
+	static const int RAW_CAPTURE_NAME_BYTES = 64;
+
+	/**
+		Start of a raw capture file, followed by the int32 channel IDs of the
+		stream padded to 8 bytes and their SDK channel names, RAW_CAPTURE_NAME_BYTES
+		each, then by blocks up to dataEnd.
+
+		All fields are little-endian. The file is grown ahead of the writer,
+		so only the bytes before dataEnd hold blocks.
+	*/
+	struct RawCaptureHeader
+	{
+		char magic[8];
+		uint32 version;
+		/** Offset of the first block */
+		uint32 headerBytes;
+		int32 streamID;
+		int32 numberOfChannels;
+		double samplingRate;
+		/** Bit_Resolution of the stream, in microvolts */
+		double bitVolts;
+		/** Offset just past the last complete block, updated after every block */
+		uint64 dataEnd;
+		char streamName[RAW_CAPTURE_NAME_BYTES];
+	};
+
+	/**
+		One GetAlignedData block, followed by the int32 StreamFetch::rows of the
+		channels it was fetched with, padded to 8 bytes, then by their
+		numberOfFetchedChannels * numberOfSamplesPerChannel channel-major int16
+		samples, padded to 8 bytes. Channels missing from rows were not read
+	*/
+	struct RawCaptureBlock
+	{
+		/** Device timestamp of the first sample, as the SDK returned it */
+		uint32 deviceTimeStamp;
+		int32 numberOfSamplesPerChannel;
+		/** Sample number given to the first sample, skipping the samples lost before it */
+		int64 firstSampleNumber;
+		int32 numberOfFetchedChannels;
+		int32 reserved;
+	};
+
+	static const char RAW_CAPTURE_MAGIC[8] = {'A', 'O', 'R', 'A', 'W', 'C', 'A', 'P'};
+	static const uint32 RAW_CAPTURE_VERSION = 2;
+
+	/** Offset of the first block in the capture of a stream with this many channels */
+	inline int64 getRawCaptureHeaderBytes(int numberOfChannels)
+	{
+		return sizeof(RawCaptureHeader) + (((int64)numberOfChannels * sizeof(int32) + 7) & ~(int64)7) + (int64)numberOfChannels * RAW_CAPTURE_NAME_BYTES;
+	}
+
+	/** Offset of the samples of a block with this many fetched channels, from the start of the block */
+	inline int64 getRawCaptureBlockHeaderBytes(int numberOfFetchedChannels)
+	{
+		return sizeof(RawCaptureBlock) + (((int64)numberOfFetchedChannels * sizeof(int32) + 7) & ~(int64)7);
+	}
+
+	/** Bytes a block of this size takes in a capture file */
+	inline int64 getRawCaptureBlockBytes(int numberOfFetchedChannels, int numberOfSamplesPerChannel)
+	{
+		const int64 dataBytes = (int64)numberOfFetchedChannels * numberOfSamplesPerChannel * sizeof(int16);
+		return getRawCaptureBlockHeaderBytes(numberOfFetchedChannels) + ((dataBytes + 7) & ~(int64)7);
+	}
+
+	class RawCaptureWriter;
+
+	/**
+		Grows the files of the RawCaptureWriters on its own thread, ahead of
+		their write positions, so the data thread never extends, maps or
+		unmaps a file.
+	*/
+	class RawCaptureGrower : public Thread
+	{
+	public:
+		RawCaptureGrower();
+		~RawCaptureGrower();
+
+		void run() override;
+
+	private:
+		friend class RawCaptureWriter;
+		/** From the writer constructors, before the thread starts */
+		void addWriter(RawCaptureWriter *writer) { writers.add(writer); }
+
+		Array<RawCaptureWriter *> writers;
+
+		JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(RawCaptureGrower);
+	};
+
+	/**
+		Appends the int16 blocks of one stream, exactly as GetAlignedData
+		returned them, with the rows of the channels they were fetched with,
+		to a memory-mapped file.
+
+		The file is grown by large steps. Once less than half a step is left,
+		the grower extends the file and maps it again at the new size, and the
+		next block switches to that mapping, so writing a block is a single
+		copy into the page cache with no system call. writeBlock is called from
+		the data thread only.
+	*/
+	class RawCaptureWriter
+	{
+	public:
+		/** channelNames are the SDK names of the stream channels, in StreamPlan::channelIDs order */
+		RawCaptureWriter(RawCaptureGrower &grower, const File &file, const StreamPlan &stream, const String &streamName, const StringArray &channelNames);
+
+		/** Unmaps the file and trims it to the blocks written, the grower must be stopped */
+		~RawCaptureWriter();
+
+		/** False once the file could not be created or grown, later blocks are dropped */
+		bool isOpen() const { return mapping != nullptr && growState.load(std::memory_order_relaxed) != GROW_FAILED; }
+
+		/** data holds the channels of fetch, in its order */
+		void writeBlock(const StreamFetch &fetch, uint32 deviceTimeStamp, int64 firstSampleNumber, const int16 *data, int numberOfSamplesPerChannel);
+
+		const File &getFile() const { return file; }
+		int64 getBytesWritten() const { return writeOffset; }
+
+		/** Blocks that did not fit because the grower fell behind or the file could not be grown */
+		int64 getDroppedBlocks() const { return droppedBlocks; }
+
+	private:
+		enum GrowState
+		{
+			/** Data thread owns nextMapping and retiredMapping */
+			GROW_IDLE,
+			/** Grower owns them, the file is to be grown to requestedSize */
+			GROW_REQUESTED,
+			/** nextMapping covers requestedSize, handed back to the data thread */
+			GROW_READY,
+			GROW_FAILED
+		};
+
+		friend class RawCaptureGrower;
+		/** Grower thread: maps the file at the requested size, if the data thread asked for it */
+		void prepareNextMapping();
+		/** Extends the file to size bytes and maps all of it, nullptr on failure */
+		std::unique_ptr<MemoryMappedFile> mapFile(int64 size);
+		RawCaptureHeader *getHeader() { return (RawCaptureHeader *)mapping->getData(); }
+
+		RawCaptureGrower &grower;
+		File file;
+		int numberOfChannels;
+		int64 growthBytes;
+
+		std::unique_ptr<MemoryMappedFile> mapping;
+		int64 mappedSize = 0;
+		int64 writeOffset = 0;
+		int64 droppedBlocks = 0;
+
+		std::atomic<int> growState{GROW_IDLE};
+		int64 requestedSize = 0;
+		std::unique_ptr<MemoryMappedFile> nextMapping;
+		/** The mapping nextMapping replaced, unmapped by the grower */
+		std::unique_ptr<MemoryMappedFile> retiredMapping;
+
+		JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(RawCaptureWriter);
+	};
+}
+
+#endif // __RAWCAPTURE_H__
@@ -0,0 +1,301 @@
+/*
+    ------------------------------------------------------------------
+
+    This file is part of the Open Ephys GUI
+    Copyright (C) 2016 Open Ephys
+
+    ------------------------------------------------------------------
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include "ReplaySource.h"
+#include "AcquisitionStats.h"
+#include "RawCapture.h"
+
+#include <algorithm>
+
+#if !JUCE_WINDOWS
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+using namespace AONode;
+
+#define DEVICE_CLOCK_HZ 44000.0
+// How far ahead of the cursor the kernel is asked to have the capture in memory
+#define READ_AHEAD_BYTES (8 << 20)
+
+/** One capture file and the position played back so far */
+class ReplaySource::ReplayStream
+{
+public:
+    ReplayStream(const File &file_) : file(file_)
+    {
+        mapping = std::make_unique<MemoryMappedFile>(file, MemoryMappedFile::readOnly);
+        const char *base = (const char *)mapping->getData();
+        const int64 size = (int64)mapping->getSize();
+        if (base == nullptr || size < (int64)sizeof(RawCaptureHeader))
+            return;
+
+        const RawCaptureHeader *fileHeader = (const RawCaptureHeader *)base;
+        if (memcmp(fileHeader->magic, RAW_CAPTURE_MAGIC, sizeof(fileHeader->magic)) != 0 ||
+            fileHeader->version != RAW_CAPTURE_VERSION ||
+            fileHeader->numberOfChannels <= 0 || fileHeader->samplingRate <= 0 ||
+            fileHeader->headerBytes != getRawCaptureHeaderBytes(fileHeader->numberOfChannels) ||
+            (int64)fileHeader->dataEnd > size || (int64)fileHeader->dataEnd < (int64)fileHeader->headerBytes)
+            return;
+
+        header = fileHeader;
+        channelIDs = (const int32 *)(header + 1);
+        channelNames = base + header->headerBytes - (int64)header->numberOfChannels * RAW_CAPTURE_NAME_BYTES;
+        ticksPerSample = DEVICE_CLOCK_HZ / header->samplingRate;
+
+#if !JUCE_WINDOWS
+        madvise((void *)base, (size_t)header->dataEnd, MADV_SEQUENTIAL);
+#endif
+        rewind();
+    }
+
+    bool isValid() const { return header != nullptr; }
+
+    String getChannelName(int row) const
+    {
+        const char *name = channelNames + row * RAW_CAPTURE_NAME_BYTES;
+        return String::fromUTF8(name, (int)strnlen(name, RAW_CAPTURE_NAME_BYTES));
+    }
+
+    void rewind()
+    {
+        blockOffset = header->headerBytes;
+        blockSamplesRead = 0;
+        readAheadEnd = blockOffset;
+        readAhead();
+
+        const RawCaptureBlock *block = getBlock();
+        originSampleNumber = (block != nullptr) ? block->firstSampleNumber : 0;
+    }
+
+    /** Block under the cursor, nullptr once the capture is over */
+    const RawCaptureBlock *getBlock() const
+    {
+        if (blockOffset + (int64)sizeof(RawCaptureBlock) > (int64)header->dataEnd)
+            return nullptr;
+
+        const RawCaptureBlock *block = (const RawCaptureBlock *)((const char *)header + blockOffset);
+        if (block->numberOfSamplesPerChannel <= 0 ||
+            block->numberOfFetchedChannels <= 0 || block->numberOfFetchedChannels > header->numberOfChannels ||
+            blockOffset + getRawCaptureBlockBytes(block->numberOfFetchedChannels, block->numberOfSamplesPerChannel) > (int64)header->dataEnd)
+            return nullptr;
+        return block;
+    }
+
+    /** Samples of the channel in this row of the capture, nullptr if the block was not fetched with it */
+    const int16 *getBlockChannel(const RawCaptureBlock *block, int row) const
+    {
+        // Fetched rows are in increasing order, after the -1 of a stream read only to keep it running
+        const int32 *rows = (const int32 *)(block + 1);
+        const int32 *found = std::lower_bound(rows, rows + block->numberOfFetchedChannels, row);
+        if (found == rows + block->numberOfFetchedChannels || *found != row)
+            return nullptr;
+
+        const int16 *samples = (const int16 *)((const char *)block + getRawCaptureBlockHeaderBytes(block->numberOfFetchedChannels));
+        return samples + (int64)(found - rows) * block->numberOfSamplesPerChannel;
+    }
+
+    void advance(int numberOfSamples)
+    {
+        const RawCaptureBlock *block = getBlock();
+        blockSamplesRead += numberOfSamples;
+        if (blockSamplesRead < block->numberOfSamplesPerChannel)
+            return;
+
+        blockOffset += getRawCaptureBlockBytes(block->numberOfFetchedChannels, block->numberOfSamplesPerChannel);
+        blockSamplesRead = 0;
+        readAhead();
+    }
+
+    File file;
+    std::unique_ptr<MemoryMappedFile> mapping;
+
+    const RawCaptureHeader *header = nullptr;
+    const int32 *channelIDs = nullptr;
+    const char *channelNames = nullptr;
+    double ticksPerSample = 1;
+
+    int64 blockOffset = 0;
+    int blockSamplesRead = 0;
+    /** Sample number of the first recorded sample, pacing counts from there */
+    int64 originSampleNumber = 0;
+
+private:
+    /** Keeps READ_AHEAD_BYTES past the cursor on their way in, one window at a time */
+    void readAhead()
+    {
+        if (blockOffset + READ_AHEAD_BYTES / 2 < readAheadEnd || readAheadEnd >= (int64)header->dataEnd)
+            return;
+
+#if !JUCE_WINDOWS
+        // Windows clusters page faults on mapped files by itself
+        const int64 pageSize = sysconf(_SC_PAGESIZE);
+        const int64 start = (jmax(readAheadEnd, blockOffset) / pageSize) * pageSize;
+        const int64 end = jmin(blockOffset + READ_AHEAD_BYTES, (int64)header->dataEnd);
+        if (end > start)
+            madvise((char *)header + start, (size_t)(end - start), MADV_WILLNEED);
+#endif
+        readAheadEnd = blockOffset + READ_AHEAD_BYTES;
+    }
+
+    int64 readAheadEnd = 0;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(ReplayStream);
+};
+
+ReplaySource::Settings ReplaySource::getSettingsFromEnvironment()
+{
+    Settings settings;
+
+    String folder = SystemStats::getEnvironmentVariable("NEUROOMEGA_REPLAY", "");
+    if (folder.isNotEmpty())
+        settings.folder = File(folder);
+
+    String speed = SystemStats::getEnvironmentVariable("NEUROOMEGA_REPLAY_SPEED", "");
+    if (speed.isNotEmpty())
+        settings.speed = speed.getDoubleValue();
+
+    return settings;
+}
+
+ReplaySource::ReplaySource(const Settings &settings_) : settings(settings_)
+{
+    for (const File &file : settings.folder.findChildFiles(File::findFiles, false, "*.aoraw"))
+    {
+        std::unique_ptr<ReplayStream> stream = std::make_unique<ReplayStream>(file);
+        if (stream->isValid())
+            streams.add(stream.release());
+        else
+            LOGE("Not a raw capture: ", file.getFullPathName());
+    }
+
+    // Same order as the SDK lists the channels
+    std::sort(streams.begin(), streams.end(), [](const ReplayStream *a, const ReplayStream *b)
+              { return a->channelIDs[0] < b->channelIDs[0]; });
+
+    for (ReplayStream *stream : streams)
+    {
+        for (int row = 0; row < stream->header->numberOfChannels; row++)
+        {
+            ChannelLocation location;
+            location.stream = stream;
+            location.row = row;
+            channelLocations.set(stream->channelIDs[row], location);
+        }
+    }
+
+    LOGC("Replaying ", streams.size(), " streams from ", settings.folder.getFullPathName(), " at speed ", settings.speed);
+    clearTimeNs = getTimeNs();
+}
+
+ReplaySource::~ReplaySource()
+{
+}
+
+int ReplaySource::getChannelsCount(AO::uint32 *channelsCount)
+{
+    *channelsCount = (AO::uint32)channelLocations.size();
+    return AO::eAO_OK;
+}
+
+int ReplaySource::getAllChannels(AO::SInformation *channelsInfo, int channelsCount)
+{
+    if (channelsCount < channelLocations.size())
+        return AO::eAO_BAD_ARG;
+
+    int i = 0;
+    for (const ReplayStream *stream : streams)
+    {
+        for (int row = 0; row < stream->header->numberOfChannels; row++, i++)
+        {
+            channelsInfo[i].channelID = stream->channelIDs[row];
+            stream->getChannelName(row).copyToUTF8(channelsInfo[i].channelName, sizeof(channelsInfo[i].channelName));
+        }
+    }
+    return AO::eAO_OK;
+}
+
+int ReplaySource::addBufferChannel(int channelID, int bufferingSizeMs)
+{
+    return channelLocations.contains(channelID) ? AO::eAO_OK : AO::eAO_BAD_ARG;
+}
+
+int ReplaySource::clearBuffers()
+{
+    clearTimeNs = getTimeNs();
+    for (ReplayStream *stream : streams)
+        stream->rewind();
+    return AO::eAO_OK;
+}
+
+int ReplaySource::getAlignedData(AO::int16 *data, int dataCapacity, int *actualDataSize, int *channelIDs, int channelsCount, AO::ULONG *timeStamp)
+{
+    *actualDataSize = 0;
+    if (data == nullptr || channelIDs == nullptr || channelsCount <= 0)
+        return AO::eAO_BAD_ARG;
+
+    // A call reads one stream, like the SDK aligns channels of the same rate
+    ReplayStream *stream = channelLocations[channelIDs[0]].stream;
+    for (int ch = 0; ch < channelsCount; ch++)
+    {
+        if (stream == nullptr || channelLocations[channelIDs[ch]].stream != stream)
+            return AO::eAO_BAD_ARG;
+    }
+
+    const RawCaptureBlock *block = stream->getBlock();
+    if (block == nullptr)
+        return AO::eAO_MEM_EMPTY;
+
+    // Blocks are returned no further than where they end, so recorded timestamp jumps are kept
+    int64 numberOfSamples = jmin<int64>(dataCapacity / channelsCount, block->numberOfSamplesPerChannel - stream->blockSamplesRead);
+    if (settings.speed > 0)
+    {
+        const int64 due = (int64)((getTimeNs() - clearTimeNs) / 1e9 * settings.speed * stream->header->samplingRate);
+        const int64 position = block->firstSampleNumber + stream->blockSamplesRead - stream->originSampleNumber;
+        numberOfSamples = jmin(numberOfSamples, due - position);
+    }
+    if (numberOfSamples <= 0)
+        return AO::eAO_MEM_EMPTY;
+
+    // Channels the plugin did not fetch read as the zeros it delivered for them
+    for (int ch = 0; ch < channelsCount; ch++)
+    {
+        const int16 *samples = stream->getBlockChannel(block, channelLocations[channelIDs[ch]].row);
+        if (samples != nullptr)
+            memcpy(data + ch * numberOfSamples, samples + stream->blockSamplesRead, (size_t)numberOfSamples * sizeof(int16));
+        else
+            std::fill(data + ch * numberOfSamples, data + (ch + 1) * numberOfSamples, (int16)0);
+    }
+
+    *timeStamp = (AO::ULONG)(uint32)(block->deviceTimeStamp + (int64)std::llround(stream->blockSamplesRead * stream->ticksPerSample));
+    stream->advance((int)numberOfSamples);
+
+    *actualDataSize = (int)(numberOfSamples * channelsCount);
+    return AO::eAO_OK;
+}
+
+int ReplaySource::getDriveDepth(AO::int32 *depthUm)
+{
+    // Captures hold no drive depth
+    return AO::eAO_FAIL;
+}
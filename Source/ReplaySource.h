@@ -0,0 +1,93 @@
+/*
+	------------------------------------------------------------------
+
+	This file is part of the Open Ephys GUI
+	Copyright (C) 2020 Open Ephys
+
+	------------------------------------------------------------------
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef __REPLAYSOURCE_H__
+#define __REPLAYSOURCE_H__
+
+#include <DataThreadHeaders.h>
+
+#include "SampleSource.h"
+
+namespace AONode
+{
+	/**
+		Plays back the .aoraw files a raw capture wrote, one per stream, as if
+		they came from the device.
+
+		Files are memory mapped and read sequentially, with the kernel asked to
+		read ahead of the cursor. The channel list, channel names, block
+		boundaries and device timestamps are the recorded ones, so recorded
+		gaps show up again, and channels a block was not fetched with read
+		as zeros. Every acquisition starts from the beginning of the capture;
+		once it is over the source stays empty.
+
+		getAlignedData calls for different streams may run concurrently.
+	*/
+	class ReplaySource : public SampleSource
+	{
+	public:
+		struct Settings
+		{
+			/** Folder holding the .aoraw files of one acquisition */
+			File folder;
+			/** Multiple of real time, 0 returns a full buffer on every call */
+			double speed = 1.0;
+		};
+
+		/** Settings from NEUROOMEGA_REPLAY (the folder) and NEUROOMEGA_REPLAY_SPEED */
+		static Settings getSettingsFromEnvironment();
+
+		ReplaySource(const Settings &settings);
+		~ReplaySource();
+
+		SampleSourceType getType() const override { return SampleSourceType::REPLAY; }
+
+		bool isConnected() override { return streams.size() > 0; }
+		int getChannelsCount(AO::uint32 *channelsCount) override;
+		int getAllChannels(AO::SInformation *channelsInfo, int channelsCount) override;
+		int addBufferChannel(int channelID, int bufferingSizeMs) override;
+		int clearBuffers() override;
+		int getAlignedData(AO::int16 *data, int dataCapacity, int *actualDataSize, int *channelIDs, int channelsCount, AO::ULONG *timeStamp) override;
+		int getDriveDepth(AO::int32 *depthUm) override;
+
+	private:
+		class ReplayStream;
+
+		/** Where a channel is in the capture */
+		struct ChannelLocation
+		{
+			ReplayStream *stream = nullptr;
+			int row = 0;
+		};
+
+		Settings settings;
+		OwnedArray<ReplayStream> streams;
+		HashMap<int, ChannelLocation> channelLocations;
+
+		int64 clearTimeNs;
+
+		JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(ReplaySource);
+	};
+}
+
+#endif // __REPLAYSOURCE_H__
@@ -0,0 +1,336 @@
+/*
+    ------------------------------------------------------------------
+
+    This file is part of the Open Ephys GUI
+    Copyright (C) 2016 Open Ephys
+
+    ------------------------------------------------------------------
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include "SampleConversion.h"
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define AO_CONVERSION_X86 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define AO_TARGET(isa)
+#else
+#define AO_TARGET(isa) __attribute__((target(isa)))
+#endif
+#else
+#define AO_CONVERSION_X86 0
+#endif
+
+using namespace AONode;
+
+// Reference loop, also used for the channels and samples that do not fill a whole tile
+static void deinterleaveAndScaleScalar(const int16_t *src, float *dst, int numberOfChannels, int numberOfSamplesPerChannel, float bitVolts,
+                                       int firstChannel, int lastChannel, int firstSample)
+{
+    // Single channel streams need no transpose, a plain loop lets the compiler vectorize it
+    if (numberOfChannels == 1 && firstChannel == 0 && lastChannel == 1)
+    {
+        for (int samp = firstSample; samp < numberOfSamplesPerChannel; samp++)
+            dst[samp] = src[samp] * bitVolts;
+        return;
+    }
+
+    for (int samp = firstSample; samp < numberOfSamplesPerChannel; samp++)
+        for (int chan = firstChannel; chan < lastChannel; chan++)
+            dst[samp * numberOfChannels + chan] = src[chan * numberOfSamplesPerChannel + samp] * bitVolts;
+}
+
+#if AO_CONVERSION_X86
+
+// Each kernel transposes square tiles of channels x samples and returns the first channel it did not handle
+
+AO_TARGET("sse2")
+static int deinterleaveAndScaleSSE2(const int16_t *src, float *dst, int numberOfChannels, int numberOfSamplesPerChannel, float bitVolts, int firstChannel)
+{
+    const __m128 scale = _mm_set1_ps(bitVolts);
+    int chan = firstChannel;
+    for (; chan + 4 <= numberOfChannels; chan += 4)
+    {
+        int samp = 0;
+        for (; samp + 4 <= numberOfSamplesPerChannel; samp += 4)
+        {
+            __m128 r[4];
+            for (int i = 0; i < 4; i++)
+            {
+                __m128i s = _mm_loadl_epi64((const __m128i *)(src + (chan + i) * numberOfSamplesPerChannel + samp));
+                s = _mm_srai_epi32(_mm_unpacklo_epi16(s, s), 16);
+                r[i] = _mm_mul_ps(_mm_cvtepi32_ps(s), scale);
+            }
+            _MM_TRANSPOSE4_PS(r[0], r[1], r[2], r[3]);
+            for (int i = 0; i < 4; i++)
+                _mm_storeu_ps(dst + (samp + i) * numberOfChannels + chan, r[i]);
+        }
+        deinterleaveAndScaleScalar(src, dst, numberOfChannels, numberOfSamplesPerChannel, bitVolts, chan, chan + 4, samp);
+    }
+    return chan;
+}
+
+AO_TARGET("avx2")
+static int deinterleaveAndScaleAVX2(const int16_t *src, float *dst, int numberOfChannels, int numberOfSamplesPerChannel, float bitVolts, int firstChannel)
+{
+    const __m256 scale = _mm256_set1_ps(bitVolts);
+    int chan = firstChannel;
+    for (; chan + 8 <= numberOfChannels; chan += 8)
+    {
+        int samp = 0;
+        for (; samp + 8 <= numberOfSamplesPerChannel; samp += 8)
+        {
+            __m256 r[8], t[8], u[8];
+            for (int i = 0; i < 8; i++)
+            {
+                __m128i s = _mm_loadu_si128((const __m128i *)(src + (chan + i) * numberOfSamplesPerChannel + samp));
+                r[i] = _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(s)), scale);
+            }
+            for (int i = 0; i < 8; i += 2)
+            {
+                t[i] = _mm256_unpacklo_ps(r[i], r[i + 1]);
+                t[i + 1] = _mm256_unpackhi_ps(r[i], r[i + 1]);
+            }
+            for (int i = 0; i < 8; i += 4)
+            {
+                u[i] = _mm256_shuffle_ps(t[i], t[i + 2], _MM_SHUFFLE(1, 0, 1, 0));
+                u[i + 1] = _mm256_shuffle_ps(t[i], t[i + 2], _MM_SHUFFLE(3, 2, 3, 2));
+                u[i + 2] = _mm256_shuffle_ps(t[i + 1], t[i + 3], _MM_SHUFFLE(1, 0, 1, 0));
+                u[i + 3] = _mm256_shuffle_ps(t[i + 1], t[i + 3], _MM_SHUFFLE(3, 2, 3, 2));
+            }
+            for (int i = 0; i < 4; i++)
+            {
+                _mm256_storeu_ps(dst + (samp + i) * numberOfChannels + chan, _mm256_permute2f128_ps(u[i], u[i + 4], 0x20));
+                _mm256_storeu_ps(dst + (samp + i + 4) * numberOfChannels + chan, _mm256_permute2f128_ps(u[i], u[i + 4], 0x31));
+            }
+        }
+        deinterleaveAndScaleScalar(src, dst, numberOfChannels, numberOfSamplesPerChannel, bitVolts, chan, chan + 8, samp);
+    }
+    return chan;
+}
+
+AO_TARGET("avx512f")
+static int deinterleaveAndScaleAVX512(const int16_t *src, float *dst, int numberOfChannels, int numberOfSamplesPerChannel, float bitVolts, int firstChannel)
+{
+    // The maskz forms with every lane set compile to the plain instructions, the unmasked intrinsics
+    // pass an undefined vector through that GCC reports as maybe uninitialized under -Wall
+    const __mmask16 all = 0xFFFF;
+    const __m512 scale = _mm512_set1_ps(bitVolts);
+    int chan = firstChannel;
+    for (; chan + 16 <= numberOfChannels; chan += 16)
+    {
+        int samp = 0;
+        for (; samp + 16 <= numberOfSamplesPerChannel; samp += 16)
+        {
+            __m512 r[16], t[16];
+            for (int i = 0; i < 16; i++)
+            {
+                __m256i s = _mm256_loadu_si256((const __m256i *)(src + (chan + i) * numberOfSamplesPerChannel + samp));
+                r[i] = _mm512_maskz_mul_ps(all, _mm512_maskz_cvtepi32_ps(all, _mm512_maskz_cvtepi16_epi32(all, s)), scale);
+            }
+            for (int i = 0; i < 16; i += 2)
+            {
+                t[i] = _mm512_maskz_unpacklo_ps(all, r[i], r[i + 1]);
+                t[i + 1] = _mm512_maskz_unpackhi_ps(all, r[i], r[i + 1]);
+            }
+            for (int i = 0; i < 16; i += 4)
+            {
+                r[i] = _mm512_maskz_shuffle_ps(all, t[i], t[i + 2], _MM_SHUFFLE(1, 0, 1, 0));
+                r[i + 1] = _mm512_maskz_shuffle_ps(all, t[i], t[i + 2], _MM_SHUFFLE(3, 2, 3, 2));
+                r[i + 2] = _mm512_maskz_shuffle_ps(all, t[i + 1], t[i + 3], _MM_SHUFFLE(1, 0, 1, 0));
+                r[i + 3] = _mm512_maskz_shuffle_ps(all, t[i + 1], t[i + 3], _MM_SHUFFLE(3, 2, 3, 2));
+            }
+            // r[4k + j] now holds sample j (and j + 4, 8, 12 in the other 128-bit lanes) of channels 4k..4k+3
+            for (int i = 0; i < 4; i++)
+            {
+                t[i] = _mm512_maskz_shuffle_f32x4(all, r[i], r[i + 4], 0x88);
+                t[i + 4] = _mm512_maskz_shuffle_f32x4(all, r[i], r[i + 4], 0xDD);
+                t[i + 8] = _mm512_maskz_shuffle_f32x4(all, r[i + 8], r[i + 12], 0x88);
+                t[i + 12] = _mm512_maskz_shuffle_f32x4(all, r[i + 8], r[i + 12], 0xDD);
+            }
+            for (int i = 0; i < 8; i++)
+            {
+                r[i] = _mm512_maskz_shuffle_f32x4(all, t[i], t[i + 8], 0x88);
+                r[i + 8] = _mm512_maskz_shuffle_f32x4(all, t[i], t[i + 8], 0xDD);
+            }
+            for (int i = 0; i < 16; i++)
+                _mm512_storeu_ps(dst + (samp + i) * numberOfChannels + chan, r[i]);
+        }
+        deinterleaveAndScaleScalar(src, dst, numberOfChannels, numberOfSamplesPerChannel, bitVolts, chan, chan + 16, samp);
+    }
+    return chan;
+}
+
+static int countTrailingZeros(uint32_t mask)
+{
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward(&index, mask);
+    return (int)index;
+#else
+    return __builtin_ctz(mask);
+#endif
+}
+
+// equalBytes has two bits per word, set where the word equals the one before it
+static int appendChangedWords(uint32_t equalBytes, uint32_t allEqual, int firstWord, int *positions, int numberOfChanges)
+{
+    uint32_t changed = ~equalBytes & allEqual;
+    while (changed != 0)
+    {
+        const int bit = countTrailingZeros(changed);
+        positions[numberOfChanges++] = firstWord + bit / 2;
+        changed &= ~(3u << bit);
+    }
+    return numberOfChanges;
+}
+
+// Each kernel compares whole vectors of words with the same vector shifted by one and returns the first word it did not handle
+
+AO_TARGET("sse2")
+static int findChangedWordsSSE2(const int16_t *words, int numberOfWords, int firstWord, int *positions, int *numberOfChanges)
+{
+    int i = firstWord;
+    for (; i + 8 <= numberOfWords; i += 8)
+    {
+        const __m128i current = _mm_loadu_si128((const __m128i *)(words + i));
+        const __m128i previous = _mm_loadu_si128((const __m128i *)(words + i - 1));
+        const uint32_t equalBytes = (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi16(current, previous));
+        if (equalBytes != 0xFFFF)
+            *numberOfChanges = appendChangedWords(equalBytes, 0xFFFF, i, positions, *numberOfChanges);
+    }
+    return i;
+}
+
+AO_TARGET("avx2")
+static int findChangedWordsAVX2(const int16_t *words, int numberOfWords, int firstWord, int *positions, int *numberOfChanges)
+{
+    int i = firstWord;
+    for (; i + 16 <= numberOfWords; i += 16)
+    {
+        const __m256i current = _mm256_loadu_si256((const __m256i *)(words + i));
+        const __m256i previous = _mm256_loadu_si256((const __m256i *)(words + i - 1));
+        const uint32_t equalBytes = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi16(current, previous));
+        if (equalBytes != 0xFFFFFFFF)
+            *numberOfChanges = appendChangedWords(equalBytes, 0xFFFFFFFF, i, positions, *numberOfChanges);
+    }
+    return i;
+}
+
+static ConversionKernel detectConversionKernel()
+{
+#ifdef _MSC_VER
+    int info[4];
+    __cpuid(info, 0);
+    const int maxLeaf = info[0];
+    __cpuid(info, 1);
+    const bool osSavesAVX = (info[2] & (1 << 27)) && (info[2] & (1 << 28)) && ((_xgetbv(0) & 0x6) == 0x6);
+    if (maxLeaf >= 7 && osSavesAVX)
+    {
+        __cpuidex(info, 7, 0);
+        if ((info[1] & (1 << 16)) && ((_xgetbv(0) & 0xE6) == 0xE6))
+            return ConversionKernel::AVX512;
+        if (info[1] & (1 << 5))
+            return ConversionKernel::AVX2;
+    }
+    return ConversionKernel::SSE2;
+#else
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f"))
+        return ConversionKernel::AVX512;
+    if (__builtin_cpu_supports("avx2"))
+        return ConversionKernel::AVX2;
+    if (__builtin_cpu_supports("sse2"))
+        return ConversionKernel::SSE2;
+    return ConversionKernel::SCALAR;
+#endif
+}
+
+#else
+
+static ConversionKernel detectConversionKernel()
+{
+    return ConversionKernel::SCALAR;
+}
+
+#endif
+
+ConversionKernel AONode::getBestConversionKernel()
+{
+    static const ConversionKernel bestKernel = detectConversionKernel();
+    return bestKernel;
+}
+
+void AONode::deinterleaveAndScale(ConversionKernel kernel, const int16_t *src, float *dst, int numberOfChannels, int numberOfSamplesPerChannel, float bitVolts)
+{
+    int chan = 0;
+
+    if (kernel > getBestConversionKernel())
+        kernel = getBestConversionKernel();
+
+#if AO_CONVERSION_X86
+    // Wide tiles first, the channels left over go to the narrower kernels
+    if (kernel >= ConversionKernel::AVX512)
+        chan = deinterleaveAndScaleAVX512(src, dst, numberOfChannels, numberOfSamplesPerChannel, bitVolts, chan);
+    if (kernel >= ConversionKernel::AVX2)
+        chan = deinterleaveAndScaleAVX2(src, dst, numberOfChannels, numberOfSamplesPerChannel, bitVolts, chan);
+    if (kernel >= ConversionKernel::SSE2)
+        chan = deinterleaveAndScaleSSE2(src, dst, numberOfChannels, numberOfSamplesPerChannel, bitVolts, chan);
+#endif
+
+    deinterleaveAndScaleScalar(src, dst, numberOfChannels, numberOfSamplesPerChannel, bitVolts, chan, numberOfChannels, 0);
+}
+
+void AONode::deinterleaveAndScale(const int16_t *src, float *dst, int numberOfChannels, int numberOfSamplesPerChannel, float bitVolts)
+{
+    deinterleaveAndScale(getBestConversionKernel(), src, dst, numberOfChannels, numberOfSamplesPerChannel, bitVolts);
+}
+
+int AONode::findChangedWords(ConversionKernel kernel, const int16_t *words, int numberOfWords, int16_t previousWord, int *positions)
+{
+    if (numberOfWords <= 0)
+        return 0;
+
+    int numberOfChanges = 0;
+    if (words[0] != previousWord)
+        positions[numberOfChanges++] = 0;
+
+    if (kernel > getBestConversionKernel())
+        kernel = getBestConversionKernel();
+
+    // Word 0 is done, every vector load below also reads the word before it
+    int i = 1;
+#if AO_CONVERSION_X86
+    if (kernel >= ConversionKernel::AVX2)
+        i = findChangedWordsAVX2(words, numberOfWords, i, positions, &numberOfChanges);
+    if (kernel >= ConversionKernel::SSE2)
+        i = findChangedWordsSSE2(words, numberOfWords, i, positions, &numberOfChanges);
+#endif
+
+    for (; i < numberOfWords; i++)
+    {
+        if (words[i] != words[i - 1])
+            positions[numberOfChanges++] = i;
+    }
+    return numberOfChanges;
+}
+
+int AONode::findChangedWords(const int16_t *words, int numberOfWords, int16_t previousWord, int *positions)
+{
+    return findChangedWords(getBestConversionKernel(), words, numberOfWords, previousWord, positions);
+}
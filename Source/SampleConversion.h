@@ -0,0 +1,68 @@
+/*
+	------------------------------------------------------------------
+
+	This file is part of the Open Ephys GUI
+	Copyright (C) 2020 Open Ephys
+
+	------------------------------------------------------------------
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __SAMPLECONVERSION_H__
+#define __SAMPLECONVERSION_H__
+
+#include <stdint.h>
+
+namespace AONode
+{
+	/** Instruction sets the conversion kernel can run on */
+	enum class ConversionKernel
+	{
+		SCALAR,
+		SSE2,
+		AVX2,
+		AVX512
+	};
+
+	/**
+		Converts a channel-major AO block (src[chan * numberOfSamplesPerChannel + samp])
+		into the sample-major float layout DataBuffer expects (dst[samp * numberOfChannels + chan]),
+		multiplying every sample by bitVolts.
+
+		The widest kernel supported by the CPU is picked on first use. Every kernel
+		gives bit-identical results to the scalar loop.
+	*/
+	void deinterleaveAndScale(const int16_t *src, float *dst, int numberOfChannels, int numberOfSamplesPerChannel, float bitVolts);
+
+	/** Same as deinterleaveAndScale, forcing a given kernel (falls back to narrower ones the CPU lacks) */
+	void deinterleaveAndScale(ConversionKernel kernel, const int16_t *src, float *dst, int numberOfChannels, int numberOfSamplesPerChannel, float bitVolts);
+
+	/**
+		Writes to positions the indices i at which words[i] differs from words[i - 1],
+		or from previousWord for i = 0, and returns how many there are.
+
+		positions must have room for numberOfWords entries. Runs of identical
+		words, the usual case for digital inputs, are skipped a vector at a time.
+	*/
+	int findChangedWords(const int16_t *words, int numberOfWords, int16_t previousWord, int *positions);
+
+	/** Same as findChangedWords, forcing a given kernel (falls back to narrower ones the CPU lacks) */
+	int findChangedWords(ConversionKernel kernel, const int16_t *words, int numberOfWords, int16_t previousWord, int *positions);
+
+	/** Widest kernel the running CPU supports */
+	ConversionKernel getBestConversionKernel();
+}
+
+#endif // __SAMPLECONVERSION_H__
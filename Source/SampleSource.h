@@ -0,0 +1,96 @@
+/*
+	------------------------------------------------------------------
+
+	This file is part of the Open Ephys GUI
+	Copyright (C) 2020 Open Ephys
+
+	------------------------------------------------------------------
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef __SAMPLESOURCE_H__
+#define __SAMPLESOURCE_H__
+
+// AlphaOmega SDK
+namespace AO
+{
+#include "AOTypes.h"
+#include "AOSystemAPI.h"
+#include "StreamFormat.h"
+}
+
+namespace AONode
+{
+	/** Where DeviceThread gets its samples from, values match the editor selector IDs */
+	enum class SampleSourceType
+	{
+		NEURO_OMEGA = 1,
+		SYNTHETIC,
+		REPLAY
+	};
+
+	/**
+		The part of the AlphaOmega SDK the acquisition path uses.
+
+		Calls take the same arguments and return the same AO::EAOResult codes
+		as their SDK counterparts. getAlignedData may be called concurrently
+		for different streams.
+	*/
+	class SampleSource
+	{
+	public:
+		virtual ~SampleSource() {}
+
+		virtual SampleSourceType getType() const = 0;
+
+		virtual bool isConnected() = 0;
+		virtual int getChannelsCount(AO::uint32 *channelsCount) = 0;
+		virtual int getAllChannels(AO::SInformation *channelsInfo, int channelsCount) = 0;
+		virtual int addBufferChannel(int channelID, int bufferingSizeMs) = 0;
+		virtual int clearBuffers() = 0;
+		virtual int getAlignedData(AO::int16 *data, int dataCapacity, int *actualDataSize, int *channelIDs, int channelsCount, AO::ULONG *timeStamp) = 0;
+		virtual int getDriveDepth(AO::int32 *depthUm) = 0;
+	};
+
+	/** Forwards to the AlphaOmega SDK, connected by DeviceThread */
+	class NeuroOmegaSource : public SampleSource
+	{
+	public:
+		SampleSourceType getType() const override { return SampleSourceType::NEURO_OMEGA; }
+
+		bool isConnected() override { return AO::isConnected() == AO::eAO_CONNECTED; }
+
+		int getChannelsCount(AO::uint32 *channelsCount) override { return AO::GetChannelsCount(channelsCount); }
+
+		int getAllChannels(AO::SInformation *channelsInfo, int channelsCount) override
+		{
+			return AO::GetAllChannels(channelsInfo, channelsCount);
+		}
+
+		int addBufferChannel(int channelID, int bufferingSizeMs) override { return AO::AddBufferChannel(channelID, bufferingSizeMs); }
+
+		int clearBuffers() override { return AO::ClearBuffers(); }
+
+		int getAlignedData(AO::int16 *data, int dataCapacity, int *actualDataSize, int *channelIDs, int channelsCount, AO::ULONG *timeStamp) override
+		{
+			return AO::GetAlignedData(data, dataCapacity, actualDataSize, channelIDs, channelsCount, timeStamp);
+		}
+
+		int getDriveDepth(AO::int32 *depthUm) override { return AO::GetDriveDepth(depthUm); }
+	};
+}
+
+#endif // __SAMPLESOURCE_H__
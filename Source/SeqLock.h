@@ -0,0 +1,102 @@
+/*
+	------------------------------------------------------------------
+
+	This file is part of the Open Ephys GUI
+	Copyright (C) 2020 Open Ephys
+
+	------------------------------------------------------------------
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __SEQLOCK_H__
+#define __SEQLOCK_H__
+
+#include <algorithm>
+#include <atomic>
+#include <stdint.h>
+#include <string.h>
+#include <type_traits>
+
+namespace AONode
+{
+	/**
+		Holds the latest value of a trivially copyable type for one writer and
+		any number of readers.
+
+		A sequence lock: the writer never waits and readers only retry while a
+		write is in progress, so neither side takes a lock or allocates. The
+		value is copied through relaxed atomic words, so a torn read is never
+		a data race, only a retry.
+	*/
+	template <typename ValueType>
+	class SeqLockSlot
+	{
+		static_assert(std::is_trivially_copyable<ValueType>::value, "SeqLockSlot copies values word by word");
+
+	public:
+		/** Writer only */
+		void publish(const ValueType &value)
+		{
+			const uint32_t version = sequence.load(std::memory_order_relaxed);
+			sequence.store(version + 1, std::memory_order_relaxed);
+			std::atomic_thread_fence(std::memory_order_release);
+
+			const char *bytes = reinterpret_cast<const char *>(&value);
+			for (int i = 0; i < NUMBER_OF_WORDS; i++)
+			{
+				uint64_t word = 0;
+				memcpy(&word, bytes + i * sizeof(uint64_t), getWordSize(i));
+				words[i].store(word, std::memory_order_relaxed);
+			}
+
+			sequence.store(version + 2, std::memory_order_release);
+		}
+
+		/** Any thread, returns a value-initialised ValueType until the first publish */
+		ValueType read() const
+		{
+			ValueType value{};
+			char *bytes = reinterpret_cast<char *>(&value);
+			for (;;)
+			{
+				const uint32_t before = sequence.load(std::memory_order_acquire);
+				if (before == 0)
+					return ValueType{};
+
+				for (int i = 0; i < NUMBER_OF_WORDS; i++)
+				{
+					const uint64_t word = words[i].load(std::memory_order_relaxed);
+					memcpy(bytes + i * sizeof(uint64_t), &word, getWordSize(i));
+				}
+				std::atomic_thread_fence(std::memory_order_acquire);
+				if ((before & 1) == 0 && sequence.load(std::memory_order_relaxed) == before)
+					return value;
+			}
+		}
+
+	private:
+		static const int NUMBER_OF_WORDS = (int)((sizeof(ValueType) + sizeof(uint64_t) - 1) / sizeof(uint64_t));
+
+		static size_t getWordSize(int i)
+		{
+			return std::min(sizeof(uint64_t), sizeof(ValueType) - i * sizeof(uint64_t));
+		}
+
+		std::atomic<uint32_t> sequence{0};
+		std::atomic<uint64_t> words[NUMBER_OF_WORDS] = {};
+	};
+}
+
+#endif // __SEQLOCK_H__
@@ -0,0 +1,116 @@
+/*
+	------------------------------------------------------------------
+
+	This file is part of the Open Ephys GUI
+	Copyright (C) 2020 Open Ephys
+
+	------------------------------------------------------------------
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __SPSCRING_H__
+#define __SPSCRING_H__
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <stdint.h>
+#include <string.h>
+
+namespace AONode
+{
+	/**
+		Lock-free ring buffer for exactly one producer thread and one consumer thread.
+
+		Pushes and pops are all-or-nothing copies of trivially copyable elements.
+		Everything the producer wrote before a push is visible to the consumer
+		once it sees the pushed elements, so a second ring can carry headers
+		describing the data of the first.
+	*/
+	template <typename ElementType>
+	class SpscRing
+	{
+	public:
+		/** The capacity is rounded up to a power of two */
+		explicit SpscRing(int minimumCapacity)
+		{
+			capacity = 2;
+			while (capacity < minimumCapacity)
+				capacity *= 2;
+			mask = capacity - 1;
+			buffer.reset(new ElementType[capacity]());
+		}
+
+		SpscRing(const SpscRing &) = delete;
+		SpscRing &operator=(const SpscRing &) = delete;
+
+		int getCapacity() const { return capacity; }
+
+		/** Producer: number of elements that can be pushed */
+		int getFreeSpace() const
+		{
+			return capacity - (int)(writeIndex.load(std::memory_order_relaxed) - readIndex.load(std::memory_order_acquire));
+		}
+
+		/** Producer: copies numItems elements in, or nothing if they do not fit */
+		bool push(const ElementType *items, int numItems)
+		{
+			const uint64_t write = writeIndex.load(std::memory_order_relaxed);
+			if (numItems > capacity - (int)(write - readIndex.load(std::memory_order_acquire)))
+				return false;
+
+			const int start = (int)(write & mask);
+			const int firstPart = std::min(numItems, capacity - start);
+			memcpy(buffer.get() + start, items, firstPart * sizeof(ElementType));
+			memcpy(buffer.get(), items + firstPart, (numItems - firstPart) * sizeof(ElementType));
+
+			writeIndex.store(write + numItems, std::memory_order_release);
+			return true;
+		}
+
+		/** Consumer: number of elements that can be popped */
+		int getNumReady() const
+		{
+			return (int)(writeIndex.load(std::memory_order_acquire) - readIndex.load(std::memory_order_relaxed));
+		}
+
+		/** Consumer: copies numItems elements out, or nothing if fewer are ready */
+		bool pop(ElementType *destination, int numItems)
+		{
+			const uint64_t read = readIndex.load(std::memory_order_relaxed);
+			if (numItems > (int)(writeIndex.load(std::memory_order_acquire) - read))
+				return false;
+
+			const int start = (int)(read & mask);
+			const int firstPart = std::min(numItems, capacity - start);
+			memcpy(destination, buffer.get() + start, firstPart * sizeof(ElementType));
+			memcpy(destination + firstPart, buffer.get(), (numItems - firstPart) * sizeof(ElementType));
+
+			readIndex.store(read + numItems, std::memory_order_release);
+			return true;
+		}
+
+	private:
+		std::unique_ptr<ElementType[]> buffer;
+		int capacity;
+		int mask;
+
+		// Kept on separate cache lines so producer and consumer do not false-share
+		alignas(64) std::atomic<uint64_t> writeIndex{0};
+		alignas(64) std::atomic<uint64_t> readIndex{0};
+	};
+}
+
+#endif // __SPSCRING_H__
@@ -0,0 +1,131 @@
+/*
+    ------------------------------------------------------------------
+
+    This file is part of the Open Ephys GUI
+    Copyright (C) 2016 Open Ephys
+
+    ------------------------------------------------------------------
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include "StreamReader.h"
+#include "CpuTime.h"
+
+using namespace AONode;
+
+// Enough room for the data thread to fall behind by a few hundred milliseconds
+#define RING_FETCHES 8
+#define RING_BLOCKS 256
+
+StreamReader::StreamReader(SampleSource &source_, const StreamPlan &stream_, const LiveFetchPlan &fetchPlan_, int fetchCapacity_, PollWaitStrategy &waitStrategy_, StreamCounters &counters_, DataReadyEvent &dataReady_)
+    : source(source_),
+      stream(stream_),
+      fetchPlan(fetchPlan_),
+      fetchAligner(source_, stream_, counters_),
+      fetchCapacity(fetchCapacity_),
+      sampleRing(fetchCapacity_ * RING_FETCHES),
+      blockRing(RING_BLOCKS),
+      waitStrategy(waitStrategy_),
+      counters(counters_),
+      dataReady(dataReady_)
+{
+    fetchBuffer.reset(new AO::int16[fetchCapacity]);
+}
+
+StreamReader::~StreamReader()
+{
+    stopThread();
+}
+
+void StreamReader::startThread()
+{
+    exitRequested.store(false, std::memory_order_relaxed);
+    thread = std::thread([this]
+                         { run(); });
+}
+
+void StreamReader::stopThread()
+{
+    signalThreadShouldExit();
+    if (thread.joinable())
+        thread.join();
+}
+
+void StreamReader::run()
+{
+    readBlocks();
+    cpuTimeNs.store(getThreadCpuTimeNs(), std::memory_order_release);
+}
+
+void StreamReader::readBlocks()
+{
+    int emptyPolls = 0;
+    BlockHeader header;
+
+    waitStrategy.waitForNextBlock(stream);
+    while (!threadShouldExit())
+    {
+        header.numberOfItems = 0;
+        header.fetch = &fetchAligner.getFetch(fetchPlan.get()->streams[stream.sourceBufferIdx], fetchBuffer.get(), fetchCapacity);
+        const int capacity = fetchCapacity / stream.numberOfChannels * header.fetch->getNumberOfChannels();
+        const int64_t fetchStartNs = getTimeNs();
+        // The SDK only reads the channel IDs
+        int status = source.getAlignedData(fetchBuffer.get(), capacity, &header.numberOfItems, const_cast<int *>(header.fetch->channelIDs.data()), header.fetch->getNumberOfChannels(), &header.timeStamp);
+        if (status != AO::eAO_OK && status != AO::eAO_MEM_EMPTY)
+        {
+            // Whatever a failed call left in the buffer is not a block
+            StreamCounters::increment(counters.sdkErrors);
+            waitStrategy.waitAfterError(stream);
+            continue;
+        }
+        if (status == AO::eAO_MEM_EMPTY || header.numberOfItems == 0)
+        {
+            waitStrategy.waitAfterEmptyPoll(stream, emptyPolls++);
+            continue;
+        }
+        header.arrivalNs = getTimeNs();
+        header.fetchNs = header.arrivalNs - fetchStartNs;
+        fetchAligner.blockFetched(header.timeStamp, header.numberOfItems / header.fetch->getNumberOfChannels());
+        emptyPolls = 0;
+        waitStrategy.blockReceived(stream);
+
+        // Back-pressure: the SDK keeps buffering while the data thread catches up
+        while (sampleRing.getFreeSpace() < header.numberOfItems || blockRing.getFreeSpace() < 1)
+        {
+            ringFullStalls.fetch_add(1, std::memory_order_relaxed);
+            if (threadShouldExit())
+                return;
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+
+        sampleRing.push(fetchBuffer.get(), header.numberOfItems);
+        blockRing.push(&header, 1);
+        dataReady.signal();
+
+        // A full fetch means the SDK has more buffered, read it right away
+        if (header.numberOfItems < capacity)
+            waitStrategy.waitForNextBlock(stream);
+    }
+}
+
+int StreamReader::popBlock(AO::int16 *destination, BlockHeader &header)
+{
+    if (!blockRing.pop(&header, 1))
+        return 0;
+
+    sampleRing.pop(destination, header.numberOfItems);
+    return header.numberOfItems;
+}
@@ -0,0 +1,153 @@
+/*
+	------------------------------------------------------------------
+
+	This file is part of the Open Ephys GUI
+	Copyright (C) 2020 Open Ephys
+
+	------------------------------------------------------------------
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __STREAMREADER_H__
+#define __STREAMREADER_H__
+
+#include "AcquisitionCounters.h"
+#include "AcquisitionPlan.h"
+#include "FetchAligner.h"
+#include "FetchPlan.h"
+#include "PollWaitStrategy.h"
+#include "SampleSource.h"
+#include "SpscRing.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+namespace AONode
+{
+	/** Lets the stream readers wake the thread draining them, like an auto-reset event */
+	class DataReadyEvent
+	{
+	public:
+		DataReadyEvent() {}
+		DataReadyEvent(const DataReadyEvent &) = delete;
+		DataReadyEvent &operator=(const DataReadyEvent &) = delete;
+
+		void signal()
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			signalled = true;
+			condition.notify_one();
+		}
+
+		/** Returns once signalled or after timeoutMs, and clears the signal */
+		void wait(int timeoutMs)
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			condition.wait_for(lock, std::chrono::milliseconds(timeoutMs), [this]
+							   { return signalled; });
+			signalled = false;
+		}
+
+	private:
+		std::mutex mutex;
+		std::condition_variable condition;
+		bool signalled = false;
+	};
+
+	/**
+		Reads one stream from the SDK on its own thread.
+
+		Blocks are copied, still channel-major int16, into a pair of SPSC rings
+		that the data thread drains with popBlock. A stream with no data only
+		keeps its own reader waiting.
+	*/
+	class StreamReader
+	{
+	public:
+		/**
+			fetchCapacity is the number of int16 items a single GetAlignedData call may return
+			with every channel of the stream, the channels read are those of fetchPlan
+		*/
+		StreamReader(SampleSource &source, const StreamPlan &stream, const LiveFetchPlan &fetchPlan, int fetchCapacity, PollWaitStrategy &waitStrategy, StreamCounters &counters, DataReadyEvent &dataReady);
+
+		/** Stops the thread if it still runs */
+		~StreamReader();
+
+		StreamReader(const StreamReader &) = delete;
+		StreamReader &operator=(const StreamReader &) = delete;
+
+		/** What the SDK returned along with the samples of a block */
+		struct BlockHeader
+		{
+			AO::ULONG timeStamp;
+			/** When the reader got the block, and how long GetAlignedData took */
+			int64_t arrivalNs;
+			int64_t fetchNs;
+			int numberOfItems;
+			/** Channels the block holds, numberOfItems counts only those */
+			const StreamFetch *fetch;
+		};
+
+		void startThread();
+
+		/** Asks the thread to return, without waiting for it */
+		void signalThreadShouldExit() { exitRequested.store(true, std::memory_order_relaxed); }
+
+		/** Asks the thread to return and waits until it has */
+		void stopThread();
+
+		/**
+			Data thread: copies the oldest block into destination (at least fetchCapacity items)
+			and returns its number of items, or 0 when no block is ready
+		*/
+		int popBlock(AO::int16 *destination, BlockHeader &header);
+
+		/** Number of times the reader had to wait because the data thread was not draining */
+		int64_t getRingFullStalls() const { return ringFullStalls.load(std::memory_order_relaxed); }
+
+		/** CPU time the reader thread used, once it has exited */
+		int64_t getCpuTimeNs() const { return cpuTimeNs.load(std::memory_order_acquire); }
+
+	private:
+		SampleSource &source;
+		StreamPlan stream;
+		const LiveFetchPlan &fetchPlan;
+		FetchAligner fetchAligner;
+		int fetchCapacity;
+		std::unique_ptr<AO::int16[]> fetchBuffer;
+
+		SpscRing<AO::int16> sampleRing;
+		SpscRing<BlockHeader> blockRing;
+
+		PollWaitStrategy &waitStrategy;
+		StreamCounters &counters;
+		DataReadyEvent &dataReady;
+		std::atomic<int64_t> ringFullStalls{0};
+		std::atomic<int64_t> cpuTimeNs{0};
+
+		std::thread thread;
+		std::atomic<bool> exitRequested{false};
+
+		bool threadShouldExit() const { return exitRequested.load(std::memory_order_relaxed); }
+		void run();
+		void readBlocks();
+	};
+}
+
+#endif // __STREAMREADER_H__
@@ -0,0 +1,97 @@
+/*
+	------------------------------------------------------------------
+
+	This file is part of the Open Ephys GUI
+	Copyright (C) 2020 Open Ephys
+
+	------------------------------------------------------------------
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __STREAMSCRATCH_H__
+#define __STREAMSCRATCH_H__
+
+#include <atomic>
+#include <memory>
+#include <stdint.h>
+
+namespace AONode
+{
+	/**
+		Per-stream arrays: the block GetAlignedData fills and the arrays
+		handed to DataBuffer::addToBuffer.
+
+		Sized once when acquisition starts and only reallocated when a
+		larger block is requested, so updateBuffer never allocates in
+		steady state. Every reallocation is counted in getNumAllocations().
+	*/
+	class StreamScratch
+	{
+	public:
+		StreamScratch() {}
+		StreamScratch(const StreamScratch &) = delete;
+		StreamScratch &operator=(const StreamScratch &) = delete;
+
+		/** Makes room for maxSamplesPerChannel samples of numberOfChannels channels */
+		void ensureSize(int numberOfChannels, int maxSamplesPerChannel)
+		{
+			if (maxSamplesPerChannel > samplesCapacity)
+			{
+				sampleCount.reset(new int64_t[maxSamplesPerChannel]);
+				timeStamps.reset(new double[maxSamplesPerChannel]);
+				eventCodes.reset(new uint64_t[maxSamplesPerChannel]);
+				samplesCapacity = maxSamplesPerChannel;
+				allocationCounter() += 3;
+			}
+
+			int numItems = numberOfChannels * maxSamplesPerChannel;
+			if (numItems > itemsCapacity)
+			{
+				sourceBufferData.reset(new float[numItems]);
+				fetchData.reset(new int16_t[numItems]);
+				itemsCapacity = numItems;
+				allocationCounter() += 2;
+			}
+			fetchCapacity = numItems;
+		}
+
+		/** Number of items GetAlignedData may write to fetchData, whole samples of every channel */
+		int getFetchCapacity() const { return fetchCapacity; }
+
+		/** Total number of arena allocations made by all streams since the plugin was loaded */
+		static int64_t getNumAllocations() { return allocationCounter().load(std::memory_order_relaxed); }
+
+		/** Channel-major, as GetAlignedData returns it */
+		std::unique_ptr<int16_t[]> fetchData;
+
+		std::unique_ptr<float[]> sourceBufferData;
+		std::unique_ptr<int64_t[]> sampleCount;
+		std::unique_ptr<double[]> timeStamps;
+		std::unique_ptr<uint64_t[]> eventCodes;
+
+	private:
+		int samplesCapacity = 0;
+		int itemsCapacity = 0;
+		int fetchCapacity = 0;
+
+		static std::atomic<int64_t> &allocationCounter()
+		{
+			static std::atomic<int64_t> counter{0};
+			return counter;
+		}
+	};
+}
+
+#endif // __STREAMSCRATCH_H__
@@ -0,0 +1,476 @@
+/*
+    ------------------------------------------------------------------
+
+    This file is part of the Open Ephys GUI
+    Copyright (C) 2016 Open Ephys
+
+    ------------------------------------------------------------------
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include "SyntheticSource.h"
+#include "AcquisitionStats.h"
+
+using namespace AONode;
+
+#define DEVICE_CLOCK_HZ 44000.0
+#define SPIKE_DURATION_MS 1.6
+#define SPIKE_REFRACTORY_MS 2.0
+// Digital line 2 pulses for this long, about once a second
+#define MARKER_PULSE_MS 10.0
+#define MARKER_PULSES_PER_SECOND 1.0
+
+namespace
+{
+    enum class SignalKind
+    {
+        LFP,
+        ECOG,
+        RAW,
+        SPK,
+        DIGITAL
+    };
+
+    struct SyntheticStream
+    {
+        const char *name;
+        bool groupedName;
+        int defaultChannels;
+        int maxChannels;
+        double samplingRate;
+        int firstChannelID;
+        SignalKind kind;
+        float microvoltsPerBit;
+    };
+
+    // Same IDs, names and rates as a Neuro Omega with one microelectrode drive and an ECOG headbox
+    const SyntheticStream SYNTHETIC_STREAMS[] = {
+        {"LFP", false, 5, 16, 1375, 10000, SignalKind::LFP, 1.9f},
+        {"Macro LFP", false, 5, 16, 1375, 10016, SignalKind::LFP, 1.9f},
+        {"RAW", false, 5, 16, 44000, 10032, SignalKind::RAW, 1.9f},
+        {"Macro RAW", false, 5, 16, 44000, 10048, SignalKind::RAW, 1.9f},
+        {"SPK", false, 5, 16, 44000, 10064, SignalKind::SPK, 1.9f},
+        {"ECOG LF 1", true, 16, 128, 1375, 10128, SignalKind::ECOG, 0.7f},
+        {"ECOG HF 1", true, 16, 128, 22000, 10256, SignalKind::ECOG, 0.7f},
+        {"Port-", false, 1, 1, 44000, 11200, SignalKind::DIGITAL, 1.0f}};
+
+    /** Amplitudes in microvolts of each part of a signal */
+    struct SignalAmplitudes
+    {
+        double background;
+        double betaBurst;
+        double lineNoise;
+        double whiteNoise;
+        double spike;
+    };
+
+    SignalAmplitudes getSignalAmplitudes(SignalKind kind)
+    {
+        switch (kind)
+        {
+        case SignalKind::LFP:
+            return {15, 25, 4, 2, 0};
+        case SignalKind::ECOG:
+            return {25, 15, 8, 3, 0};
+        case SignalKind::RAW:
+            return {15, 20, 4, 8, 100};
+        case SignalKind::SPK:
+            return {0, 0, 0.5, 6, 100};
+        }
+        return {0, 0, 0, 0, 0};
+    }
+
+    uint64 splitMix64(uint64 x)
+    {
+        x += 0x9E3779B97F4A7C15ull;
+        x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+        x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+        return x ^ (x >> 31);
+    }
+}
+
+/** One channel and the state of its signal generator */
+class SyntheticSource::SyntheticChannel
+{
+public:
+    SyntheticChannel(const SyntheticStream &stream, int index, int numberOfChannels, uint64 sourceSeed, double lineFrequency)
+        : channelID(stream.firstChannelID + index),
+          samplingRate(stream.samplingRate),
+          digital(stream.kind == SignalKind::DIGITAL),
+          amplitudes(getSignalAmplitudes(stream.kind)),
+          microvoltsPerBit(stream.microvoltsPerBit),
+          seed(splitMix64(sourceSeed ^ splitMix64((uint64)channelID)))
+    {
+        const int digits = digital ? 1 : (numberOfChannels > 99) ? 3 : 2;
+        name = String(stream.name) + (stream.groupedName ? " / " : " ") + String(index + 1).paddedLeft('0', digits);
+
+        lineStepCos = std::cos(2.0 * MathConstants<double>::pi * lineFrequency / samplingRate);
+        lineStepSin = std::sin(2.0 * MathConstants<double>::pi * lineFrequency / samplingRate);
+
+        // Negative peak then a slower positive rebound, as seen on an extracellular electrode
+        if (amplitudes.spike > 0)
+        {
+            spikeLength = (int)std::ceil(SPIKE_DURATION_MS / 1000.0 * samplingRate);
+            spikeWaveform.malloc(spikeLength);
+            for (int i = 0; i < spikeLength; i++)
+            {
+                const double ms = i * 1000.0 / samplingRate;
+                spikeWaveform[i] = (float)(-std::exp(-square(ms - 0.3) / (2 * square(0.1))) + 0.4 * std::exp(-square(ms - 0.7) / (2 * square(0.25))));
+            }
+        }
+
+        reset();
+    }
+
+    /** Restarts the generator, the same samples come out again */
+    void reset()
+    {
+        rngState = seed | 1;
+        pink[0] = pink[1] = pink[2] = 0;
+        lineCos = 1;
+        lineSin = 0;
+        lineSamples = 0;
+
+        burstLength = 0;
+        burstPosition = 0;
+        burstsPerSample = (1.0 + uniform()) / samplingRate;
+
+        spikesPerSample = (5.0 + 25.0 * uniform()) / samplingRate;
+        channelSpikeAmplitude = amplitudes.spike * (0.6 + 0.9 * uniform());
+        spikePosition = -1;
+        samplesToNextSpike = nextSpikeInterval();
+
+        wordPosition = 0;
+        markerRemaining = 0;
+        samplesToNextMarker = nextMarkerInterval();
+
+        readPosition = 0;
+    }
+
+    void generate(AO::int16 *destination, int64 numberOfSamples)
+    {
+        if (digital)
+        {
+            for (int64 samp = 0; samp < numberOfSamples; samp++)
+                destination[samp] = nextWord();
+            return;
+        }
+
+        for (int64 samp = 0; samp < numberOfSamples; samp++)
+            destination[samp] = (AO::int16)jlimit(-32768.0, 32767.0, std::round(nextMicrovolts() / microvoltsPerBit));
+    }
+
+    void skip(int64 numberOfSamples)
+    {
+        for (int64 samp = 0; samp < numberOfSamples; samp++)
+        {
+            if (digital)
+                nextWord();
+            else
+                nextMicrovolts();
+        }
+    }
+
+    int channelID;
+    String name;
+    double samplingRate;
+
+    bool buffered = false;
+    int64 bufferingSize = 0;
+    int64 readPosition = 0;
+
+private:
+    double uniform()
+    {
+        // xorshift64*
+        rngState ^= rngState >> 12;
+        rngState ^= rngState << 25;
+        rngState ^= rngState >> 27;
+        return ((rngState * 0x2545F4914F6CDD1Dull) >> 11) * (1.0 / 9007199254740992.0);
+    }
+
+    /** Zero mean, unit variance, triangular rather than normal which is enough for noise */
+    double unitNoise()
+    {
+        return (uniform() + uniform() - 1.0) * 2.449489742783178;
+    }
+
+    int64 nextSpikeInterval()
+    {
+        const int64 refractory = (int64)(SPIKE_REFRACTORY_MS / 1000.0 * samplingRate);
+        return refractory + (int64)(-std::log(1.0 - uniform()) / spikesPerSample);
+    }
+
+    int64 nextMarkerInterval()
+    {
+        return 1 + (int64)(-std::log(1.0 - uniform()) * samplingRate / MARKER_PULSES_PER_SECOND);
+    }
+
+    /** Line 1 is a 1 Hz square wave, line 2 a marker pulse at Poisson intervals */
+    AO::int16 nextWord()
+    {
+        AO::int16 word = (AO::int16)((wordPosition++ / (int64)(samplingRate / 2)) & 1);
+
+        if (markerRemaining > 0)
+        {
+            word |= 2;
+            markerRemaining--;
+        }
+        else if (--samplesToNextMarker <= 0)
+        {
+            markerRemaining = (int64)(MARKER_PULSE_MS / 1000.0 * samplingRate);
+            samplesToNextMarker = nextMarkerInterval();
+        }
+
+        return word;
+    }
+
+    double nextMicrovolts()
+    {
+        double value = amplitudes.whiteNoise * unitNoise();
+
+        if (amplitudes.background > 0)
+        {
+            // 1/f background (Paul Kellet's economy pink noise filter)
+            const double white = unitNoise();
+            pink[0] = 0.99765 * pink[0] + white * 0.0990460;
+            pink[1] = 0.96300 * pink[1] + white * 0.2965164;
+            pink[2] = 0.57000 * pink[2] + white * 1.0526913;
+            value += amplitudes.background * 0.3 * (pink[0] + pink[1] + pink[2] + white * 0.1848);
+        }
+
+        if (amplitudes.betaBurst > 0)
+        {
+            if (burstPosition < burstLength)
+            {
+                const double envelope = 0.5 - 0.5 * std::cos(2.0 * MathConstants<double>::pi * burstPosition / burstLength);
+                value += betaAmplitude * envelope * std::sin(betaPhase);
+                betaPhase += betaStep;
+                burstPosition++;
+            }
+            else if (uniform() < burstsPerSample)
+            {
+                burstLength = (int64)((0.1 + 0.3 * uniform()) * samplingRate);
+                burstPosition = 0;
+                betaPhase = 0;
+                betaStep = 2.0 * MathConstants<double>::pi * (15.0 + 15.0 * uniform()) / samplingRate;
+                betaAmplitude = amplitudes.betaBurst * (0.6 + 0.8 * uniform());
+            }
+        }
+
+        // Line noise has the same phase on every channel, the phasor is renormalized now and then
+        value += amplitudes.lineNoise * lineSin;
+        const double rotatedCos = lineCos * lineStepCos - lineSin * lineStepSin;
+        lineSin = lineSin * lineStepCos + lineCos * lineStepSin;
+        lineCos = rotatedCos;
+        if ((++lineSamples & 4095) == 0)
+        {
+            const double norm = 1.0 / std::sqrt(lineCos * lineCos + lineSin * lineSin);
+            lineCos *= norm;
+            lineSin *= norm;
+        }
+
+        if (spikeLength > 0)
+        {
+            if (spikePosition >= 0)
+            {
+                value += spikeAmplitude * spikeWaveform[spikePosition++];
+                if (spikePosition == spikeLength)
+                    spikePosition = -1;
+            }
+            if (--samplesToNextSpike <= 0)
+            {
+                spikePosition = 0;
+                spikeAmplitude = channelSpikeAmplitude * (0.85 + 0.3 * uniform());
+                samplesToNextSpike = nextSpikeInterval();
+            }
+        }
+
+        return value;
+    }
+
+    bool digital;
+    SignalAmplitudes amplitudes;
+    float microvoltsPerBit;
+    uint64 seed;
+    uint64 rngState;
+
+    double pink[3];
+
+    double lineCos, lineSin, lineStepCos, lineStepSin;
+    uint32 lineSamples = 0;
+
+    double burstsPerSample;
+    int64 burstLength, burstPosition;
+    double betaPhase = 0, betaStep = 0, betaAmplitude = 0;
+
+    HeapBlock<float> spikeWaveform;
+    int spikeLength = 0;
+    double spikesPerSample;
+    double channelSpikeAmplitude;
+    double spikeAmplitude = 0;
+    int spikePosition;
+    int64 samplesToNextSpike;
+
+    int64 wordPosition;
+    int64 markerRemaining;
+    int64 samplesToNextMarker;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(SyntheticChannel);
+};
+
+SyntheticSource::Settings SyntheticSource::getSettingsFromEnvironment()
+{
+    Settings settings;
+
+    String seed = SystemStats::getEnvironmentVariable("NEUROOMEGA_SYNTH_SEED", "");
+    if (seed.isNotEmpty())
+        settings.seed = (uint64)seed.getLargeIntValue();
+
+    String speed = SystemStats::getEnvironmentVariable("NEUROOMEGA_SYNTH_SPEED", "");
+    if (speed.isNotEmpty())
+        settings.speed = speed.getDoubleValue();
+
+    String lineFrequency = SystemStats::getEnvironmentVariable("NEUROOMEGA_SYNTH_LINE_HZ", "");
+    if (lineFrequency.isNotEmpty())
+        settings.lineFrequency = lineFrequency.getDoubleValue();
+
+    for (const String &token : StringArray::fromTokens(SystemStats::getEnvironmentVariable("NEUROOMEGA_SYNTH_CHANNELS", ""), ",", ""))
+    {
+        if (token.contains("="))
+            settings.channelCounts.set(token.upToFirstOccurrenceOf("=", false, false).trim(),
+                                       token.fromFirstOccurrenceOf("=", false, false).trim());
+    }
+
+    return settings;
+}
+
+SyntheticSource::SyntheticSource(const Settings &settings_) : settings(settings_)
+{
+    for (const SyntheticStream &stream : SYNTHETIC_STREAMS)
+    {
+        int numberOfChannels = stream.defaultChannels;
+        if (settings.channelCounts.containsKey(stream.name))
+            numberOfChannels = jlimit(0, stream.maxChannels, settings.channelCounts[stream.name].getIntValue());
+
+        for (int ch = 0; ch < numberOfChannels; ch++)
+        {
+            channels.add(new SyntheticChannel(stream, ch, numberOfChannels, settings.seed, settings.lineFrequency));
+            channelsByID.set(channels.getLast()->channelID, channels.getLast());
+        }
+    }
+
+    createTimeNs = clearTimeNs = getTimeNs();
+    LOGC("Synthetic source: ", channels.size(), " channels, seed ", (int64)settings.seed, ", speed ", settings.speed);
+}
+
+SyntheticSource::~SyntheticSource()
+{
+}
+
+int SyntheticSource::getChannelsCount(AO::uint32 *channelsCount)
+{
+    *channelsCount = (AO::uint32)channels.size();
+    return AO::eAO_OK;
+}
+
+int SyntheticSource::getAllChannels(AO::SInformation *channelsInfo, int channelsCount)
+{
+    if (channelsCount < channels.size())
+        return AO::eAO_BAD_ARG;
+
+    for (int i = 0; i < channels.size(); i++)
+    {
+        channelsInfo[i].channelID = channels[i]->channelID;
+        channels[i]->name.copyToUTF8(channelsInfo[i].channelName, sizeof(channelsInfo[i].channelName));
+    }
+    return AO::eAO_OK;
+}
+
+int SyntheticSource::addBufferChannel(int channelID, int bufferingSizeMs)
+{
+    SyntheticChannel *channel = channelsByID[channelID];
+    if (channel == nullptr)
+        return AO::eAO_BAD_ARG;
+
+    channel->buffered = true;
+    channel->bufferingSize = (int64)(bufferingSizeMs / 1000.0 * channel->samplingRate);
+    return AO::eAO_OK;
+}
+
+int SyntheticSource::clearBuffers()
+{
+    clearTimeNs = getTimeNs();
+    for (SyntheticChannel *channel : channels)
+        channel->reset();
+    return AO::eAO_OK;
+}
+
+int64 SyntheticSource::getProducedSamples(const SyntheticChannel &channel, int64 nowNs) const
+{
+    return (int64)((nowNs - clearTimeNs) / 1e9 * settings.speed * channel.samplingRate);
+}
+
+int SyntheticSource::getAlignedData(AO::int16 *data, int dataCapacity, int *actualDataSize, int *channelIDs, int channelsCount, AO::ULONG *timeStamp)
+{
+    *actualDataSize = 0;
+    if (data == nullptr || channelIDs == nullptr || channelsCount <= 0)
+        return AO::eAO_BAD_ARG;
+
+    const int64 nowNs = getTimeNs();
+    int64 numberOfSamples = dataCapacity / channelsCount;
+    for (int ch = 0; ch < channelsCount; ch++)
+    {
+        SyntheticChannel *channel = channelsByID[channelIDs[ch]];
+        if (channel == nullptr || !channel->buffered)
+            return AO::eAO_BAD_ARG;
+        if (settings.speed <= 0)
+            continue;
+
+        // Anything older than the buffering size has been overwritten, like the SDK circular buffer
+        const int64 produced = getProducedSamples(*channel, nowNs);
+        if (channel->readPosition < produced - channel->bufferingSize)
+        {
+            channel->skip(produced - channel->bufferingSize - channel->readPosition);
+            channel->readPosition = produced - channel->bufferingSize;
+        }
+        numberOfSamples = jmin(numberOfSamples, produced - channel->readPosition);
+    }
+
+    if (numberOfSamples <= 0)
+        return AO::eAO_MEM_EMPTY;
+
+    const SyntheticChannel *first = channelsByID[channelIDs[0]];
+    *timeStamp = (AO::ULONG)(uint32)(first->readPosition * (DEVICE_CLOCK_HZ / first->samplingRate));
+
+    for (int ch = 0; ch < channelsCount; ch++)
+    {
+        SyntheticChannel *channel = channelsByID[channelIDs[ch]];
+        channel->generate(data + ch * numberOfSamples, numberOfSamples);
+        channel->readPosition += numberOfSamples;
+    }
+
+    *actualDataSize = (int)(numberOfSamples * channelsCount);
+    return AO::eAO_OK;
+}
+
+int SyntheticSource::getDriveDepth(AO::int32 *depthUm)
+{
+    // Starts 10 mm above target and advances 100 um every 2 s, down to 2 mm below
+    const double seconds = (getTimeNs() - createTimeNs) / 1e9 * jmax(settings.speed, 1.0);
+    *depthUm = jmin(15000 + (int)(seconds / 2.0) * 100, 27000);
+    return AO::eAO_OK;
+}
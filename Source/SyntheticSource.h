@@ -0,0 +1,96 @@
+/*
+	------------------------------------------------------------------
+
+	This file is part of the Open Ephys GUI
+	Copyright (C) 2020 Open Ephys
+
+	------------------------------------------------------------------
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef __SYNTHETICSOURCE_H__
+#define __SYNTHETICSOURCE_H__
+
+#include <DataThreadHeaders.h>
+
+#include "SampleSource.h"
+
+namespace AONode
+{
+	/**
+		Generates Neuro Omega-like data without hardware, for demos and benchmarks.
+
+		Channel names, IDs and 44 kHz timestamps follow the SDK. Each channel is
+		seeded from the source seed and its ID, so a seed and channel layout
+		always give the same samples. LFP and ECOG carry 1/f background with
+		beta bursts, RAW carries spike trains on top of LFP, SPK spike trains
+		alone, and every channel picks up some line noise. The digital port
+		"Port- 1" carries a 1 Hz square wave on line 1 and 10 ms marker
+		pulses on line 2.
+
+		getAlignedData calls for disjoint sets of channels may run concurrently.
+	*/
+	class SyntheticSource : public SampleSource
+	{
+	public:
+		struct Settings
+		{
+			uint64 seed = 1;
+			/** Multiple of real time, 0 returns a full buffer on every call */
+			double speed = 1.0;
+			double lineFrequency = 50.0;
+			/** Channels per stream name, streams left out get their default count */
+			StringPairArray channelCounts;
+		};
+
+		/**
+			Settings from NEUROOMEGA_SYNTH_SEED, NEUROOMEGA_SYNTH_SPEED,
+			NEUROOMEGA_SYNTH_LINE_HZ and NEUROOMEGA_SYNTH_CHANNELS
+			(e.g. "LFP=5,RAW=5,SPK=5,ECOG HF 1=16", 0 removes a stream)
+		*/
+		static Settings getSettingsFromEnvironment();
+
+		SyntheticSource(const Settings &settings);
+		~SyntheticSource();
+
+		SampleSourceType getType() const override { return SampleSourceType::SYNTHETIC; }
+
+		bool isConnected() override { return true; }
+		int getChannelsCount(AO::uint32 *channelsCount) override;
+		int getAllChannels(AO::SInformation *channelsInfo, int channelsCount) override;
+		int addBufferChannel(int channelID, int bufferingSizeMs) override;
+		int clearBuffers() override;
+		int getAlignedData(AO::int16 *data, int dataCapacity, int *actualDataSize, int *channelIDs, int channelsCount, AO::ULONG *timeStamp) override;
+		int getDriveDepth(AO::int32 *depthUm) override;
+
+	private:
+		class SyntheticChannel;
+
+		/** Samples a channel has produced between clearBuffers and nowNs, at the configured speed */
+		int64 getProducedSamples(const SyntheticChannel &channel, int64 nowNs) const;
+
+		Settings settings;
+		OwnedArray<SyntheticChannel> channels;
+		HashMap<int, SyntheticChannel *> channelsByID;
+
+		int64 clearTimeNs;
+		int64 createTimeNs;
+
+		JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(SyntheticSource);
+	};
+}
+
+#endif // __SYNTHETICSOURCE_H__
@@ -71,6 +71,14 @@ void ChannelsStreamsCanvas::setEnabled(bool shouldBeEnabled)
     updateContent();
 }
 
+void ChannelsStreamsCanvas::setOnlySelectionEditable(bool shouldOnlyEditSelection)
+{
+    if (channelsTable != nullptr)
+        channelsTable->setOnlySelectionEditable(shouldOnlyEditSelection);
+    if (streamsTable != nullptr)
+        streamsTable->setOnlySelectionEditable(shouldOnlyEditSelection);
+}
+
 void ChannelsStreamsCanvas::update()
 {
 }
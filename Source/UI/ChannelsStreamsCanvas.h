@@ -62,6 +62,9 @@ namespace AONode
 
 		void setEnabled(bool shouldBeEnabled);
 
+		/** Leaves only the Enabled checkboxes editable, while acquiring */
+		void setOnlySelectionEditable(bool shouldOnlyEditSelection);
+
 		/** Called when parameters of the underlying data processor are changed*/
 		void update();
 
@@ -18,7 +18,8 @@ namespace AONode
         void init(XmlElement *xmlList)
         {
             dataList = xmlList;
-            numRows = dataList->getNumChildElements();
+            updateRows();
+            numRows = rows.size();
             setUpHeaders();
 
             addAndMakeVisible(table);
@@ -66,7 +67,7 @@ namespace AONode
             g.setColour(rowIsSelected ? Colours::darkblue : getLookAndFeel().findColour(ListBox::textColourId));
             g.setFont(font);
 
-            if (auto *rowElement = dataList->getChildElement(rowNumber))
+            if (auto *rowElement = rows[rowNumber])
             {
                 auto text = rowElement->getStringAttribute(getAttributeNameForColumnId(columnId));
 
@@ -83,6 +84,7 @@ namespace AONode
             {
                 DataSorter sorter(getAttributeNameForColumnId(newSortColumnId), isForwards);
                 dataList->sortChildElements(sorter);
+                updateRows();
 
                 table.updateContent();
             }
@@ -124,7 +126,7 @@ namespace AONode
 
             for (auto i = getNumRows(); --i >= 0;)
             {
-                if (auto *rowElement = dataList->getChildElement(i))
+                if (auto *rowElement = rows[i])
                 {
                     auto text = rowElement->getStringAttribute(getAttributeNameForColumnId(columnId));
 
@@ -139,17 +141,18 @@ namespace AONode
 
         bool getSelection(const int rowNumber) const
         {
-            return dataList->getChildElement(rowNumber)->getBoolAttribute("Enabled");
+            return rows[rowNumber]->getBoolAttribute("Enabled");
         }
 
         void setSelection(const int rowNumber, const bool newSelection, juce::ToggleButton *toggleButton)
         {
-            dataList->getChildElement(rowNumber)->setAttribute("Enabled", newSelection);
+            rows[rowNumber]->setAttribute("Enabled", newSelection);
             if (atLeastOneStreamEnabled())
-                xmlModifiedBroadcaster.sendActionMessage("Xml Modified");
+                // "Enabled:<list tag>:<ID>" lets the thread update just that row
+                xmlModifiedBroadcaster.sendActionMessage("Enabled:" + dataList->getTagName() + ":" + rows[rowNumber]->getStringAttribute("ID"));
             else
             {
-                dataList->getChildElement(rowNumber)->setAttribute("Enabled", true);
+                rows[rowNumber]->setAttribute("Enabled", true);
                 toggleButton->setToggleState(true, juce::dontSendNotification);
                 AlertWindow::showMessageBox(AlertWindow::NoIcon, "Neuro Omega", "At least one must be enabled", "OK", nullptr);
             }
@@ -159,7 +162,7 @@ namespace AONode
         {
             for (auto i = getNumRows(); --i >= 0;)
             {
-                if (auto *rowElement = dataList->getChildElement(i))
+                if (auto *rowElement = rows[i])
                 {
                     if (rowElement->getBoolAttribute("Enabled"))
                         return true;
@@ -170,13 +173,15 @@ namespace AONode
 
         String getText(const int columnNumber, const int rowNumber) const
         {
-            return dataList->getChildElement(rowNumber)->getStringAttribute(getAttributeNameForColumnId(columnNumber));
+            return rows[rowNumber]->getStringAttribute(getAttributeNameForColumnId(columnNumber));
         }
 
         void setText(const int columnNumber, const int rowNumber, const String &newText)
         {
+            if (onlySelectionEditable)
+                return;
             const auto &columnName = table.getHeader().getColumnName(columnNumber);
-            dataList->getChildElement(rowNumber)->setAttribute(columnName, newText);
+            rows[rowNumber]->setAttribute(columnName, newText);
             xmlModifiedBroadcaster.sendActionMessage("Xml Modified");
         }
 
@@ -192,15 +197,32 @@ namespace AONode
                 table.updateContent();
         }
 
+        /** While acquiring only the Enabled checkboxes may change, the other columns are fixed until it stops */
+        void setOnlySelectionEditable(bool shouldOnlyEditSelection)
+        {
+            onlySelectionEditable = shouldOnlyEditSelection;
+            updateContent();
+        }
+
         ActionBroadcaster xmlModifiedBroadcaster;
 
     private:
         TableListBox table{{}, this};
         Font font{14.0f};
 
-        XmlElement *columnList = nullptr;
+        std::unique_ptr<XmlElement> columnList;
         XmlElement *dataList = nullptr;
+        /** Children of dataList in their current order, getChildElement walks the list */
+        Array<XmlElement *> rows;
         int numRows = 0;
+        bool onlySelectionEditable = false;
+
+        void updateRows()
+        {
+            rows.clearQuick();
+            for (auto *rowElement : dataList->getChildIterator())
+                rows.add(rowElement);
+        }
 
         //==============================================================================
         class EditableTextCustomComponent : public Label
@@ -228,6 +250,7 @@ namespace AONode
             {
                 row = newRow;
                 columnId = newColumn;
+                setEditable(false, !owner.onlySelectionEditable, false);
                 setText(owner.getText(columnId, row), dontSendNotification);
             }
 
@@ -298,7 +321,7 @@ namespace AONode
         //==============================================================================
         void setUpHeaders()
         {
-            columnList = new XmlElement("HEADERS");
+            columnList = std::make_unique<XmlElement>("HEADERS");
 
             XmlElement *element;
 
@@ -371,6 +394,12 @@ namespace AONode
                 table->setEnabled(shouldBeEnabled);
         }
 
+        void setOnlySelectionEditable(bool shouldOnlyEditSelection)
+        {
+            if (table != nullptr)
+                table->setOnlySelectionEditable(shouldOnlyEditSelection);
+        }
+
     private:
         //==============================================================================
         TableComponent *table;
@@ -0,0 +1,269 @@
+/*
+    ------------------------------------------------------------------
+
+    This file is part of the Open Ephys GUI
+    Copyright (C) 2016 Open Ephys
+
+    ------------------------------------------------------------------
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+// Runs the acquisition engine against the simulated SDK, in every acquisition mode, and
+// checks what reaches the Host when the SDK misbehaves or a channel is left out and back.
+
+#include "AcquisitionEngine.h"
+#include "SimulatedDevice.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <vector>
+
+using namespace AONode;
+
+static int failures = 0;
+
+#define CHECK(condition, ...)                    \
+    do                                           \
+    {                                            \
+        if (!(condition))                        \
+        {                                        \
+            failures++;                          \
+            std::printf("FAILED: " __VA_ARGS__); \
+            std::printf("\n");                   \
+        }                                        \
+    } while (0)
+
+// Never a sample of the simulated device, which stays well within the int16 range
+#define POISON_SAMPLE 0x7FFF
+
+/** The simulated SDK, except that every failEvery-th getAlignedData fails after filling the buffer with garbage */
+class FailingSource : public NeuroOmegaSource
+{
+public:
+    explicit FailingSource(int failEvery_) : failEvery(failEvery_) {}
+
+    int getAlignedData(AO::int16 *data, int dataCapacity, int *actualDataSize, int *channelIDs, int channelsCount, AO::ULONG *timeStamp) override
+    {
+        if (failEvery > 0 && ++calls % failEvery == 0)
+        {
+            for (int i = 0; i < dataCapacity; i++)
+                data[i] = POISON_SAMPLE;
+            *actualDataSize = dataCapacity;
+            *timeStamp = 0;
+            return AO::eAO_FAIL;
+        }
+        return NeuroOmegaSource::getAlignedData(data, dataCapacity, actualDataSize, channelIDs, channelsCount, timeStamp);
+    }
+
+private:
+    const int failEvery;
+    // Readers call from their own threads
+    std::atomic<int64_t> calls{0};
+};
+
+/** Counts the poisoned samples of every block the engine delivers */
+class CheckingHost : public BufferingHost
+{
+public:
+    explicit CheckingHost(const AcquisitionPlan &plan) : BufferingHost(plan) {}
+
+    void blockFetched(const StreamPlan &, const StreamFetch &fetch, uint32_t, int64_t, const int16_t *data, int numberOfSamplesPerChannel) override
+    {
+        for (int i = 0; i < fetch.getNumberOfChannels() * numberOfSamplesPerChannel; i++)
+            if (data[i] == POISON_SAMPLE)
+                poisonedSamples++;
+    }
+
+    int64_t poisonedSamples = 0;
+};
+
+struct EngineRun
+{
+    int64_t blocks = 0;
+    int64_t sdkErrors = 0;
+    int64_t emptyPolls = 0;
+    int64_t lostSamples = 0;
+    int64_t overlaps = 0;
+    int64_t poisonedSamples = 0;
+};
+
+static EngineRun runEngine(SampleSource &source, const std::vector<SimulatedStream> &streams, AcquisitionMode mode, double seconds)
+{
+    AcquisitionPlan plan = makeSimulatedPlan(streams);
+    std::unique_ptr<FetchPlan> fetchPlan = makeCompleteFetchPlan(plan);
+    CheckingHost host(plan);
+    AcquisitionEngine engine(host);
+    engine.setMode(mode);
+    engine.start(source, std::move(plan), std::move(fetchPlan), -1);
+
+    const int64_t endNs = getTimeNs() + (int64_t)(seconds * 1e9);
+    while (getTimeNs() < endNs)
+        engine.readBlocks();
+    engine.stop();
+
+    EngineRun run;
+    for (const StreamPlan &stream : engine.getPlan().streams)
+    {
+        const StreamCounters &counters = engine.getCounters(stream.sourceBufferIdx);
+        run.blocks += counters.blocks;
+        run.sdkErrors += counters.sdkErrors;
+        run.lostSamples += counters.lostSamples;
+        run.overlaps += counters.overlaps;
+        run.emptyPolls += engine.getPollWaitStrategy().getEmptyPolls(stream.sourceBufferIdx);
+    }
+    run.poisonedSamples = host.poisonedSamples;
+    return run;
+}
+
+static void testSdkErrors(const std::vector<SimulatedStream> &streams, AcquisitionMode mode, const char *modeName)
+{
+    FailingSource source(3);
+    const EngineRun run = runEngine(source, streams, mode, 1.0);
+
+    CHECK(run.blocks > 0, "%s: no block read between the failed calls", modeName);
+    CHECK(run.sdkErrors > 0, "%s: failed calls not counted as SDK errors", modeName);
+    CHECK(run.poisonedSamples == 0, "%s: %lld samples of failed calls reached the Host", modeName, (long long)run.poisonedSamples);
+    CHECK(run.lostSamples == 0 && run.overlaps == 0, "%s: failed calls made %lld samples look lost and %lld blocks overlap",
+          modeName, (long long)run.lostSamples, (long long)run.overlaps);
+}
+
+// A reader whose every call fails waits a block between calls and polls nothing empty
+static void testReadersBackOffOnErrors(const std::vector<SimulatedStream> &streams)
+{
+    FailingSource source(1);
+    const double seconds = 0.5;
+    const EngineRun run = runEngine(source, streams, AcquisitionMode::READER_THREADS, seconds);
+
+    // At most one call per 5 ms target block, with room for late wake-ups
+    const int64_t maxCalls = (int64_t)(streams.size() * seconds * 1000 / 5) + 10 * (int64_t)streams.size();
+    CHECK(run.blocks == 0, "readers: %lld blocks delivered from failed calls", (long long)run.blocks);
+    CHECK(run.sdkErrors > 0 && run.sdkErrors <= maxCalls, "readers: %lld failed calls in %.1f s, expected 1 to %lld",
+          (long long)run.sdkErrors, seconds, (long long)maxCalls);
+    CHECK(run.emptyPolls == 0, "readers: %lld failed calls counted as empty polls", (long long)run.emptyPolls);
+}
+
+// Two channels of a simulated stream share the sine and differ by their noise, at most this much
+#define MAX_ALIGNED_DIFFERENCE 64
+
+/** Checks that the second channel of every block is sample-aligned with the first, or zeroed */
+class AlignmentHost : public BufferingHost
+{
+public:
+    using BufferingHost::BufferingHost;
+
+    int addBlock(const StreamPlan &stream, StreamScratch &scratch, int64_t firstSampleNumber, int numberOfSamplesPerChannel, int64_t blockStartNs) override
+    {
+        const int16_t *first = scratch.fetchData.get();
+        const int16_t *second = first + numberOfSamplesPerChannel;
+        int maxDifference = 0;
+        bool zeroed = true;
+        for (int samp = 0; samp < numberOfSamplesPerChannel; samp++)
+        {
+            zeroed = zeroed && second[samp] == 0;
+            maxDifference = std::max(maxDifference, std::abs(second[samp] - first[samp]));
+        }
+
+        if (zeroed)
+            zeroedBlocks++;
+        else if (maxDifference > MAX_ALIGNED_DIFFERENCE)
+            misalignedBlocks++;
+        else if (zeroedBlocks > 0)
+            realignedBlocks++;
+        return BufferingHost::addBlock(stream, scratch, firstSampleNumber, numberOfSamplesPerChannel, blockStartNs);
+    }
+
+    int64_t zeroedBlocks = 0;
+    int64_t misalignedBlocks = 0;
+    int64_t realignedBlocks = 0;
+};
+
+// The SDK keeps buffering a channel left out of the fetch plan, once fetched again it has to
+// start at the sample the others are at
+static void testToggledChannelStaysAligned(const SimulatedStream &stream, AcquisitionMode mode, const char *modeName)
+{
+    NeuroOmegaSource source;
+    AcquisitionPlan plan = makeSimulatedPlan({stream});
+    std::unique_ptr<FetchPlan> firstFetchPlan = makeCompleteFetchPlan(plan);
+    std::unique_ptr<FetchPlan> completeFetchPlan = makeCompleteFetchPlan(plan);
+    std::unique_ptr<FetchPlan> toggledFetchPlan = makeCompleteFetchPlan(plan);
+    StreamFetch &toggled = toggledFetchPlan->streams[0];
+    toggled.channelIDs.erase(toggled.channelIDs.begin() + 1);
+    toggled.rows.erase(toggled.rows.begin() + 1);
+    toggled.complete = false;
+
+    AlignmentHost host(plan);
+    AcquisitionEngine engine(host);
+    engine.setMode(mode);
+    engine.start(source, std::move(plan), std::move(firstFetchPlan), -1);
+
+    auto runFor = [&engine](double seconds)
+    {
+        const int64_t endNs = getTimeNs() + (int64_t)(seconds * 1e9);
+        while (getTimeNs() < endNs)
+            engine.readBlocks();
+    };
+    runFor(0.3);
+    engine.publishFetchPlan(std::move(toggledFetchPlan));
+    runFor(0.4);
+    engine.publishFetchPlan(std::move(completeFetchPlan));
+    runFor(0.4);
+    engine.stop();
+
+    const StreamCounters &counters = engine.getCounters(0);
+    CHECK(host.zeroedBlocks > 0, "%s: no block read while the channel was left out", modeName);
+    CHECK(host.realignedBlocks > 0, "%s: the channel did not come back", modeName);
+    CHECK(host.misalignedBlocks == 0, "%s: %lld blocks with the channel out of alignment", modeName, (long long)host.misalignedBlocks);
+    CHECK(counters.lostSamples == 0 && counters.overlaps == 0 && counters.sdkErrors == 0,
+          "%s: toggling a channel lost %lld samples, made %lld blocks overlap and %lld SDK errors", modeName,
+          (long long)counters.lostSamples, (long long)counters.overlaps, (long long)counters.sdkErrors.load());
+}
+
+int main()
+{
+    NeuroOmegaSource source;
+    CHECK(connectSimulator(source), "could not connect to the simulated device");
+    const std::vector<SimulatedStream> streams = findSimulatedStreams(source);
+    CHECK(!streams.empty(), "no samples from the simulated device");
+    if (!streams.empty())
+    {
+        testSdkErrors(streams, AcquisitionMode::SEQUENTIAL, "sequential");
+        testSdkErrors(streams, AcquisitionMode::SCHEDULED, "scheduled");
+        testSdkErrors(streams, AcquisitionMode::READER_THREADS, "readers");
+        testReadersBackOffOnErrors(streams);
+
+        for (const SimulatedStream &stream : streams)
+        {
+            if (stream.name != "RAW")
+                continue;
+            testToggledChannelStaysAligned(stream, AcquisitionMode::SEQUENTIAL, "sequential");
+            testToggledChannelStaysAligned(stream, AcquisitionMode::SCHEDULED, "scheduled");
+            testToggledChannelStaysAligned(stream, AcquisitionMode::READER_THREADS, "readers");
+        }
+    }
+    AO::CloseConnection();
+
+    if (failures > 0)
+    {
+        std::printf("%d checks failed\n", failures);
+        return 1;
+    }
+    std::printf("All checks passed\n");
+    return 0;
+}
@@ -0,0 +1,209 @@
+/*
+    ------------------------------------------------------------------
+
+    This file is part of the Open Ephys GUI
+    Copyright (C) 2016 Open Ephys
+
+    ------------------------------------------------------------------
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+// Checks that AllocationCounter sees the allocations of the calling thread only,
+// then that the steady-state work updateBuffer does per block allocates nothing, both
+// piece by piece and as the acquisition engine running against the simulated SDK.
+
+#include "AllocationCounter.h"
+#include "DeviceClock.h"
+#include "SampleConversion.h"
+#include "SeqLock.h"
+#include "SimulatedDevice.h"
+
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace AONode;
+
+static int failures = 0;
+
+// Allocations stored here escape, the compiler cannot elide a new and delete pair
+static int *volatile escapedInt = nullptr;
+static double *volatile escapedDoubles = nullptr;
+
+#define CHECK(condition, ...)                    \
+    do                                           \
+    {                                            \
+        if (!(condition))                        \
+        {                                        \
+            failures++;                          \
+            std::printf("FAILED: " __VA_ARGS__); \
+            std::printf("\n");                   \
+        }                                        \
+    } while (0)
+
+// Same shape as the counters the data thread publishes
+struct TestCounters
+{
+    int64_t snapshotNs;
+    int numberOfStreams;
+    int64_t values[64][10];
+};
+
+static void testCounting()
+{
+    CHECK(AllocationCounter::isCounting(), "built without NEUROOMEGA_COUNT_ALLOCATIONS");
+
+    int64_t before = AllocationCounter::getThreadAllocations();
+    escapedInt = new int(1);
+    delete escapedInt;
+    escapedDoubles = new double[16];
+    delete[] escapedDoubles;
+    CHECK(AllocationCounter::getThreadAllocations() - before == 2, "new and new[] counted %lld times, expected 2",
+          (long long)(AllocationCounter::getThreadAllocations() - before));
+
+    before = AllocationCounter::getThreadAllocations();
+    {
+        std::vector<int> values;
+        values.reserve(1000);
+        std::string text(100, 'x');
+    }
+    CHECK(AllocationCounter::getThreadAllocations() - before == 2, "vector and string counted %lld times, expected 2",
+          (long long)(AllocationCounter::getThreadAllocations() - before));
+
+    // Another thread's allocations are its own
+    before = AllocationCounter::getThreadAllocations();
+    int64_t otherThreadAllocations = 0;
+    std::thread other([&]
+                      {
+        const int64_t start = AllocationCounter::getThreadAllocations();
+        for (int i = 0; i < 10; i++)
+        {
+            escapedInt = new int(i);
+            delete escapedInt;
+        }
+        otherThreadAllocations = AllocationCounter::getThreadAllocations() - start; });
+    other.join();
+    const int64_t afterThread = AllocationCounter::getThreadAllocations();
+    CHECK(otherThreadAllocations == 10, "other thread counted %lld allocations, expected 10", (long long)otherThreadAllocations);
+    // Starting the thread allocates its state on this thread, the other thread's ten are not added
+    CHECK(afterThread - before < 10, "this thread was charged %lld allocations of another thread", (long long)(afterThread - before));
+}
+
+static void testSteadyStateDoesNotAllocate()
+{
+    const int numberOfChannels = 16;
+    const int numberOfSamples = 440;
+
+    std::vector<int16_t> fetchData(numberOfChannels * numberOfSamples, 3);
+    std::vector<float> sourceBufferData(numberOfChannels * numberOfSamples);
+    std::vector<int16_t> digitalWords(numberOfSamples, 0);
+    std::vector<int> changes(numberOfSamples);
+    std::vector<double> timeStamps(numberOfSamples);
+    DeviceClockModel clock;
+    clock.reset(44000, 0);
+    SeqLockSlot<TestCounters> slot;
+    TestCounters counters{};
+
+    // The first call picks the kernel and may initialise statics
+    deinterleaveAndScale(fetchData.data(), sourceBufferData.data(), numberOfChannels, numberOfSamples, 0.195f);
+
+    const int64_t before = AllocationCounter::getThreadAllocations();
+    for (int block = 0; block < 1000; block++)
+    {
+        deinterleaveAndScale(fetchData.data(), sourceBufferData.data(), numberOfChannels, numberOfSamples, 0.195f);
+
+        digitalWords[block % numberOfSamples] ^= 1;
+        findChangedWords(digitalWords.data(), numberOfSamples, 0, changes.data());
+
+        const int64_t firstTick = clock.unwrap((uint32_t)(block * numberOfSamples));
+        clock.timeStampBlock(firstTick, (int64_t)block * numberOfSamples, numberOfSamples, (int64_t)(block + 1) * 10000000, timeStamps.data());
+
+        counters.snapshotNs = block;
+        slot.publish(counters);
+        counters = slot.read();
+    }
+    const int64_t allocations = AllocationCounter::getThreadAllocations() - before;
+    CHECK(allocations == 0, "conversion, TTL edges, timestamps and counters publishing allocated %lld times in 1000 blocks", (long long)allocations);
+}
+
+// readBlocks as updateBuffer calls it, for a second and a half so a counters snapshot is published
+static void testEngineDoesNotAllocate(NeuroOmegaSource &source, const std::vector<SimulatedStream> &streams, int digitalPortChannelID,
+                                      AcquisitionMode mode, const char *modeName)
+{
+    AcquisitionPlan plan = makeSimulatedPlan(streams);
+    std::unique_ptr<FetchPlan> fetchPlan = makeCompleteFetchPlan(plan);
+    BufferingHost host(plan);
+    AcquisitionEngine engine(host);
+    engine.setMode(mode);
+    engine.start(source, std::move(plan), std::move(fetchPlan), digitalPortChannelID);
+
+    // The fetch buffers grow to what the device delivers per call
+    const int64_t warmUpEndNs = getTimeNs() + 300000000;
+    while (getTimeNs() < warmUpEndNs)
+        engine.readBlocks();
+
+    int64_t allocations = 0;
+    int64_t calls = 0;
+    const int64_t endNs = getTimeNs() + 1500000000;
+    while (getTimeNs() < endNs)
+    {
+        const int64_t before = AllocationCounter::getThreadAllocations();
+        engine.readBlocks();
+        // updateBuffer only asserts when no fetch buffer grew
+        if (engine.hasGrownFetchBuffer())
+            continue;
+        allocations += AllocationCounter::getThreadAllocations() - before;
+        calls++;
+    }
+    engine.stop();
+
+    int64_t blocks = 0;
+    for (const StreamPlan &stream : engine.getPlan().streams)
+        blocks += engine.getCounters(stream.sourceBufferIdx).blocks;
+
+    CHECK(blocks > 0, "%s: no block read from the simulated device", modeName);
+    CHECK(engine.getCountersSnapshot().snapshotNs > engine.getStartNs(), "%s: no counters snapshot published", modeName);
+    CHECK(allocations == 0, "%s: readBlocks allocated %lld times in %lld calls", modeName, (long long)allocations, (long long)calls);
+}
+
+int main()
+{
+    testCounting();
+    testSteadyStateDoesNotAllocate();
+
+    NeuroOmegaSource source;
+    CHECK(connectSimulator(source), "could not connect to the simulated device");
+    const std::vector<SimulatedStream> streams = findSimulatedStreams(source);
+    CHECK(!streams.empty(), "no samples from the simulated device");
+    if (!streams.empty())
+    {
+        const int digitalPortChannelID = findSimulatedDigitalPort(source);
+        testEngineDoesNotAllocate(source, streams, digitalPortChannelID, AcquisitionMode::SEQUENTIAL, "sequential");
+        testEngineDoesNotAllocate(source, streams, digitalPortChannelID, AcquisitionMode::SCHEDULED, "scheduled");
+        testEngineDoesNotAllocate(source, streams, digitalPortChannelID, AcquisitionMode::READER_THREADS, "readers");
+    }
+    AO::CloseConnection();
+
+    if (failures > 0)
+    {
+        std::printf("%d checks failed\n", failures);
+        return 1;
+    }
+    std::printf("All checks passed\n");
+    return 0;
+}
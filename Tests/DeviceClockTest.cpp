@@ -0,0 +1,285 @@
+/*
+    ------------------------------------------------------------------
+
+    This file is part of the Open Ephys GUI
+    Copyright (C) 2016 Open Ephys
+
+    ------------------------------------------------------------------
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+// Feeds DeviceClockModel the blocks of a simulated stream whose clock drifts from the
+// host clock by a known amount, with jittered and occasionally stalled host reads, and
+// checks the timestamps against the true host time of every sample.
+// The random jitter comes from a fixed seed, so every run sees the same blocks.
+
+#include "DeviceClock.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+using namespace AONode;
+
+static int failures = 0;
+
+#define CHECK(condition, ...)                    \
+    do                                           \
+    {                                            \
+        if (!(condition))                        \
+        {                                        \
+            failures++;                          \
+            std::printf("FAILED: " __VA_ARGS__); \
+            std::printf("\n");                   \
+        }                                        \
+    } while (0)
+
+struct ClockScenario
+{
+    const char *name;
+    double samplingRate;
+    int samplesPerBlock;
+    double driftPpm;
+    // Host reads land up to this late after the block's last sample, uniformly
+    double maxJitterUs;
+    // One read in this many stalls for stallMs on top of the jitter
+    int stallEvery;
+    double stallMs;
+    // Blocks the device drops, none when 0
+    int dropEvery;
+    // How far the rate of the defaults file is from the true one, in percent
+    double nominalRateErrorPercent;
+};
+
+// Tick counter value of the first sample, so the 32-bit counter wraps 30 s into the run
+static const uint32_t firstDeviceTick = 0xFFFFFFFFu - 30u * DeviceClockModel::DEVICE_CLOCK_HZ;
+
+static void runScenario(const ClockScenario &scenario)
+{
+    const double runSeconds = 600;
+    // The loop settles within a minute, timestamps are only checked after it
+    const double settleSeconds = 60;
+    // Timestamps follow the host reads, so they sit behind the true sample times by the mean
+    // read delay. Around that offset the loop has to average all but 5 % of the read jitter out
+    const double maxWanderUs = std::max(10.0, scenario.maxJitterUs * 0.05);
+    const double maxDriftErrorPpm = 0.1;
+
+    // A device tick lasts this long on the host clock
+    const double hostNsPerTick = 1e9 / DeviceClockModel::DEVICE_CLOCK_HZ / (1.0 + scenario.driftPpm * 1e-6);
+    const double ticksPerSample = DeviceClockModel::DEVICE_CLOCK_HZ / scenario.samplingRate;
+    const int64_t hostStartNs = 1000000000;
+
+    std::mt19937 random(7);
+    std::uniform_real_distribution<double> jitterNs(0.0, scenario.maxJitterUs * 1e3);
+
+    DeviceClockModel clock;
+    clock.reset(scenario.samplingRate * (1.0 + scenario.nominalRateErrorPercent * 1e-2), hostStartNs);
+
+    std::vector<double> timeStamps(scenario.samplesPerBlock);
+    double lastTimeStamp = -1;
+    double sumError = 0;
+    double minError = 1e9;
+    double maxError = -1e9;
+    int64_t numberOfCheckedSamples = 0;
+    double sumDelayNs = 0;
+    int64_t missingSamples = 0;
+    int64_t expectedMissingSamples = 0;
+    int64_t droppedSamples = 0;
+    bool increasing = true;
+
+    const int64_t numberOfBlocks = (int64_t)(runSeconds * scenario.samplingRate / scenario.samplesPerBlock);
+    for (int64_t block = 0; block < numberOfBlocks; block++)
+    {
+        const int64_t firstSampleNumber = block * scenario.samplesPerBlock;
+        const int64_t firstTickSinceStart = (int64_t)std::llround(firstSampleNumber * ticksPerSample);
+
+        if (scenario.dropEvery > 0 && block % scenario.dropEvery == scenario.dropEvery - 1)
+        {
+            droppedSamples += scenario.samplesPerBlock;
+            continue;
+        }
+        // Dropped blocks only show once the next block arrives
+        expectedMissingSamples += droppedSamples;
+        droppedSamples = 0;
+
+        const double blockEndHostNs = (firstTickSinceStart + scenario.samplesPerBlock * ticksPerSample) * hostNsPerTick;
+        double delayNs = jitterNs(random);
+        if (scenario.stallEvery > 0 && block % scenario.stallEvery == scenario.stallEvery / 2)
+            delayNs += scenario.stallMs * 1e6;
+        const int64_t arrivalNs = hostStartNs + (int64_t)(blockEndHostNs + delayNs);
+        sumDelayNs += delayNs;
+
+        const uint32_t deviceTimeStamp = (uint32_t)(firstDeviceTick + (uint64_t)firstTickSinceStart);
+        const int64_t firstTick = clock.unwrap(deviceTimeStamp);
+        missingSamples += clock.getMissingSamples(firstTick);
+        clock.timeStampBlock(firstTick, firstSampleNumber, scenario.samplesPerBlock, arrivalNs, timeStamps.data());
+
+        for (int samp = 0; samp < scenario.samplesPerBlock; samp++)
+        {
+            if (timeStamps[samp] <= lastTimeStamp)
+                increasing = false;
+            lastTimeStamp = timeStamps[samp];
+
+            const double trueSeconds = (firstTickSinceStart + samp * ticksPerSample) * hostNsPerTick * 1e-9;
+            if (trueSeconds < settleSeconds)
+                continue;
+            const double error = timeStamps[samp] - trueSeconds;
+            sumError += error;
+            minError = std::min(minError, error);
+            maxError = std::max(maxError, error);
+            numberOfCheckedSamples++;
+        }
+    }
+
+    const double meanError = sumError / numberOfCheckedSamples;
+    const double maxWander = std::max(maxError - meanError, meanError - minError);
+    const double meanDelayUs = sumDelayNs / numberOfBlocks * 1e-3;
+
+    std::printf("%-42s drift %+8.3f ppm (true %+6.1f), ticks/sample %9.6f, offset %+6.1f us (mean read delay %6.1f), wander %5.1f us\n",
+                scenario.name, clock.getDriftPpm(), scenario.driftPpm, clock.getTicksPerSample(), meanError * 1e6, meanDelayUs, maxWander * 1e6);
+
+    CHECK(increasing, "%s: timestamps are not strictly increasing", scenario.name);
+    CHECK(std::abs(clock.getDriftPpm() - scenario.driftPpm) <= maxDriftErrorPpm,
+          "%s: measured drift %.3f ppm, expected %.1f +/- %.1f", scenario.name, clock.getDriftPpm(), scenario.driftPpm, maxDriftErrorPpm);
+    CHECK(std::abs(clock.getTicksPerSample() - ticksPerSample) <= ticksPerSample * 1e-6,
+          "%s: measured %.6f ticks per sample, expected %.6f", scenario.name, clock.getTicksPerSample(), ticksPerSample);
+    CHECK(meanError > 0 && meanError * 1e6 <= scenario.maxJitterUs,
+          "%s: timestamps %.1f us behind the samples, expected within the read jitter of %.1f us", scenario.name, meanError * 1e6, scenario.maxJitterUs);
+    CHECK(maxWander * 1e6 <= maxWanderUs,
+          "%s: timestamps wander up to %.1f us after settling, bound %.1f us", scenario.name, maxWander * 1e6, maxWanderUs);
+    CHECK(missingSamples == expectedMissingSamples,
+          "%s: %lld missing samples reported, %lld dropped", scenario.name, (long long)missingSamples, (long long)expectedMissingSamples);
+}
+
+// Ten days of LFP in 2 s blocks, so the 32-bit tick counter wraps 9 times, with the device
+// clock drifting from the host clock. Every sample has to stay within one sample period
+// of its true time from the very first block on, across every wrap
+static void testLongRun()
+{
+    const double days = 10;
+    const double samplingRate = 1375;
+    const int samplesPerBlock = 2750;
+    const double driftPpm = 45;
+    const double maxJitterUs = 200;
+    const double samplePeriodUs = 1e6 / samplingRate;
+
+    const double hostNsPerTick = 1e9 / DeviceClockModel::DEVICE_CLOCK_HZ / (1.0 + driftPpm * 1e-6);
+    const double ticksPerSample = DeviceClockModel::DEVICE_CLOCK_HZ / samplingRate;
+    const int64_t hostStartNs = 1000000000;
+    // The counter wraps a minute into the run
+    const uint32_t firstLongRunTick = 0xFFFFFFFFu - 60u * DeviceClockModel::DEVICE_CLOCK_HZ;
+
+    std::mt19937 random(11);
+    std::uniform_real_distribution<double> jitterNs(0.0, maxJitterUs * 1e3);
+
+    DeviceClockModel clock;
+    clock.reset(samplingRate, hostStartNs);
+
+    std::vector<double> timeStamps(samplesPerBlock);
+    double lastTimeStamp = -1;
+    double maxAbsError = 0;
+    double maxAbsErrorSeconds = 0;
+    int64_t missingSamples = 0;
+    int wraps = 0;
+    uint32_t lastDeviceTimeStamp = firstLongRunTick;
+    bool increasing = true;
+
+    const int64_t numberOfBlocks = (int64_t)(days * 86400 * samplingRate / samplesPerBlock);
+    for (int64_t block = 0; block < numberOfBlocks; block++)
+    {
+        const int64_t firstSampleNumber = block * samplesPerBlock;
+        const int64_t firstTickSinceStart = (int64_t)std::llround(firstSampleNumber * ticksPerSample);
+        const double blockEndHostNs = (firstTickSinceStart + samplesPerBlock * ticksPerSample) * hostNsPerTick;
+        const int64_t arrivalNs = hostStartNs + (int64_t)(blockEndHostNs + jitterNs(random));
+
+        const uint32_t deviceTimeStamp = (uint32_t)(firstLongRunTick + (uint64_t)firstTickSinceStart);
+        if (deviceTimeStamp < lastDeviceTimeStamp)
+            wraps++;
+        lastDeviceTimeStamp = deviceTimeStamp;
+
+        const int64_t firstTick = clock.unwrap(deviceTimeStamp);
+        missingSamples += clock.getMissingSamples(firstTick);
+        clock.timeStampBlock(firstTick, firstSampleNumber, samplesPerBlock, arrivalNs, timeStamps.data());
+
+        if (timeStamps[0] <= lastTimeStamp)
+            increasing = false;
+        lastTimeStamp = timeStamps[samplesPerBlock - 1];
+
+        // Timestamps are evenly spaced within a block, its first and last samples bound the error
+        for (int samp : {0, samplesPerBlock - 1})
+        {
+            const double trueSeconds = (firstTickSinceStart + samp * ticksPerSample) * hostNsPerTick * 1e-9;
+            const double absError = std::abs(timeStamps[samp] - trueSeconds);
+            if (absError > maxAbsError)
+            {
+                maxAbsError = absError;
+                maxAbsErrorSeconds = trueSeconds;
+            }
+        }
+    }
+
+    std::printf("%-42s drift %+8.3f ppm (true %+6.1f), %d wraps, max error %6.1f us at %.0f s, sample period %.1f us\n",
+                "LFP 1375 Hz, 10 days, 2 s blocks", clock.getDriftPpm(), driftPpm, wraps, maxAbsError * 1e6, maxAbsErrorSeconds, samplePeriodUs);
+
+    CHECK(wraps >= 8, "long run: the tick counter wrapped %d times, expected at least 8", wraps);
+    CHECK(increasing, "long run: timestamps are not strictly increasing");
+    CHECK(missingSamples == 0, "long run: %lld missing samples reported for contiguous blocks", (long long)missingSamples);
+    CHECK(maxAbsError * 1e6 < samplePeriodUs, "long run: a timestamp is %.1f us off at %.0f s, more than the %.1f us sample period",
+          maxAbsError * 1e6, maxAbsErrorSeconds, samplePeriodUs);
+    CHECK(std::abs(clock.getDriftPpm() - driftPpm) <= 1.0, "long run: measured drift %.3f ppm, expected %.1f", clock.getDriftPpm(), driftPpm);
+}
+
+static void testUnwrap()
+{
+    DeviceClockModel clock;
+    clock.reset(44000, 0);
+
+    CHECK(clock.unwrap(0xFFFFFF00u) == 0xFFFFFF00ll, "unwrap changed a timestamp before the first wrap");
+    CHECK(clock.unwrap(0x00000100u) == 0x100000100ll, "unwrap missed the counter wrapping");
+    CHECK(clock.unwrap(0x00000300u) == 0x100000300ll, "unwrap counted a second wrap");
+    // A block reported slightly out of order is not another wrap
+    CHECK(clock.unwrap(0x00000200u) == 0x100000200ll, "unwrap took a small step back for a wrap");
+    CHECK(clock.unwrap(0x00000400u) == 0x100000400ll, "unwrap lost count after a step back");
+}
+
+int main()
+{
+    const ClockScenario scenarios[] = {
+        // name                              rate   block  ppm   jitter us  stall every, ms  drop every  nominal error %
+        {"RAW 44 kHz, no drift", 44000, 440, 0, 200, 0, 0, 0, 0},
+        {"RAW 44 kHz, +50 ppm", 44000, 440, 50, 200, 0, 0, 0, 0},
+        {"RAW 44 kHz, -80 ppm, stalls", 44000, 440, -80, 500, 500, 40, 0, 0},
+        {"LFP 1375 Hz, +20 ppm, dropped blocks", 1375, 14, 20, 1000, 0, 0, 1000, 0},
+        {"SPK 22 kHz, -30 ppm, stalls, drops", 22000, 220, -30, 300, 300, 20, 2500, 0},
+        {"LFP 1375 Hz, defaults file 3 % off, drops", 1375, 14, 10, 1000, 0, 0, 1000, 3},
+        {"SPK 22 kHz, defaults file -5 % off, drops", 22000, 220, -30, 300, 0, 0, 2500, -5},
+    };
+
+    testUnwrap();
+    testLongRun();
+    for (const ClockScenario &scenario : scenarios)
+        runScenario(scenario);
+
+    if (failures > 0)
+    {
+        std::printf("%d checks failed\n", failures);
+        return 1;
+    }
+    std::printf("All checks passed\n");
+    return 0;
+}
@@ -0,0 +1,195 @@
+/*
+    ------------------------------------------------------------------
+
+    This file is part of the Open Ephys GUI
+    Copyright (C) 2016 Open Ephys
+
+    ------------------------------------------------------------------
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+// Runs the plugin's acquisition engine without the GUI: the AcquisitionEngine DeviceThread
+// uses reads every channel of the simulated SDK in one of the acquisition modes, with the
+// same poll waits, reader threads and rings, fetch plan, digital inputs, device clock model
+// and sample conversion. Its Host stands in for DeviceThread and copies each block to a
+// buffer the size of a DataBuffer, which the GUI would drain.
+//
+//   HeadlessBenchmark [--seconds 10] [--mode sequential|scheduled|readers] [--report file.json]
+//
+// NEUROOMEGA_SIM_PROFILE and NEUROOMEGA_SIM_SPEED choose the channels and pace, as for
+// the plugin. The report gives samples/s, ns per sample, per-stage block latency and the
+// CPU seconds per wall-clock second of the acquisition threads and of the whole process.
+// The simulated SDK makes up its samples in the process, which is part of the CPU used.
+
+#include "AcquisitionEngine.h"
+#include "CpuTime.h"
+#include "SampleConversion.h"
+#include "SimulatedDevice.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace AONode;
+
+static std::string getPercentiles(const LatencyHistogram &histogram)
+{
+    char text[128];
+    std::snprintf(text, sizeof(text), "{\"p50\": %lld, \"p99\": %lld, \"p999\": %lld}",
+                  (long long)histogram.getPercentile(0.5), (long long)histogram.getPercentile(0.99),
+                  (long long)histogram.getPercentile(0.999));
+    return text;
+}
+
+int main(int argc, char **argv)
+{
+    double seconds = 10;
+    std::string modeName = "sequential";
+    const char *reportPath = nullptr;
+    for (int i = 1; i + 1 < argc; i += 2)
+    {
+        if (std::strcmp(argv[i], "--seconds") == 0)
+            seconds = std::atof(argv[i + 1]);
+        else if (std::strcmp(argv[i], "--mode") == 0)
+            modeName = argv[i + 1];
+        else if (std::strcmp(argv[i], "--report") == 0)
+            reportPath = argv[i + 1];
+    }
+
+    AcquisitionMode mode;
+    if (modeName == "sequential")
+        mode = AcquisitionMode::SEQUENTIAL;
+    else if (modeName == "scheduled")
+        mode = AcquisitionMode::SCHEDULED;
+    else if (modeName == "readers")
+        mode = AcquisitionMode::READER_THREADS;
+    else
+    {
+        std::fprintf(stderr, "Unknown mode %s, use sequential, scheduled or readers\n", modeName.c_str());
+        return 2;
+    }
+
+    NeuroOmegaSource source;
+    if (!connectSimulator(source))
+    {
+        std::fprintf(stderr, "Could not connect to the simulated device\n");
+        return 1;
+    }
+
+    const std::vector<SimulatedStream> streams = findSimulatedStreams(source);
+    if (streams.empty())
+    {
+        std::fprintf(stderr, "No samples from the simulated device\n");
+        return 1;
+    }
+
+    AcquisitionPlan plan = makeSimulatedPlan(streams);
+    std::unique_ptr<FetchPlan> fetchPlan = makeCompleteFetchPlan(plan);
+    BufferingHost host(plan);
+    AcquisitionEngine engine(host);
+    engine.setMode(mode);
+    engine.start(source, std::move(plan), std::move(fetchPlan), findSimulatedDigitalPort(source));
+
+    const int64_t startNs = engine.getStartNs();
+    const int64_t startProcessCpuNs = getProcessCpuTimeNs();
+    std::atomic<int64_t> dataThreadCpuNs{0};
+    std::thread dataThread([&]()
+                           {
+        while (!host.shouldStop())
+            engine.readBlocks();
+        dataThreadCpuNs = getThreadCpuTimeNs(); });
+
+    std::this_thread::sleep_for(std::chrono::duration<double>(seconds));
+    host.stopRequested = true;
+    dataThread.join();
+    engine.stop();
+
+    const double wallSeconds = (getTimeNs() - startNs) / 1e9;
+    const double processCpuSeconds = (getProcessCpuTimeNs() - startProcessCpuNs) / 1e9;
+    int64_t threadsCpuNs = dataThreadCpuNs;
+    int numberOfThreads = 1;
+    for (const StreamPlan &stream : engine.getPlan().streams)
+    {
+        if (const StreamReader *reader = engine.getReader(stream.sourceBufferIdx))
+        {
+            threadsCpuNs += reader->getCpuTimeNs();
+            numberOfThreads++;
+        }
+    }
+
+    const char *kernelNames[] = {"SCALAR", "SSE2", "AVX2", "AVX512"};
+    const char *profile = std::getenv("NEUROOMEGA_SIM_PROFILE");
+    const char *speed = std::getenv("NEUROOMEGA_SIM_SPEED");
+
+    int64_t totalSamples = 0;
+    int64_t totalLostSamples = 0;
+    std::string streamReports;
+    for (const StreamPlan &stream : engine.getPlan().streams)
+    {
+        const StreamCounters &counters = engine.getCounters(stream.sourceBufferIdx);
+        StreamLatency &latency = engine.getLatency(stream.sourceBufferIdx);
+        const int64_t samples = counters.samples * stream.numberOfChannels;
+        totalSamples += samples;
+        totalLostSamples += counters.lostSamples;
+
+        char report[512];
+        std::snprintf(report, sizeof(report),
+                      "%s\n    {\"name\": \"%s\", \"channels\": %d, \"samplingRate\": %.1f, \"blocks\": %lld, \"samplesPerSecond\": %.1f, "
+                      "\"emptyPolls\": %lld, \"sdkErrors\": %lld, \"gaps\": %lld, \"overruns\": %lld, \"overlaps\": %lld, \"lostSamples\": %lld, "
+                      "\"driftPpm\": %.2f,\n     ",
+                      streamReports.empty() ? "" : ",", streams[stream.sourceBufferIdx].name.c_str(), stream.numberOfChannels,
+                      stream.samplingRate, (long long)counters.blocks.load(), samples / wallSeconds,
+                      (long long)engine.getPollWaitStrategy().getEmptyPolls(stream.sourceBufferIdx), (long long)counters.sdkErrors.load(),
+                      (long long)counters.gaps.load(), (long long)counters.overruns.load(), (long long)counters.overlaps.load(),
+                      (long long)counters.lostSamples.load(), engine.getClock(stream.sourceBufferIdx).getDriftPpm());
+        streamReports += report;
+        streamReports += "\"fetchNs\": " + getPercentiles(latency.fetch) + ", \"convertNs\": " + getPercentiles(latency.convert) +
+                         ", \"addToBufferNs\": " + getPercentiles(latency.addToBuffer) + ", \"ageNs\": " + getPercentiles(latency.age) + "}";
+    }
+
+    char summary[2048];
+    std::snprintf(summary, sizeof(summary),
+                  "{\n  \"plugin\": \"Neuro Omega\", \"headless\": true, \"acquisitionMode\": \"%s\", \"profile\": \"%s\", \"simSpeed\": \"%s\",\n"
+                  "  \"conversionKernel\": \"%s\", \"threads\": %d, \"wallSeconds\": %.3f, \"samples\": %lld, \"samplesPerSecond\": %.1f,\n"
+                  "  \"lostSamples\": %lld, \"nsPerSample\": %.3f, \"cpuSecondsPerWallSecond\": %.4f, \"dataThreadCpuSecondsPerWallSecond\": %.4f,\n"
+                  "  \"processCpuSecondsPerWallSecond\": %.4f,\n  \"streams\": [",
+                  modeName.c_str(), profile != nullptr ? profile : "default", speed != nullptr ? speed : "1",
+                  kernelNames[(int)getBestConversionKernel()], numberOfThreads, wallSeconds, (long long)totalSamples,
+                  totalSamples / wallSeconds, (long long)totalLostSamples, totalSamples > 0 ? (double)threadsCpuNs / totalSamples : 0.0,
+                  threadsCpuNs / 1e9 / wallSeconds, dataThreadCpuNs / 1e9 / wallSeconds, processCpuSeconds / wallSeconds);
+    const std::string report = std::string(summary) + streamReports + "\n  ]\n}\n";
+
+    std::fputs(report.c_str(), stdout);
+    if (reportPath != nullptr)
+    {
+        FILE *file = std::fopen(reportPath, "w");
+        if (file == nullptr || std::fputs(report.c_str(), file) < 0)
+        {
+            std::fprintf(stderr, "Unable to write %s\n", reportPath);
+            return 1;
+        }
+        std::fclose(file);
+    }
+
+    AO::CloseConnection();
+    return totalSamples > 0 ? 0 : 1;
+}
@@ -0,0 +1,255 @@
+/*
+    ------------------------------------------------------------------
+
+    This file is part of the Open Ephys GUI
+    Copyright (C) 2016 Open Ephys
+
+    ------------------------------------------------------------------
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+// Checks every conversion kernel the CPU supports against the scalar loop, bit for bit,
+// over channel counts and block lengths that leave every kind of partial tile.
+// "SampleConversionTest --bench" also times each kernel against scalar over 1 to 256 channels
+// and 32 to 4096 samples per block.
+
+#include "SampleConversion.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <vector>
+
+using namespace AONode;
+
+static int failures = 0;
+
+#define CHECK(condition, ...)                  \
+    do                                         \
+    {                                          \
+        if (!(condition))                      \
+        {                                      \
+            failures++;                        \
+            std::printf("FAILED: " __VA_ARGS__); \
+            std::printf("\n");                 \
+        }                                      \
+    } while (0)
+
+static const ConversionKernel kernels[] = {ConversionKernel::SCALAR, ConversionKernel::SSE2, ConversionKernel::AVX2, ConversionKernel::AVX512};
+
+static const char *getKernelName(ConversionKernel kernel)
+{
+    switch (kernel)
+    {
+    case ConversionKernel::SCALAR:
+        return "scalar";
+    case ConversionKernel::SSE2:
+        return "SSE2";
+    case ConversionKernel::AVX2:
+        return "AVX2";
+    case ConversionKernel::AVX512:
+        return "AVX-512";
+    }
+    return "?";
+}
+
+static void deinterleaveAndScaleReference(const int16_t *src, float *dst, int numberOfChannels, int numberOfSamplesPerChannel, float bitVolts)
+{
+    for (int samp = 0; samp < numberOfSamplesPerChannel; samp++)
+        for (int chan = 0; chan < numberOfChannels; chan++)
+            dst[samp * numberOfChannels + chan] = src[chan * numberOfSamplesPerChannel + samp] * bitVolts;
+}
+
+static int findChangedWordsReference(const int16_t *words, int numberOfWords, int16_t previousWord, int *positions)
+{
+    int numberOfChanges = 0;
+    for (int i = 0; i < numberOfWords; i++)
+    {
+        if (words[i] != (i == 0 ? previousWord : words[i - 1]))
+            positions[numberOfChanges++] = i;
+    }
+    return numberOfChanges;
+}
+
+static void testDeinterleaveAndScale(ConversionKernel kernel, std::mt19937 &random)
+{
+    // Up to two 16 channel AVX-512 tiles plus every remainder, and sample counts around each tile width
+    const int maxChannels = 40;
+    const int maxSamples = 70;
+    const float bitVoltsValues[] = {1.0f, 0.195f, -3.0517578e-05f};
+
+    std::uniform_int_distribution<int> word(-32768, 32767);
+    std::vector<int16_t> src(maxChannels * maxSamples);
+    // One guard sample past the end catches kernels writing beyond the block
+    std::vector<float> expected(maxChannels * maxSamples + 1);
+    std::vector<float> actual(maxChannels * maxSamples + 1);
+
+    for (float bitVolts : bitVoltsValues)
+    {
+        for (int numberOfChannels = 1; numberOfChannels <= maxChannels; numberOfChannels++)
+        {
+            for (int numberOfSamples = 0; numberOfSamples <= maxSamples; numberOfSamples++)
+            {
+                const int n = numberOfChannels * numberOfSamples;
+                for (int i = 0; i < n; i++)
+                    src[i] = (int16_t)word(random);
+                // Include the extremes in every block
+                if (n >= 2)
+                {
+                    src[0] = -32768;
+                    src[n - 1] = 32767;
+                }
+
+                std::fill(expected.begin(), expected.end(), -1.0f);
+                std::fill(actual.begin(), actual.end(), -1.0f);
+                deinterleaveAndScaleReference(src.data(), expected.data(), numberOfChannels, numberOfSamples, bitVolts);
+                deinterleaveAndScale(kernel, src.data(), actual.data(), numberOfChannels, numberOfSamples, bitVolts);
+
+                CHECK(std::memcmp(expected.data(), actual.data(), (n + 1) * sizeof(float)) == 0,
+                      "%s deinterleaveAndScale differs from scalar with %d channels, %d samples, bitVolts %g",
+                      getKernelName(kernel), numberOfChannels, numberOfSamples, bitVolts);
+            }
+        }
+    }
+}
+
+static void testFindChangedWords(ConversionKernel kernel, std::mt19937 &random)
+{
+    const int maxWords = 100;
+    std::vector<int16_t> words(maxWords);
+    std::vector<int> expected(maxWords);
+    std::vector<int> actual(maxWords);
+
+    // From a change at every word to a single change, so every run length up to a few vectors shows up
+    for (int changeEvery = 1; changeEvery <= 40; changeEvery++)
+    {
+        for (int numberOfWords = 0; numberOfWords <= maxWords; numberOfWords++)
+        {
+            std::uniform_int_distribution<int> interval(1, 2 * changeEvery);
+            int16_t value = 0x0101;
+            int nextChange = interval(random);
+            for (int i = 0; i < numberOfWords; i++)
+            {
+                if (i == nextChange)
+                {
+                    // Flip a single bit, so vectors that differ in one byte only are covered too
+                    value ^= (int16_t)(1 << (random() % 16));
+                    nextChange += interval(random);
+                }
+                words[i] = value;
+            }
+
+            for (int16_t previousWord : {(int16_t)0x0101, (int16_t)0x0100})
+            {
+                const int numberOfExpected = findChangedWordsReference(words.data(), numberOfWords, previousWord, expected.data());
+                const int numberOfActual = findChangedWords(kernel, words.data(), numberOfWords, previousWord, actual.data());
+
+                CHECK(numberOfActual == numberOfExpected && std::equal(expected.begin(), expected.begin() + numberOfExpected, actual.begin()),
+                      "%s findChangedWords differs from scalar with %d words, a change every ~%d",
+                      getKernelName(kernel), numberOfWords, changeEvery);
+            }
+        }
+    }
+}
+
+static double getSeconds()
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Time per sample of one kernel converting the same block over and over
+static double measureNsPerSample(ConversionKernel kernel, int numberOfChannels, int numberOfSamples)
+{
+    std::vector<int16_t> src(numberOfChannels * numberOfSamples);
+    std::vector<float> dst(numberOfChannels * numberOfSamples);
+    std::mt19937 random(1);
+    for (int16_t &sample : src)
+        sample = (int16_t)random();
+
+    const double minimumSeconds = 0.02;
+    long long numberOfBlocks = 0;
+    const double start = getSeconds();
+    double elapsed = 0;
+    while (elapsed < minimumSeconds)
+    {
+        for (int i = 0; i < 10; i++)
+            deinterleaveAndScale(kernel, src.data(), dst.data(), numberOfChannels, numberOfSamples, 0.195f);
+        numberOfBlocks += 10;
+        elapsed = getSeconds() - start;
+    }
+
+    return elapsed * 1e9 / ((double)numberOfBlocks * numberOfChannels * numberOfSamples);
+}
+
+// Every kernel the CPU supports on one block shape, as time per sample and speedup over scalar
+static void benchmark(int numberOfChannels, int numberOfSamples)
+{
+    const double scalarNs = measureNsPerSample(ConversionKernel::SCALAR, numberOfChannels, numberOfSamples);
+    std::printf("  %3d x %4d  %7.3f", numberOfChannels, numberOfSamples, scalarNs);
+    for (ConversionKernel kernel : kernels)
+    {
+        if (kernel == ConversionKernel::SCALAR || kernel > getBestConversionKernel())
+            continue;
+        const double ns = measureNsPerSample(kernel, numberOfChannels, numberOfSamples);
+        std::printf("  %7.3f %5.2fx", ns, scalarNs / ns);
+    }
+    std::printf("\n");
+}
+
+int main(int argc, char **argv)
+{
+    const bool runBenchmark = argc > 1 && std::strcmp(argv[1], "--bench") == 0;
+    std::mt19937 random(20240301);
+
+    std::printf("Best kernel on this CPU: %s\n", getKernelName(getBestConversionKernel()));
+
+    for (ConversionKernel kernel : kernels)
+    {
+        if (kernel > getBestConversionKernel())
+        {
+            std::printf("Skipping %s, not supported by this CPU\n", getKernelName(kernel));
+            continue;
+        }
+        std::printf("Testing %s\n", getKernelName(kernel));
+        testDeinterleaveAndScale(kernel, random);
+        testFindChangedWords(kernel, random);
+    }
+
+    if (runBenchmark)
+    {
+        // From single channel streams to the stress profile, from the shortest blocks the readers
+        // hand over to several seconds of LFP
+        std::printf("deinterleaveAndScale, ns/sample and speedup over scalar:\n");
+        std::printf("  chan x samp   scalar");
+        for (ConversionKernel kernel : kernels)
+            if (kernel != ConversionKernel::SCALAR && kernel <= getBestConversionKernel())
+                std::printf("  %-14s", getKernelName(kernel));
+        std::printf("\n");
+        for (int numberOfChannels : {1, 2, 4, 5, 8, 16, 17, 32, 64, 128, 256})
+            for (int numberOfSamples : {32, 64, 128, 256, 512, 1024, 2048, 4096})
+                benchmark(numberOfChannels, numberOfSamples);
+    }
+
+    if (failures > 0)
+    {
+        std::printf("%d checks failed\n", failures);
+        return 1;
+    }
+    std::printf("All checks passed\n");
+    return 0;
+}
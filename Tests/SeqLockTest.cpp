@@ -0,0 +1,106 @@
+/*
+    ------------------------------------------------------------------
+
+    This file is part of the Open Ephys GUI
+    Copyright (C) 2016 Open Ephys
+
+    ------------------------------------------------------------------
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+// Publishes values from one thread while others read them, and checks that no
+// reader ever sees a value mixing two publishes or going back in time.
+
+#include "SeqLock.h"
+
+#include <atomic>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+using namespace AONode;
+
+// Odd size, so the last word of the slot is only partly used
+struct TestValue
+{
+    int64_t sequence;
+    int64_t copies[40];
+    int32_t last;
+};
+
+int main()
+{
+    const int64_t numberOfPublishes = 500000;
+    const int numberOfReaders = 2;
+
+    SeqLockSlot<TestValue> slot;
+    std::atomic<bool> writing{true};
+    std::atomic<int> failures{0};
+    std::atomic<int64_t> numberOfReads{0};
+
+    if (slot.read().sequence != 0)
+        failures++;
+
+    std::vector<std::thread> readers;
+    for (int r = 0; r < numberOfReaders; r++)
+    {
+        readers.emplace_back([&]
+                             {
+            int64_t previous = 0;
+            int64_t reads = 0;
+            while (writing.load(std::memory_order_relaxed))
+            {
+                const TestValue value = slot.read();
+                bool consistent = value.sequence >= previous && value.last == (int32_t)value.sequence;
+                for (int64_t copy : value.copies)
+                    consistent = consistent && copy == value.sequence;
+                if (!consistent && failures.fetch_add(1) < 10)
+                    std::printf("FAILED: torn or stale read of %lld after %lld\n", (long long)value.sequence, (long long)previous);
+                previous = value.sequence;
+                reads++;
+            }
+            numberOfReads += reads; });
+    }
+
+    TestValue value{};
+    for (int64_t i = 1; i <= numberOfPublishes; i++)
+    {
+        value.sequence = i;
+        for (int64_t &copy : value.copies)
+            copy = i;
+        value.last = (int32_t)i;
+        slot.publish(value);
+    }
+    writing = false;
+    for (std::thread &reader : readers)
+        reader.join();
+
+    const TestValue latest = slot.read();
+    if (latest.sequence != numberOfPublishes)
+    {
+        failures++;
+        std::printf("FAILED: latest value %lld, expected %lld\n", (long long)latest.sequence, (long long)numberOfPublishes);
+    }
+
+    std::printf("%lld publishes, %lld reads\n", (long long)numberOfPublishes, (long long)numberOfReads.load());
+    if (failures > 0)
+    {
+        std::printf("%d checks failed\n", failures.load());
+        return 1;
+    }
+    std::printf("All checks passed\n");
+    return 0;
+}
@@ -0,0 +1,244 @@
+/*
+	------------------------------------------------------------------
+
+	This file is part of the Open Ephys GUI
+	Copyright (C) 2020 Open Ephys
+
+	------------------------------------------------------------------
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __SIMULATEDDEVICE_H__
+#define __SIMULATEDDEVICE_H__
+
+#include "AcquisitionCounters.h"
+#include "AcquisitionEngine.h"
+#include "AcquisitionPlan.h"
+#include "DeviceClock.h"
+#include "FetchPlan.h"
+#include "SampleSource.h"
+
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace AONode
+{
+	/** Channels of the simulated SDK grouped into streams, as DeviceThread groups the device's */
+	struct SimulatedStream
+	{
+		std::string name;
+		std::vector<int> channelIDs;
+		double samplingRate = 0;
+
+		int getNumberOfChannels() const { return (int)channelIDs.size(); }
+	};
+
+	/** "RAW 01" and "ECOG HF 1 / 01" belong to the streams "RAW" and "ECOG HF 1" */
+	inline std::string getSimulatedStreamName(const char *channelName)
+	{
+		std::string name(channelName);
+		size_t end = name.size();
+		while (end > 0 && (std::isdigit((unsigned char)name[end - 1]) != 0))
+			end--;
+		while (end > 0 && (name[end - 1] == ' ' || name[end - 1] == '/'))
+			end--;
+		return name.substr(0, end);
+	}
+
+	/** Connects to the simulated device, false if it does not answer within 5 s */
+	inline bool connectSimulator(SampleSource &source)
+	{
+		AO::MAC_ADDR sysMAC = {0};
+		if (AO::DefaultStartConnection(&sysMAC, 0) != AO::eAO_OK)
+			return false;
+		for (int i = 0; i < 500 && !source.isConnected(); i++)
+			std::this_thread::sleep_for(std::chrono::milliseconds(10));
+		return source.isConnected();
+	}
+
+	/**
+		Every stream of the simulated device except the digital ports, which go to
+		DigitalInputs. The SDK does not report sampling rates, the plugin takes them
+		from its defaults files, here the device ticks between two blocks tell them.
+		Empty if a stream delivers nothing within 2 s
+	*/
+	inline std::vector<SimulatedStream> findSimulatedStreams(SampleSource &source)
+	{
+		std::vector<SimulatedStream> streams;
+		AO::uint32 numberOfChannels = 0;
+		if (source.getChannelsCount(&numberOfChannels) != AO::eAO_OK)
+			return streams;
+		std::vector<AO::SInformation> channels(numberOfChannels);
+		if (source.getAllChannels(channels.data(), (int)numberOfChannels) != AO::eAO_OK)
+			return streams;
+
+		for (const AO::SInformation &channel : channels)
+		{
+			const std::string streamName = getSimulatedStreamName(channel.channelName);
+			if (streamName.compare(0, 5, "Port-") == 0)
+				continue;
+			if (streams.empty() || streams.back().name != streamName)
+			{
+				streams.push_back(SimulatedStream());
+				streams.back().name = streamName;
+			}
+			streams.back().channelIDs.push_back(channel.channelID);
+		}
+
+		for (const SimulatedStream &stream : streams)
+			for (int channelID : stream.channelIDs)
+				source.addBufferChannel(channelID, 5000);
+		source.clearBuffers();
+
+		for (SimulatedStream &stream : streams)
+		{
+			std::vector<AO::int16> data(stream.getNumberOfChannels() * 4096);
+			AO::ULONG timeStamps[2];
+			int numberOfSamples[2];
+			for (int block = 0; block < 2; block++)
+			{
+				int numberOfItems = 0;
+				const int64_t deadlineNs = getTimeNs() + 2000000000;
+				while (source.getAlignedData(data.data(), (int)data.size(), &numberOfItems, stream.channelIDs.data(),
+											 stream.getNumberOfChannels(), &timeStamps[block]) != AO::eAO_OK ||
+					   numberOfItems == 0)
+				{
+					if (getTimeNs() > deadlineNs)
+						return std::vector<SimulatedStream>();
+					std::this_thread::sleep_for(std::chrono::milliseconds(1));
+				}
+				numberOfSamples[block] = numberOfItems / stream.getNumberOfChannels();
+			}
+			const double ticks = (double)(uint32_t)(timeStamps[1] - timeStamps[0]);
+			if (ticks <= 0)
+				return std::vector<SimulatedStream>();
+			stream.samplingRate = DeviceClockModel::DEVICE_CLOCK_HZ * numberOfSamples[0] / ticks;
+		}
+		return streams;
+	}
+
+	/** Channel ID of the first digital input port, -1 if there is none */
+	inline int findSimulatedDigitalPort(SampleSource &source)
+	{
+		AO::uint32 numberOfChannels = 0;
+		if (source.getChannelsCount(&numberOfChannels) != AO::eAO_OK)
+			return -1;
+		std::vector<AO::SInformation> channels(numberOfChannels);
+		if (source.getAllChannels(channels.data(), (int)numberOfChannels) != AO::eAO_OK)
+			return -1;
+
+		for (const AO::SInformation &channel : channels)
+			if (getSimulatedStreamName(channel.channelName).compare(0, 5, "Port-") == 0)
+				return channel.channelID;
+		return -1;
+	}
+
+	/** Plan of every channel of streams, as compileAcquisitionPlan makes it, at the Neuro Omega 0.195 uV per bit */
+	inline AcquisitionPlan makeSimulatedPlan(const std::vector<SimulatedStream> &streams)
+	{
+		AcquisitionPlan plan;
+		for (size_t idx = 0; idx < streams.size(); idx++)
+		{
+			StreamPlan streamPlan;
+			streamPlan.streamID = (int)idx;
+			streamPlan.sourceBufferIdx = (int)idx;
+			streamPlan.numberOfChannels = streams[idx].getNumberOfChannels();
+			streamPlan.bitVolts = 0.195f;
+			streamPlan.samplingRate = streams[idx].samplingRate;
+			streamPlan.channelIDs = nullptr;
+			plan.streams.push_back(streamPlan);
+			plan.channelIDs.insert(plan.channelIDs.end(), streams[idx].channelIDs.begin(), streams[idx].channelIDs.end());
+		}
+
+		int *channelIDsArray = plan.channelIDs.data();
+		for (StreamPlan &streamPlan : plan.streams)
+		{
+			streamPlan.channelIDs = channelIDsArray;
+			channelIDsArray += streamPlan.numberOfChannels;
+		}
+		return plan;
+	}
+
+	/** Reads every channel of plan */
+	inline std::unique_ptr<FetchPlan> makeCompleteFetchPlan(const AcquisitionPlan &plan)
+	{
+		std::unique_ptr<FetchPlan> fetchPlan = std::make_unique<FetchPlan>();
+		for (const StreamPlan &stream : plan.streams)
+		{
+			StreamFetch fetch;
+			fetch.channelIDs.assign(stream.channelIDs, stream.channelIDs + stream.numberOfChannels);
+			for (int ch = 0; ch < stream.numberOfChannels; ch++)
+				fetch.rows.push_back(ch);
+			fetch.complete = true;
+			fetchPlan->streams.push_back(fetch);
+		}
+		return fetchPlan;
+	}
+
+	/**
+		DeviceThread without the GUI: every block is copied once into a buffer the
+		size of a DataBuffer, as addToBuffer does, and read at once. Makes no
+		allocation once constructed
+	*/
+	class BufferingHost : public AcquisitionEngine::Host
+	{
+	public:
+		/** Samples per channel of each buffer, as DeviceThread makes them */
+		static const int BUFFER_SIZE = 10000;
+
+		explicit BufferingHost(const AcquisitionPlan &plan)
+		{
+			for (const StreamPlan &stream : plan.streams)
+			{
+				buffers.push_back(std::vector<float>((size_t)stream.numberOfChannels * BUFFER_SIZE));
+				bufferPositions.push_back(0);
+			}
+		}
+
+		bool shouldStop() override { return stopRequested.load(std::memory_order_relaxed); }
+
+		void blockFetched(const StreamPlan &, const StreamFetch &, uint32_t, int64_t, const int16_t *, int) override {}
+
+		int addBlock(const StreamPlan &stream, StreamScratch &scratch, int64_t, int numberOfSamplesPerChannel, int64_t) override
+		{
+			std::vector<float> &buffer = buffers[stream.sourceBufferIdx];
+			int &position = bufferPositions[stream.sourceBufferIdx];
+			for (int ch = 0; ch < stream.numberOfChannels; ch++)
+			{
+				const float *channel = scratch.sourceBufferData.get() + (size_t)ch * numberOfSamplesPerChannel;
+				float *destination = buffer.data() + (size_t)ch * BUFFER_SIZE;
+				for (int samp = 0, pos = position; samp < numberOfSamplesPerChannel; samp++, pos = (pos + 1) % BUFFER_SIZE)
+					destination[pos] = channel[samp];
+			}
+			position = (position + numberOfSamplesPerChannel) % BUFFER_SIZE;
+			return 0;
+		}
+
+		void fetchBufferGrown(const StreamPlan &, int) override {}
+
+		std::atomic<bool> stopRequested{false};
+
+	private:
+		std::vector<std::vector<float>> buffers;
+		std::vector<int> bufferPositions;
+	};
+}
+
+#endif // __SIMULATEDDEVICE_H__